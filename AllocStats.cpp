@@ -0,0 +1,150 @@
+//
+//  AllocStats.cpp
+//  Goober Eats
+//
+
+#include "AllocStats.h"
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+
+static const char* const SUBSYSTEM_NAMES[ALLOC_SUBSYSTEM_COUNT] = {
+    "other", "map", "router", "optimizer", "planner", "output"
+};
+
+#ifdef GOOBER_ALLOC_STATS
+
+// a header this size keeps the block behind it aligned as malloc's was
+const size_t ALLOC_HEADER_BYTES = 16;
+
+struct SubsystemCounters
+{
+    atomic<long long> liveBytes;
+    atomic<long long> peakBytes;
+    atomic<long long> allocations;
+    atomic<long long> liveBlocks;
+};
+
+// zero-initialized before any constructor runs, so allocations made during static
+// initialization are counted too
+static SubsystemCounters g_counters[ALLOC_SUBSYSTEM_COUNT];
+static thread_local unsigned char g_allocTag = ALLOC_OTHER;
+
+AllocScope::AllocScope(AllocSubsystem subsystem)
+{
+    m_previous = g_allocTag;
+    g_allocTag = subsystem;
+}
+
+AllocScope::~AllocScope()
+{
+    g_allocTag = m_previous;
+}
+
+static void* countedAlloc(size_t size)
+{
+    char* block = static_cast<char*>(malloc(size + ALLOC_HEADER_BYTES));
+    if ( block == nullptr )
+        return nullptr;
+    unsigned char tag = g_allocTag;
+    *reinterpret_cast<size_t*>(block) = size;
+    block[sizeof(size_t)] = tag;
+
+    SubsystemCounters& c = g_counters[tag];
+    long long live = c.liveBytes.fetch_add(size, memory_order_relaxed) + size;
+    c.allocations.fetch_add(1, memory_order_relaxed);
+    c.liveBlocks.fetch_add(1, memory_order_relaxed);
+    long long peak = c.peakBytes.load(memory_order_relaxed);
+    while ( live > peak  &&  !c.peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed) )
+        ;
+    return block + ALLOC_HEADER_BYTES;
+}
+
+static void countedFree(void* p)
+{
+    if ( p == nullptr )
+        return;
+    char* block = static_cast<char*>(p) - ALLOC_HEADER_BYTES;
+    size_t size = *reinterpret_cast<size_t*>(block);
+    SubsystemCounters& c = g_counters[static_cast<unsigned char>(block[sizeof(size_t)])];
+    c.liveBytes.fetch_sub(size, memory_order_relaxed);
+    c.liveBlocks.fetch_sub(1, memory_order_relaxed);
+    free(block);
+}
+
+static void* countedNew(size_t size)
+{
+    void* p = countedAlloc(size);
+    while ( p == nullptr )
+    {
+        new_handler handler = get_new_handler();
+        if ( handler == nullptr )
+            throw bad_alloc();
+        handler();
+        p = countedAlloc(size);
+    }
+    return p;
+}
+
+void* operator new(size_t size) { return countedNew(size); }
+void* operator new[](size_t size) { return countedNew(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { countedFree(p); }
+
+bool allocationStatsAvailable()
+{
+    return true;
+}
+
+AllocStats allocationStats(AllocSubsystem subsystem)
+{
+    const SubsystemCounters& c = g_counters[subsystem];
+    AllocStats s;
+    s.liveBytes = c.liveBytes.load(memory_order_relaxed);
+    s.peakBytes = c.peakBytes.load(memory_order_relaxed);
+    s.allocations = c.allocations.load(memory_order_relaxed);
+    s.liveBlocks = c.liveBlocks.load(memory_order_relaxed);
+    return s;
+}
+
+#else
+
+bool allocationStatsAvailable()
+{
+    return false;
+}
+
+AllocStats allocationStats(AllocSubsystem)
+{
+    AllocStats s = { 0, 0, 0, 0 };
+    return s;
+}
+
+#endif
+
+void writeAllocationReport(ostream& out)
+{
+    if ( !allocationStatsAvailable() )
+    {
+        out << "Allocation accounting is off; rebuild with -DGOOBER_ALLOC_STATS." << endl;
+        return;
+    }
+    out << "subsystem       live KB    peak KB   live blocks   allocations" << endl;
+    for ( int i = 0 ; i < ALLOC_SUBSYSTEM_COUNT ; i++ )
+    {
+        AllocStats s = allocationStats(AllocSubsystem(i));
+        char line[128];
+        snprintf(line, sizeof(line), "%-10s %10.1f %10.1f %13lld %13lld",
+                 SUBSYSTEM_NAMES[i], s.liveBytes / 1024.0, s.peakBytes / 1024.0, s.liveBlocks, s.allocations);
+        out << line << endl;
+    }
+}
@@ -0,0 +1,61 @@
+
+#ifndef ALLOC_STATS_INCLUDED
+#define ALLOC_STATS_INCLUDED
+
+#include <iostream>
+
+// AllocStats.h
+
+// Heap use broken down by the part of the program that allocated it.
+//
+// Accounting is opt-in at build time: compile with -DGOOBER_ALLOC_STATS and the global
+// operator new and delete are replaced by versions that put a 16 byte header in front of each
+// block, recording its size and the subsystem that allocated it. Without the flag nothing is
+// replaced, ALLOC_SCOPE compiles to nothing and allocationStatsAvailable() is false.
+//
+// ALLOC_SCOPE(ALLOC_ROUTER) charges everything allocated on this thread for the rest of the
+// enclosing block to the router; the innermost scope wins. A block is credited back to whoever
+// allocated it when it's freed, wherever that happens, so live bytes are what each subsystem
+// still has outstanding.
+
+enum AllocSubsystem
+{
+    ALLOC_OTHER, ALLOC_MAP, ALLOC_ROUTER, ALLOC_OPTIMIZER, ALLOC_PLANNER, ALLOC_OUTPUT, ALLOC_SUBSYSTEM_COUNT
+};
+
+struct AllocStats
+{
+    long long liveBytes;
+    long long peakBytes;
+    long long allocations;      // ever made
+    long long liveBlocks;
+};
+
+bool allocationStatsAvailable();
+AllocStats allocationStats(AllocSubsystem subsystem);
+void writeAllocationReport(std::ostream& out);
+
+#ifdef GOOBER_ALLOC_STATS
+
+class AllocScope
+{
+public:
+    AllocScope(AllocSubsystem subsystem);
+    ~AllocScope();
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+private:
+    unsigned char m_previous;
+};
+
+#define ALLOC_CONCAT2(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT2(a, b)
+#define ALLOC_SCOPE(subsystem) AllocScope ALLOC_CONCAT(allocScope, __LINE__)(subsystem)
+
+#else
+
+#define ALLOC_SCOPE(subsystem)
+
+#endif
+
+#endif // ALLOC_STATS_INCLUDED
@@ -0,0 +1,312 @@
+//
+//  ChainGraph.cpp
+//  Goober Eats
+//
+
+#include "ChainGraph.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+ChainGraph::ChainGraph()
+{
+    m_graph = nullptr;
+}
+
+void ChainGraph::clear()
+{
+    m_graph = nullptr;
+    m_junctionOf.clear();
+    m_nodeChain.clear();
+    m_nodeOffset.clear();
+    m_junctionNode.clear();
+    m_chainStart.clear();
+    m_chainSource.clear();
+    m_chainTarget.clear();
+    m_chainReverse.clear();
+    m_chainMiles.clear();
+    m_chainEdgeStart.clear();
+    m_chainEdges.clear();
+}
+
+  // drives from a junction along edge until the next junction, which it returns
+int ChainGraph::walk(int from, int edge, vector<int>& edges) const
+{
+    const StreetGraph& g = *m_graph;
+    edges.push_back(edge);
+    int previous = from, at = g.edgeTarget(edge);
+    while ( m_junctionOf[at] == -1 )
+    {
+        int e = g.firstEdge(at);
+        if ( g.edgeTarget(e) == previous )
+            e++;
+        edges.push_back(e);
+        previous = at;
+        at = g.edgeTarget(e);
+    }
+    return at;
+}
+
+void ChainGraph::build(const StreetGraph& g)
+{
+    TRACE_SPAN("ChainGraph::build");
+    ALLOC_SCOPE(ALLOC_MAP);
+    clear();
+    m_graph = &g;
+    int n = g.nodeCount();
+
+    // first just mark the junctions (0 for now), then find loops that don't have one
+    m_junctionOf.assign(n, -1);
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        int first = g.firstEdge(v);
+        if ( g.lastEdge(v) - first != 2  ||  g.edgeTarget(first) == g.edgeTarget(first + 1) )
+            m_junctionOf[v] = 0;
+    }
+    vector<char> seen(n, 0);
+    vector<int> edges;
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        if ( m_junctionOf[v] == -1 )
+            continue;
+        seen[v] = 1;
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+        {
+            edges.clear();
+            walk(v, e, edges);
+            for ( size_t i = 0 ; i + 1 < edges.size() ; i++ )
+                seen[g.edgeTarget(edges[i])] = 1;
+        }
+    }
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        if ( seen[v] )
+            continue;
+        m_junctionOf[v] = 0;
+        edges.clear();
+        walk(v, g.firstEdge(v), edges);
+        for ( size_t i = 0 ; i < edges.size() ; i++ )
+            seen[g.edgeTarget(edges[i])] = 1;
+    }
+
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        if ( m_junctionOf[v] != -1 )
+        {
+            m_junctionOf[v] = m_junctionNode.size();
+            m_junctionNode.push_back(v);
+        }
+    }
+
+    m_nodeChain.assign(n, -1);
+    m_nodeOffset.assign(n, -1);
+    m_chainEdgeStart.push_back(0);
+    for ( size_t j = 0 ; j < m_junctionNode.size() ; j++ )
+    {
+        int v = m_junctionNode[j];
+        m_chainStart.push_back(m_chainTarget.size());
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+        {
+            edges.clear();
+            int end = walk(v, e, edges);
+            int c = m_chainTarget.size();
+            double miles = 0;
+            for ( size_t i = 0 ; i < edges.size() ; i++ )
+            {
+                miles += g.edgeMiles(edges[i]);
+                int inside = g.edgeTarget(edges[i]);
+                if ( i + 1 < edges.size()  &&  m_nodeChain[inside] == -1 )
+                {
+                    m_nodeChain[inside] = c;
+                    m_nodeOffset[inside] = i + 1;
+                }
+            }
+            m_chainSource.push_back(j);
+            m_chainTarget.push_back(m_junctionOf[end]);
+            m_chainMiles.push_back(miles);
+            m_chainEdges.insert(m_chainEdges.end(), edges.begin(), edges.end());
+            m_chainEdgeStart.push_back(m_chainEdges.size());
+        }
+    }
+    m_chainStart.push_back(m_chainTarget.size());
+
+    // the way back along a chain starts from its far junction towards its last inside node,
+    // which no other chain from there does; a chain of one edge has nothing inside to need it
+    m_chainReverse.assign(m_chainTarget.size(), -1);
+    for ( size_t c = 0 ; c < m_chainTarget.size() ; c++ )
+    {
+        int length = chainLength(c);
+        if ( length < 2 )
+            continue;
+        int lastInside = g.edgeTarget(m_chainEdges[m_chainEdgeStart[c] + length - 2]);
+        int j = m_chainTarget[c];
+        for ( int r = m_chainStart[j] ; r < m_chainStart[j + 1] ; r++ )
+        {
+            if ( g.edgeTarget(m_chainEdges[m_chainEdgeStart[r]]) == lastInside )
+                m_chainReverse[c] = r;
+        }
+    }
+}
+
+double ChainGraph::milesAlong(int chain, int begin, int end) const
+{
+    double miles = 0;
+    for ( int i = m_chainEdgeStart[chain] + begin ; i < m_chainEdgeStart[chain] + end ; i++ )
+        miles += m_graph->edgeMiles(m_chainEdges[i]);
+    return miles;
+}
+
+void ChainGraph::appendEdges(int chain, int begin, int end, vector<int>& edges) const
+{
+    edges.insert(edges.end(), m_chainEdges.begin() + m_chainEdgeStart[chain] + begin,
+                 m_chainEdges.begin() + m_chainEdgeStart[chain] + end);
+}
+
+template<typename OpenSet>
+DeliveryResult ChainGraph::route(int start, int end, SearchArrays<OpenSet>& s, vector<int>& edges,
+                                 const Deadline* deadline) const
+{
+    const StreetGraph& g = *m_graph;
+    CrowFliesHeuristic crow = { 1 };
+    s.prepare(junctionCount());
+    edges.clear();
+
+    double weight = 1;
+    auto push = [&](int j, double c, int chain, int offset) {
+        if ( s.cost[j] >= 0  &&  c >= s.cost[j] )
+            return;
+        if ( s.cost[j] < 0 )
+            s.touched.push_back(j);
+        s.cost[j] = c;
+        s.via[j] = chain;               // -1 for the start itself
+        s.previous[j] = offset;         // edges of chain skipped, when the route starts inside it
+        s.open.push(j, c + weight * crow.estimate(g, m_junctionNode[j], end));
+    };
+
+    // the route ends at a junction, or along the chain end is inside from one of its two ends
+    Tail tails[2];
+    int tailCount = 0;
+    if ( m_junctionOf[end] != -1 )
+        tails[tailCount++] = Tail{ m_junctionOf[end], 0, -1, 0 };
+    else
+    {
+        int c = m_nodeChain[end], r = m_chainReverse[c];
+        int length = chainLength(c), at = m_nodeOffset[end];
+        tails[tailCount++] = Tail{ m_chainSource[c], milesAlong(c, 0, at), c, at };
+        tails[tailCount++] = Tail{ m_chainSource[r], milesAlong(r, 0, length - at), r, length - at };
+    }
+
+    double best = numeric_limits<double>::infinity();
+    int bestTail = -1;
+    int directChain = -1, directBegin = 0, directEnd = 0;
+    if ( m_junctionOf[start] != -1 )
+        push(m_junctionOf[start], 0, -1, 0);
+    else
+    {
+        int c = m_nodeChain[start], r = m_chainReverse[c];
+        int length = chainLength(c), at = m_nodeOffset[start];
+        if ( m_junctionOf[end] == -1  &&  m_nodeChain[end] == c )
+        {
+            // both inside the same chain: straight along it is one candidate
+            int endAt = m_nodeOffset[end];
+            if ( at < endAt )
+            {
+                directChain = c;
+                directBegin = at;
+                directEnd = endAt;
+            }
+            else
+            {
+                directChain = r;
+                directBegin = length - at;
+                directEnd = length - endAt;
+            }
+            best = milesAlong(directChain, directBegin, directEnd);
+        }
+        push(m_chainTarget[c], milesAlong(c, at, length), c, at);
+        push(m_chainTarget[r], milesAlong(r, length - at, length), r, length - at);
+    }
+
+    // with the estimate weighted, stopping once the smallest key reaches best still keeps the
+    // route within DEADLINE_ROUTE_WEIGHT times the shortest
+    unsigned int polls = 0;
+    while ( !s.open.empty() )
+    {
+        if ( weight == 1  &&  deadlinePassed(deadline, polls) )
+        {
+            weight = DEADLINE_ROUTE_WEIGHT;
+            s.open.clear();
+            for ( size_t i = 0 ; i < s.touched.size() ; i++ )
+            {
+                int j = s.touched[i];
+                if ( !s.closed[j] )
+                    s.open.push(j, s.cost[j] + weight * crow.estimate(g, m_junctionNode[j], end));
+            }
+        }
+        OpenEntry top = s.open.pop();
+        if ( top.key >= best )
+            break;
+        int j = top.state;
+        if ( s.closed[j] )
+            continue;
+        s.closed[j] = 1;
+        double cost = s.cost[j];
+        for ( int t = 0 ; t < tailCount ; t++ )
+        {
+            if ( tails[t].junction == j  &&  cost + tails[t].miles < best )
+            {
+                best = cost + tails[t].miles;
+                bestTail = t;
+            }
+        }
+        for ( int c = m_chainStart[j] ; c < m_chainStart[j + 1] ; c++ )
+            push(m_chainTarget[c], cost + m_chainMiles[c], c, 0);
+    }
+
+    if ( bestTail != -1 )
+    {
+        // back from the tail's junction to the start, a chain at a time
+        for ( int j = tails[bestTail].junction ; s.via[j] != -1 ; )
+        {
+            int c = s.via[j], skipped = s.previous[j];
+            for ( int i = m_chainEdgeStart[c + 1] - 1 ; i >= m_chainEdgeStart[c] + skipped ; i-- )
+                edges.push_back(m_chainEdges[i]);
+            if ( skipped > 0 )
+                break;
+            j = m_chainSource[c];
+        }
+        reverse(edges.begin(), edges.end());
+        if ( tails[bestTail].chain != -1 )
+            appendEdges(tails[bestTail].chain, 0, tails[bestTail].edgeCount, edges);
+    }
+    else if ( directChain != -1 )
+        appendEdges(directChain, directBegin, directEnd, edges);
+    s.reset();
+    if ( bestTail == -1  &&  directChain == -1 )
+        return NO_ROUTE;
+    return weight == 1 ? DELIVERY_SUCCESS : DEADLINE_EXCEEDED;
+}
+
+  // the routers use both kinds of open set
+template DeliveryResult ChainGraph::route(int, int, SearchScratch&, vector<int>&, const Deadline*) const;
+template DeliveryResult ChainGraph::route(int, int, RadixSearchScratch&, vector<int>&, const Deadline*) const;
+
+void ChainGraph::report(ostream& out) const
+{
+    if ( m_graph == nullptr  ||  m_graph->nodeCount() == 0 )
+    {
+        out << "Chain graph is empty." << endl;
+        return;
+    }
+    size_t bytes = m_junctionOf.size() * 3 * sizeof(int) + m_junctionNode.size() * 2 * sizeof(int)
+                 + m_chainTarget.size() * (5 * sizeof(int) + sizeof(double)) + m_chainEdges.size() * sizeof(int);
+    out.setf(ios::fixed);
+    out.precision(1);
+    out << "Chain graph: " << junctionCount() << " junctions (" << 100.0 * junctionCount() / m_graph->nodeCount()
+        << "% of nodes), " << chainCount() << " chains (" << 100.0 * chainCount() / m_graph->edgeCount()
+        << "% of edges), " << double(m_chainEdges.size()) / chainCount() << " edges per chain, "
+        << bytes / 1024 << " KB" << endl;
+}
@@ -0,0 +1,82 @@
+
+#ifndef CHAIN_GRAPH_INCLUDED
+#define CHAIN_GRAPH_INCLUDED
+
+#include "StreetGraph.h"
+#include "RoutingPolicies.h"
+#include "GraphMemory.h"
+#include <vector>
+#include <iostream>
+
+// ChainGraph.h
+
+// A StreetGraph with its degree-2 chains collapsed, for searching by distance.
+//
+// mapdata.txt breaks a street into a segment per block and more, so most intersections just
+// join two segments and give a search nothing to decide. Here only the junctions (intersections
+// with other than two streets, or two that go back to the same place) are searched over, and
+// each run of segments between two junctions is one chain, with its length added up and the
+// StreetGraph edges it's made of kept in order. A route found over chains expands back into
+// exactly the edges, and so the StreetSegments, the full graph would have given.
+//
+// Every chain is stored once in each direction. An intersection inside a chain remembers which
+// chain and how far along it is, so a route can still start or end there. A loop of
+// intersections with no junction on it gets one of its own made a junction.
+
+class ChainGraph
+{
+public:
+    ChainGraph();
+    void clear();
+    void build(const StreetGraph& g);
+
+    int junctionCount() const { return m_junctionNode.size(); }
+    int chainCount() const { return m_chainTarget.size(); }
+
+      // the StreetGraph edges of the shortest route from node start to node end, first to last;
+      // NO_ROUTE if there isn't one; scratch is a SearchScratch or a RadixSearchScratch. Past
+      // deadline it finishes as searchStreetGraph does and returns DEADLINE_EXCEEDED
+    template<typename OpenSet>
+    DeliveryResult route(int start, int end, SearchArrays<OpenSet>& scratch, std::vector<int>& edges,
+                         const Deadline* deadline = nullptr) const;
+
+      // how much smaller the searched graph is than g
+    void report(std::ostream& out) const;
+
+    ChainGraph(const ChainGraph&) = delete;
+    ChainGraph& operator=(const ChainGraph&) = delete;
+private:
+    struct Tail                         // a way from a junction to the end of the route
+    {
+        int junction;
+        double miles;
+        int chain;
+        int edgeCount;                  // of the chain's first edges
+    };
+
+    int walk(int from, int edge, std::vector<int>& edges) const;
+    int chainLength(int chain) const { return m_chainEdgeStart[chain + 1] - m_chainEdgeStart[chain]; }
+    double milesAlong(int chain, int begin, int end) const;
+    void appendEdges(int chain, int begin, int end, std::vector<int>& edges) const;
+
+    const StreetGraph* m_graph;
+
+    // per StreetGraph node: junction number, or -1 and the chain it's inside and its place on it
+    GraphArray<int> m_junctionOf;
+    GraphArray<int> m_nodeChain;
+    GraphArray<int> m_nodeOffset;       // edges from the chain's start
+
+    // per junction
+    GraphArray<int> m_junctionNode;
+    GraphArray<int> m_chainStart;       // junctionCount() + 1 entries
+
+    // per chain, leaving junction j are chains m_chainStart[j]..m_chainStart[j+1]-1
+    GraphArray<int> m_chainSource;
+    GraphArray<int> m_chainTarget;
+    GraphArray<int> m_chainReverse;     // the same chain driven the other way; -1 for one edge
+    GraphArray<double> m_chainMiles;
+    GraphArray<int> m_chainEdgeStart;   // chainCount() + 1 entries into m_chainEdges
+    GraphArray<int> m_chainEdges;
+};
+
+#endif // CHAIN_GRAPH_INCLUDED
@@ -0,0 +1,84 @@
+#ifndef DEADLINE_INCLUDED
+#define DEADLINE_INCLUDED
+
+#include <atomic>
+#include <chrono>
+
+// Deadline.h
+
+// A time limit, a cancellation switch, or both, for callers with a latency budget (live ETA
+// quotes). Hand one to PointToPointRouter, a StreetRouter, DeliveryOptimizer, DeliveryPlan or
+// DeliveryPlanner with setDeadline() before starting; it has to outlive the call. Once it has
+// passed, or once cancel() is called from any thread, the search loops stop looking for
+// something better and finish with what they have, and the call returns DEADLINE_EXCEEDED
+// along with that result:
+//
+//   PointToPointRouter,    finish the search greedily; the route never costs more than
+//   StreetRouter           DEADLINE_ROUTE_WEIGHT times the cheapest
+//   DeliveryOptimizer      keeps the best order found so far
+//   DeliveryPlan(ner)      doesn't poll itself: it routes every leg of that order, with the
+//                          routers hurrying, and checks the deadline once they're done, so a
+//                          deadline that passed at any point gives the plan DEADLINE_EXCEEDED.
+//                          The plan may miss time windows an unhurried search would have met
+//
+// A leg read off a depot tree (DepotTrees.h) takes no search, so it never looks at the deadline.
+//
+// Loops call pollExpired(), which looks at the cancel flag every time but at the clock only
+// every DEADLINE_POLL_INTERVAL calls.
+
+const unsigned int DEADLINE_POLL_INTERVAL = 64;
+
+// once the deadline passes, a route search carries on with the distance left counted this many
+// times over, which heads straight for the end and can't give a route costing more than this
+// many times the cheapest
+const double DEADLINE_ROUTE_WEIGHT = 2;
+
+class Deadline
+{
+public:
+      // never runs out, but can still be cancelled
+    Deadline()
+     : m_timed(false), m_cancelled(false)
+    {}
+
+    explicit Deadline(double milliseconds)
+     : m_when(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double, std::milli>(milliseconds))),
+       m_timed(true), m_cancelled(false)
+    {}
+
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+
+    bool expired() const
+    {
+        if ( m_cancelled.load(std::memory_order_relaxed) )
+            return true;
+        if ( !m_timed  ||  std::chrono::steady_clock::now() < m_when )
+            return false;
+        m_cancelled.store(true, std::memory_order_relaxed); // so nobody reads the clock again
+        return true;
+    }
+
+      // polls is the caller's own counter, starting at 0 so the first call reads the clock
+    bool pollExpired(unsigned int& polls) const
+    {
+        if ( m_cancelled.load(std::memory_order_relaxed) )
+            return true;
+        return polls++ % DEADLINE_POLL_INTERVAL == 0  &&  expired();
+    }
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+private:
+    std::chrono::steady_clock::time_point m_when;
+    bool m_timed;
+    mutable std::atomic<bool> m_cancelled;
+};
+
+  // for code that may not have been given a deadline
+inline bool deadlinePassed(const Deadline* deadline, unsigned int& polls)
+{
+    return deadline != nullptr  &&  deadline->pollExpired(polls);
+}
+
+#endif // DEADLINE_INCLUDED
@@ -7,52 +7,471 @@
 //
 
 #include "provided.h"
+#include "TimeWindows.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include "Deadline.h"
 #include <vector>
+#include <limits>
+#include <algorithm>
 using namespace std;
 
+// batches up to this size are solved exactly unless the caller says otherwise
+const int DEFAULT_EXACT_SOLVER_LIMIT = 15;
+
+// the Held-Karp table holds 2^n * n entries, so never go past this no matter what is requested
+const int MAX_EXACT_SOLVER_LIMIT = 20;
+
+// rows of the DP table are padded to a multiple of this so the inner loop runs in whole lanes
+const int DP_LANES = 4;
+
+const double INFINITE_DISTANCE = numeric_limits<double>::infinity();
+
+// everything the solvers need about one batch. stops are 0..n-1 and the depot is n;
+// distances and travel times are (n+1) x (n+1) row-major matrices
+struct OrderingProblem
+{
+    int n;
+    vector<double> dist;                // crow-flies miles
+    vector<double> travel;              // minutes
+    vector<ScheduleSegment> stop;       // time window and service time of each stop
+    bool timed;                         // false if no stop has a window, so schedules can be skipped
+
+    double d(int a, int b) const { return dist[a * (n + 1) + b]; }
+    double t(int a, int b) const { return travel[a * (n + 1) + b]; }
+};
+
 class DeliveryOptimizerImpl
 {
 public:
     DeliveryOptimizerImpl(const StreetMap* sm);
     ~DeliveryOptimizerImpl();
-    void optimizeDeliveryOrder(
+    bool optimizeDeliveryOrder(
         const GeoCoord& depot,
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+    void setExactSolverLimit(int maxStops);
+    void setAverageSpeed(double milesPerHour);
+    void setDeadline(const Deadline* deadline);
 private:
     const StreetMap* m_streetMap;
+    int m_exactSolverLimit;
+    double m_averageSpeed;
+    const Deadline* m_deadline;
 };
 
+static double tourLength(const OrderingProblem& p, const vector<int>& order)
+{
+    int n = p.n;
+    double length = p.d(n, order[0]);
+    for ( int i = 0 ; i < n - 1 ; i++ )
+        length += p.d(order[i], order[i+1]);
+    length += p.d(order[n-1], n);
+    return length;
+}
+
+  // total time warp of depot -> order -> depot
+static double tourTimeWarp(const OrderingProblem& p, const vector<int>& order)
+{
+    if ( !p.timed )
+        return 0;
+    int n = p.n;
+    ScheduleSegment s = p.stop[n];
+    int previous = n;
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        s = concatenate(s, p.t(previous, order[i]), p.stop[order[i]]);
+        previous = order[i];
+    }
+    s = concatenate(s, p.t(previous, n), p.stop[n]);
+    return s.timeWarp;
+}
+
+  // less time warp wins, and among equally (in)feasible tours the shorter one wins
+static bool isBetter(double warp, double length, double otherWarp, double otherLength)
+{
+    if ( warp < otherWarp - TIME_WARP_TOLERANCE )
+        return true;
+    return warp <= otherWarp + TIME_WARP_TOLERANCE  &&  length < otherLength - 1e-12;
+}
+
+// min over i of row[i] + col[i], with the row padded to a whole number of lanes.
+// each lane keeps its own running minimum so the loop is an element-wise min, which
+// the compiler turns into packed adds and mins
+static inline double minPlus(const double* row, const double* col, int stride)
+{
+    double lane[DP_LANES];
+    for ( int k = 0 ; k < DP_LANES ; k++ )
+        lane[k] = INFINITE_DISTANCE;
+    for ( int i = 0 ; i < stride ; i += DP_LANES )
+    {
+        for ( int k = 0 ; k < DP_LANES ; k++ )
+        {
+            double c = row[i + k] + col[i + k];
+            lane[k] = c < lane[k] ? c : lane[k];
+        }
+    }
+    double best = lane[0];
+    for ( int k = 1 ; k < DP_LANES ; k++ )
+        best = lane[k] < best ? lane[k] : best;
+    return best;
+}
+
+// Held-Karp over subsets of stops. best[mask][j] is the shortest path that leaves the depot,
+// visits exactly the stops in mask and ends at stop j. Entries for j outside mask stay infinite,
+// which lets the inner loop run over a full row without testing bits. Returns false, with no
+// order, if the deadline passes first: a partial table has no tour in it.
+static bool solveExact(const OrderingProblem& p, const Deadline* deadline, vector<int>& order)
+{
+    int n = p.n;
+    int stride = (n + DP_LANES - 1) / DP_LANES * DP_LANES;
+    unsigned int full = (1u << n) - 1;
+
+    // toStop[j][i] = dist(i, j), so the column we need for stop j is contiguous
+    vector<double> toStop(n * stride, INFINITE_DISTANCE);
+    for ( int j = 0 ; j < n ; j++ )
+        for ( int i = 0 ; i < n ; i++ )
+            toStop[j * stride + i] = p.d(i, j);
+
+    vector<double> best((size_t(full) + 1) * stride, INFINITE_DISTANCE);
+    for ( int j = 0 ; j < n ; j++ )
+        best[(size_t(1) << j) * stride + j] = p.d(n, j);
+
+    unsigned int polls = 0;
+    for ( unsigned int mask = 1 ; mask <= full ; mask++ )
+    {
+        if ( (mask & (mask - 1)) == 0 ) // single stop, already seeded from the depot
+            continue;
+        if ( deadlinePassed(deadline, polls) )
+            return false;
+        double* row = &best[size_t(mask) * stride];
+        for ( int j = 0 ; j < n ; j++ )
+        {
+            if ( (mask & (1u << j)) == 0 )
+                continue;
+            unsigned int prev = mask ^ (1u << j);
+            row[j] = minPlus(&best[size_t(prev) * stride], &toStop[j * stride], stride);
+        }
+    }
+
+    // close the tour back at the depot
+    int last = 0;
+    double bestLength = INFINITE_DISTANCE;
+    for ( int j = 0 ; j < n ; j++ )
+    {
+        double length = best[size_t(full) * stride + j] + p.d(j, n);
+        if ( length < bestLength )
+        {
+            bestLength = length;
+            last = j;
+        }
+    }
+
+    // walk backwards, re-deriving each predecessor instead of storing a parent table
+    order.assign(n, 0);
+    unsigned int mask = full;
+    int j = last;
+    for ( int pos = n - 1 ; pos > 0 ; pos-- )
+    {
+        order[pos] = j;
+        unsigned int prev = mask ^ (1u << j);
+        const double* prevRow = &best[size_t(prev) * stride];
+        int pred = -1;
+        double predLength = INFINITE_DISTANCE;
+        for ( int i = 0 ; i < n ; i++ )
+        {
+            double length = prevRow[i] + p.d(i, j);
+            if ( length < predLength )
+            {
+                predLength = length;
+                pred = i;
+            }
+        }
+        mask = prev;
+        j = pred;
+    }
+    order[0] = j;
+    return true;
+}
+
+static void constructNearestNeighbor(const OrderingProblem& p, vector<int>& order)
+{
+    int n = p.n;
+    order.clear();
+    vector<bool> used(n, false);
+    int current = n;
+    for ( int k = 0 ; k < n ; k++ )
+    {
+        int next = -1;
+        for ( int i = 0 ; i < n ; i++ )
+        {
+            if ( !used[i] && (next == -1 || p.d(current, i) < p.d(current, next)) )
+                next = i;
+        }
+        used[next] = true;
+        order.push_back(next);
+        current = next;
+    }
+}
+
+  // tightest deadline first, which is the natural starting point when windows bind
+static void constructByDeadline(const OrderingProblem& p, vector<int>& order)
+{
+    order.clear();
+    for ( int i = 0 ; i < p.n ; i++ )
+        order.push_back(i);
+    stable_sort(order.begin(), order.end(), [&p](int a, int b) {
+        return p.stop[a].latest < p.stop[b].latest;
+    });
+}
+
+// 2-opt and single-stop relocation until no move helps. tour[0] and tour[n+1] are the depot.
+// forward[k] summarizes the schedule of tour[0..k] and backward[k] that of tour[k..n+1], so
+// each candidate move is checked by joining a prefix, the rearranged middle and a suffix.
+// The middle is grown one stop at a time as the inner loop advances, which keeps every check
+// constant time; the arrays are only rebuilt after a move is taken. Every move leaves a whole
+// tour, so stopping at the deadline between passes leaves the best one so far.
+static void improveTour(const OrderingProblem& p, const Deadline* deadline, vector<int>& order)
+{
+    int n = p.n;
+    vector<int> tour;
+    tour.push_back(n);
+    for ( int i = 0 ; i < n ; i++ )
+        tour.push_back(order[i]);
+    tour.push_back(n);
+
+    vector<ScheduleSegment> forward(n + 2), backward(n + 2);
+    double currentWarp = 0;
+    auto rebuildSchedules = [&]() {
+        if ( !p.timed )
+            return;
+        forward[0] = p.stop[n];
+        for ( int k = 1 ; k <= n + 1 ; k++ )
+            forward[k] = concatenate(forward[k-1], p.t(tour[k-1], tour[k]), p.stop[tour[k]]);
+        backward[n+1] = p.stop[n];
+        for ( int k = n ; k >= 0 ; k-- )
+            backward[k] = concatenate(p.stop[tour[k]], p.t(tour[k], tour[k+1]), backward[k+1]);
+        currentWarp = forward[n+1].timeWarp;
+    };
+    rebuildSchedules();
+
+    bool improved = true;
+    unsigned int polls = 0;
+    while ( improved  &&  !deadlinePassed(deadline, polls) )
+    {
+        improved = false;
+
+        // 2-opt: reverse tour[i..j]
+        for ( int i = 1 ; i < n ; i++ )
+        {
+            ScheduleSegment reversed = p.stop[tour[i]];
+            for ( int j = i + 1 ; j <= n ; j++ )
+            {
+                int a = tour[i-1], b = tour[i], c = tour[j], e = tour[j+1];
+                double warp = 0;
+                if ( p.timed )
+                {
+                    reversed = concatenate(p.stop[c], p.t(c, tour[j-1]), reversed);
+                    ScheduleSegment s = concatenate(forward[i-1], p.t(a, c), reversed);
+                    warp = concatenate(s, p.t(b, e), backward[j+1]).timeWarp;
+                }
+                double delta = p.d(a, c) + p.d(b, e) - p.d(a, b) - p.d(c, e);
+                if ( isBetter(warp, delta, currentWarp, 0) )
+                {
+                    for ( int lo = i, hi = j ; lo < hi ; lo++, hi-- )
+                        swap(tour[lo], tour[hi]);
+                    rebuildSchedules();
+                    improved = true;
+                    break;
+                }
+            }
+        }
+
+        // relocation: take tour[from] out and put it back between tour[q] and tour[q+1]
+        for ( int from = 1 ; from <= n ; from++ )
+        {
+            bool moved = false;
+            int node = tour[from], prev = tour[from-1], next = tour[from+1];
+            double removeGain = p.d(prev, node) + p.d(node, next) - p.d(prev, next);
+
+            // later in the tour; middle is tour[from+1..q]
+            ScheduleSegment middle = p.stop[next];
+            for ( int q = from + 1 ; q <= n ; q++ )
+            {
+                int x = tour[q], y = tour[q+1];
+                double warp = 0;
+                if ( p.timed )
+                {
+                    if ( q > from + 1 )
+                        middle = concatenate(middle, p.t(tour[q-1], x), p.stop[x]);
+                    ScheduleSegment s = concatenate(forward[from-1], p.t(prev, next), middle);
+                    s = concatenate(s, p.t(x, node), p.stop[node]);
+                    warp = concatenate(s, p.t(node, y), backward[q+1]).timeWarp;
+                }
+                double delta = p.d(x, node) + p.d(node, y) - p.d(x, y) - removeGain;
+                if ( isBetter(warp, delta, currentWarp, 0) )
+                {
+                    tour.erase(tour.begin() + from);
+                    tour.insert(tour.begin() + q, node);
+                    rebuildSchedules();
+                    improved = moved = true;
+                    break;
+                }
+            }
+            if ( moved )
+                continue;
+
+            // earlier in the tour; middle is tour[q+1..from-1]
+            if ( from >= 2 )
+                middle = p.stop[prev];
+            for ( int q = from - 2 ; q >= 0 ; q-- )
+            {
+                int x = tour[q], y = tour[q+1];
+                double warp = 0;
+                if ( p.timed )
+                {
+                    if ( q < from - 2 )
+                        middle = concatenate(p.stop[y], p.t(y, tour[q+2]), middle);
+                    ScheduleSegment s = concatenate(forward[q], p.t(x, node), p.stop[node]);
+                    s = concatenate(s, p.t(node, y), middle);
+                    warp = concatenate(s, p.t(prev, next), backward[from+1]).timeWarp;
+                }
+                double delta = p.d(x, node) + p.d(node, y) - p.d(x, y) - removeGain;
+                if ( isBetter(warp, delta, currentWarp, 0) )
+                {
+                    tour.erase(tour.begin() + from);
+                    tour.insert(tour.begin() + q + 1, node);
+                    rebuildSchedules();
+                    improved = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for ( int i = 0 ; i < n ; i++ )
+        order[i] = tour[i+1];
+}
+
+  // construct a few starting tours, improve each, keep the best
+static void solveHeuristic(const OrderingProblem& p, const Deadline* deadline, vector<int>& order)
+{
+    constructNearestNeighbor(p, order);
+    improveTour(p, deadline, order);
+    if ( !p.timed )
+        return;
+
+    vector<int> byDeadline;
+    constructByDeadline(p, byDeadline);
+    improveTour(p, deadline, byDeadline);
+    if ( isBetter(tourTimeWarp(p, byDeadline), tourLength(p, byDeadline),
+                  tourTimeWarp(p, order), tourLength(p, order)) )
+        order = byDeadline;
+}
+
 DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
 {
     m_streetMap = sm;
+    m_exactSolverLimit = DEFAULT_EXACT_SOLVER_LIMIT;
+    m_averageSpeed = DEFAULT_AVERAGE_SPEED_MPH;
+    m_deadline = nullptr;
 }
 
 DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
 {
 }
 
-void DeliveryOptimizerImpl::optimizeDeliveryOrder(
+void DeliveryOptimizerImpl::setExactSolverLimit(int maxStops)
+{
+    if ( maxStops < 0 )
+        maxStops = 0;
+    if ( maxStops > MAX_EXACT_SOLVER_LIMIT )
+        maxStops = MAX_EXACT_SOLVER_LIMIT;
+    m_exactSolverLimit = maxStops;
+}
+
+void DeliveryOptimizerImpl::setAverageSpeed(double milesPerHour)
+{
+    if ( milesPerHour > 0 )
+        m_averageSpeed = milesPerHour;
+}
+
+void DeliveryOptimizerImpl::setDeadline(const Deadline* deadline)
+{
+    m_deadline = deadline;
+}
+
+bool DeliveryOptimizerImpl::optimizeDeliveryOrder(
     const GeoCoord& depot,
     vector<DeliveryRequest>& deliveries,
     double& oldCrowDistance,
     double& newCrowDistance) const
 {
+    TRACE_SPAN("optimizeDeliveryOrder");
+    ALLOC_SCOPE(ALLOC_OPTIMIZER);
     oldCrowDistance = 0;
     newCrowDistance = 0;
-    
+
     if ( deliveries.empty() )
-        return;
+        return true;
+
+    // crow-flies distances between every pair of stops, with the depot last
+    OrderingProblem p;
+    p.n = deliveries.size();
+    int n = p.n;
+    int m = n + 1;
+    p.dist.assign(m * m, 0);
+    p.travel.assign(m * m, 0);
+    for ( int i = 0 ; i < m ; i++ )
+    {
+        const GeoCoord& from = (i == n) ? depot : deliveries[i].location;
+        for ( int j = i + 1 ; j < m ; j++ )
+        {
+            const GeoCoord& to = (j == n) ? depot : deliveries[j].location;
+            p.dist[i * m + j] = p.dist[j * m + i] = distanceEarthMiles(from, to);
+            p.travel[i * m + j] = p.travel[j * m + i] = travelMinutes(p.dist[i * m + j], m_averageSpeed);
+        }
+    }
+
+    p.timed = false;
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        const DeliveryRequest& r = deliveries[i];
+        p.stop.push_back(scheduleForStop(r.earliestArrival, r.latestArrival, r.serviceTime));
+        if ( r.hasTimeWindow() )
+            p.timed = true;
+    }
+    p.stop.push_back(scheduleForStop(0, INFINITE_DISTANCE, 0)); // the depot
+
+    vector<int> original(n);
+    for ( int i = 0 ; i < n ; i++ )
+        original[i] = i;
+    oldCrowDistance = tourLength(p, original);
+    double oldWarp = tourTimeWarp(p, original);
+
+    // re - order the vector. the exact tour is the shortest of all tours, so if it also meets
+    // every window it is the answer; otherwise search for a feasible one
+    vector<int> order;
+    bool solved = false;
+    if ( n <= m_exactSolverLimit  &&  solveExact(p, m_deadline, order) )
+        solved = tourTimeWarp(p, order) <= TIME_WARP_TOLERANCE;
+    if ( !solved )
+        solveHeuristic(p, m_deadline, order);
 
-    oldCrowDistance += distanceEarthMiles(depot, deliveries[0].location);
-    for ( int i = 0 ; i < deliveries.size() - 1; i++ )
-        oldCrowDistance += distanceEarthMiles(deliveries[i].location, deliveries[i+1].location);
-    oldCrowDistance += distanceEarthMiles(deliveries[deliveries.size() - 1].location, depot);
-    
-    // re - order the vector
-    
-    newCrowDistance = oldCrowDistance;
+    newCrowDistance = tourLength(p, order);
+    double newWarp = tourTimeWarp(p, order);
+    if ( !isBetter(newWarp, newCrowDistance, oldWarp, oldCrowDistance) ) // never hand back something worse than we were given
+    {
+        newCrowDistance = oldCrowDistance;
+        return oldWarp <= TIME_WARP_TOLERANCE;
+    }
+
+    vector<DeliveryRequest> reordered;
+    for ( int i = 0 ; i < n ; i++ )
+        reordered.push_back(deliveries[order[i]]);
+    deliveries = reordered;
+    return newWarp <= TIME_WARP_TOLERANCE;
 }
 
 //******************** DeliveryOptimizer functions ****************************
@@ -70,7 +489,7 @@ DeliveryOptimizer::~DeliveryOptimizer()
     delete m_impl;
 }
 
-void DeliveryOptimizer::optimizeDeliveryOrder(
+bool DeliveryOptimizer::optimizeDeliveryOrder(
         const GeoCoord& depot,
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
@@ -79,4 +498,18 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
     return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
 }
 
+void DeliveryOptimizer::setExactSolverLimit(int maxStops)
+{
+    m_impl->setExactSolverLimit(maxStops);
+}
 
+void DeliveryOptimizer::setAverageSpeed(double milesPerHour)
+{
+    m_impl->setAverageSpeed(milesPerHour);
+}
+
+
+void DeliveryOptimizer::setDeadline(const Deadline* deadline)
+{
+    m_impl->setDeadline(deadline);
+}
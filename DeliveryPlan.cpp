@@ -0,0 +1,656 @@
+//
+//  DeliveryPlan.cpp
+//  Goober Eats
+//
+
+#include "provided.h"
+#include "StreetRouter.h"
+#include "TimeWindows.h"
+#include "DepotTrees.h"
+#include "StreetGraph.h"
+#include "Deadline.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include <vector>
+#include <list>
+#include <memory>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+vector<DeliveryCommand> segmentsToCommands (list<StreetSegment>& segments, DeliveryRequest& request, vector<int>& commandOfSegment); // prototype, see DeliveryPlanner.cpp
+
+struct PlanLeg
+{
+    list<StreetSegment> route;
+    double distance;                    // along the route
+    double crowDistance;                // straight line between the leg's ends
+    vector<DeliveryCommand> commands;
+    vector<int> segmentCommands;        // for each segment, index into commands
+    vector<int> rerouteTree;            // shortest-path tree into the leg's stop, once rerouted
+};
+
+class DeliveryPlanImpl
+{
+public:
+    DeliveryPlanImpl(const StreetMap* sm);
+    ~DeliveryPlanImpl();
+    DeliveryResult generate(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, DeliveryCommandSink* sink);
+    DeliveryResult insertDelivery(const DeliveryRequest& request);
+    const vector<DeliveryRequest>& deliveries() const;
+    const vector<DeliveryCommand>& commands() const;
+    double totalDistanceTravelled() const;
+    int legCount() const;
+    const list<StreetSegment>& legRoute(int leg) const;
+    int legFirstCommand(int leg) const;
+    const vector<int>& legSegmentCommands(int leg) const;
+    DeliveryResult reroute(int leg, const GeoCoord& position);
+    void setAverageSpeed(double milesPerHour);
+    void setRouteCost(RouteCost cost);
+    void useDepotTrees(const DepotTrees* trees);
+    void setDeadline(const Deadline* deadline);
+private:
+    DeliveryResult validate(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const;
+    unique_ptr<StreetRouter> newRouter() const;
+    const StreetRouter& router();
+    const DepotTrees* depotTrees() const;
+    DeliveryResult routeLeg(const StreetRouter& router, const GeoCoord& from, const DeliveryRequest& to,
+                            bool backToDepot, PlanLeg& leg) const;
+    void describeLeg(const GeoCoord& from, const DeliveryRequest& to, bool backToDepot, PlanLeg& leg) const;
+    DeliveryResult streamLegs(const GeoCoord& depot, const vector<DeliveryRequest>& ordered,
+                              vector<PlanLeg>& legs, DeliveryCommandSink& sink) const;
+    DeliveryResult walkRerouteTree(int leg, const GeoCoord& position, PlanLeg& remainder);
+
+    const StreetMap* m_streetMap;
+    RouteCost m_routeCost;
+    unique_ptr<StreetRouter> m_router;  // made on first use; streamLegs' threads make their own
+    const DepotTrees* m_depotTrees;     // nullptr unless useDepotTrees was called
+    const Deadline* m_deadline;
+    double m_averageSpeed;
+    bool m_generated;                   // m_depot means nothing until generate succeeds
+    GeoCoord m_depot;
+    vector<DeliveryRequest> m_deliveries;
+    vector<PlanLeg> m_legs;
+    vector<DeliveryCommand> m_commands;
+    double m_totalDistance;
+    double m_totalCrowDistance;
+};
+
+DeliveryPlanImpl::DeliveryPlanImpl(const StreetMap* sm)
+{
+    m_streetMap = sm;
+    m_routeCost = SHORTEST_DISTANCE;
+    m_depotTrees = nullptr;
+    m_deadline = nullptr;
+    m_averageSpeed = DEFAULT_AVERAGE_SPEED_MPH;
+    m_generated = false;
+    m_totalDistance = 0;
+    m_totalCrowDistance = 0;
+}
+
+DeliveryPlanImpl::~DeliveryPlanImpl()
+{
+}
+
+  // checks every stop before any leg is routed: each must be an intersection, and one the depot
+  // can reach. A tiled map doesn't know its components, so there only routing can tell
+DeliveryResult DeliveryPlanImpl::validate(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const
+{
+    vector<StreetSegment> dummy;
+    if ( !m_streetMap->getSegmentsThatStartWith(depot, dummy) )
+        return BAD_COORD;
+    for ( size_t i = 0 ; i < deliveries.size() ; i++ )
+    {
+        if ( !m_streetMap->getSegmentsThatStartWith(deliveries[i].location, dummy) )
+            return BAD_COORD;
+    }
+    int depotComponent = m_streetMap->componentOf(depot);
+    if ( depotComponent == -1 )
+        return DELIVERY_SUCCESS;
+    for ( size_t i = 0 ; i < deliveries.size() ; i++ )
+    {
+        if ( m_streetMap->componentOf(deliveries[i].location) != depotComponent )
+            return NO_ROUTE;
+    }
+    return DELIVERY_SUCCESS;
+}
+
+  // a tiled map only has SHORTEST_DISTANCE, so any other cost falls back to it there
+unique_ptr<StreetRouter> DeliveryPlanImpl::newRouter() const
+{
+    unique_ptr<StreetRouter> made = createRouter(m_streetMap, m_routeCost);
+    if ( made == nullptr )
+        made = createRouter(m_streetMap, SHORTEST_DISTANCE);
+    made->setDeadline(m_deadline);
+    return made;
+}
+
+const StreetRouter& DeliveryPlanImpl::router()
+{
+    if ( m_router == nullptr )
+        m_router = newRouter();
+    return *m_router;
+}
+
+  // the trees hold shortest-distance routes, which another cost would only sometimes pick
+const DepotTrees* DeliveryPlanImpl::depotTrees() const
+{
+    return m_routeCost == SHORTEST_DISTANCE ? m_depotTrees : nullptr;
+}
+
+DeliveryResult DeliveryPlanImpl::routeLeg(const StreetRouter& router, const GeoCoord& from, const DeliveryRequest& to,
+                                          bool backToDepot, PlanLeg& leg) const
+{
+    TRACE_SPAN("DeliveryPlan::routeLeg");
+    ALLOC_SCOPE(ALLOC_PLANNER);
+    // legs out of or back into a depot with a precomputed tree are read off it instead of searched
+    DeliveryResult result;
+    const DepotTrees* trees = depotTrees();
+    if ( trees != nullptr  &&  !backToDepot  &&  trees->hasDepot(from) )
+        result = trees->routeFromDepot(from, to.location, leg.route, leg.distance);
+    else if ( trees != nullptr  &&  backToDepot  &&  trees->hasDepot(to.location) )
+        result = trees->routeToDepot(from, to.location, leg.route, leg.distance);
+    else
+        result = router.generatePointToPointRoute(from, to.location, leg.route, leg.distance);
+    if ( result != DELIVERY_SUCCESS  &&  result != DEADLINE_EXCEEDED )
+        return result;
+    describeLeg(from, to, backToDepot, leg);
+    return result;
+}
+
+  // the commands and crow-flies distance for a leg whose route is in place
+void DeliveryPlanImpl::describeLeg(const GeoCoord& from, const DeliveryRequest& to, bool backToDepot, PlanLeg& leg) const
+{
+    leg.crowDistance = distanceEarthMiles(from, to.location);
+
+    DeliveryRequest request = to;
+    leg.commands = segmentsToCommands(leg.route, request, leg.segmentCommands);
+
+    // the return leg is routed as a pseudo delivery to the depot, which we don't want to show
+    if ( backToDepot )
+        leg.commands.pop_back();
+}
+
+  // joins the leg workers however streamLegs ends, a sink that throws included, since they still
+  // use its locals
+struct LegWorkers
+{
+    LegWorkers(atomic<bool>& stop) : m_stop(stop) {}
+    ~LegWorkers()
+    {
+        m_stop = true;
+        for ( size_t t = 0 ; t < threads.size() ; t++ )
+            threads[t].join();
+    }
+    vector<thread> threads;
+private:
+    atomic<bool>& m_stop;
+};
+
+  // legs are handed out in order to background threads, so the first is ready as soon as it can be
+  // while the later ones are still being searched
+DeliveryResult DeliveryPlanImpl::streamLegs(const GeoCoord& depot, const vector<DeliveryRequest>& ordered,
+                                            vector<PlanLeg>& legs, DeliveryCommandSink& sink) const
+{
+    int n = ordered.size() + 1;
+    legs.resize(n);
+    vector<DeliveryResult> results(n);
+    vector<char> routed(n, 0);
+    mutex routedLock;
+    condition_variable legRouted;
+    atomic<int> next(0);
+    atomic<bool> stop(false);
+    auto work = [&]() {
+        unique_ptr<StreetRouter> router = newRouter(); // a router's search arrays are its own
+        for ( int i = next++ ; i < n  &&  !stop ; i = next++ )
+        {
+            const GeoCoord& from = i == 0 ? depot : ordered[i-1].location;
+            DeliveryResult result;
+            if ( i == n - 1 )
+                result = routeLeg(*router, from, DeliveryRequest("TO THE DEPOT", depot), true, legs[i]);
+            else
+                result = routeLeg(*router, from, ordered[i], false, legs[i]);
+            lock_guard<mutex> guard(routedLock);
+            results[i] = result;
+            routed[i] = 1;
+            legRouted.notify_all();
+        }
+    };
+
+    int threads = thread::hardware_concurrency();
+    if ( threads < 2 )
+        threads = 2;
+    if ( threads > n )
+        threads = n;
+    LegWorkers workers(stop);
+    for ( int t = 0 ; t < threads ; t++ )
+        workers.threads.push_back(thread(work));
+
+    // this thread just passes legs on, so a finished one never waits behind a search
+    DeliveryResult result = DELIVERY_SUCCESS;
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        unique_lock<mutex> guard(routedLock);
+        legRouted.wait(guard, [&]() { return routed[i] != 0; });
+        guard.unlock();
+        if ( results[i] != DELIVERY_SUCCESS  &&  results[i] != DEADLINE_EXCEEDED )
+        {
+            result = results[i];
+            stop = true;
+            break;
+        }
+        if ( results[i] == DEADLINE_EXCEEDED )
+            result = DEADLINE_EXCEEDED;
+        sink.legRouted(i, legs[i].commands, legs[i].distance);
+    }
+    return result;
+}
+
+DeliveryResult DeliveryPlanImpl::generate(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, DeliveryCommandSink* sink)
+{
+    TRACE_SPAN("DeliveryPlan::generate");
+    ALLOC_SCOPE(ALLOC_PLANNER);
+    DeliveryResult valid = validate(depot, deliveries);
+    if ( valid != DELIVERY_SUCCESS )
+        return valid;
+
+    // first, reorder the deliveries vector
+    double oldCrows;
+    double newCrows;
+    DeliveryOptimizer optimizer(m_streetMap);
+    vector<DeliveryRequest> orderedDeliveries = deliveries;
+    optimizer.setDeadline(m_deadline);
+    optimizer.setAverageSpeed(m_averageSpeed);
+    bool feasible = optimizer.optimizeDeliveryOrder(depot, orderedDeliveries, oldCrows, newCrows);
+
+    // past the deadline the order may just be the best found in time, so go with it anyway
+    bool late = m_deadline != nullptr  &&  m_deadline->expired();
+    if ( !feasible  &&  !late )
+        return TIME_WINDOW_VIOLATION;
+
+    // route every leg before touching the plan, so a failure leaves it as it was
+    vector<PlanLeg> legs;
+    if ( !orderedDeliveries.empty()  &&  sink != nullptr )
+    {
+        DeliveryResult result = streamLegs(depot, orderedDeliveries, legs, *sink);
+        if ( result == DEADLINE_EXCEEDED )
+            late = true;
+        else if ( result != DELIVERY_SUCCESS )
+            return result;
+    }
+    else if ( !orderedDeliveries.empty() )
+    {
+        legs.resize(orderedDeliveries.size() + 1);
+        GeoCoord from = depot;
+        for ( size_t i = 0 ; i < orderedDeliveries.size() ; i++ )
+        {
+            DeliveryResult result = routeLeg(router(), from, orderedDeliveries[i], false, legs[i]);
+            if ( result == DEADLINE_EXCEEDED )
+                late = true;
+            else if ( result != DELIVERY_SUCCESS )
+                return result;
+            from = orderedDeliveries[i].location;
+        }
+        DeliveryResult result = routeLeg(router(), from, DeliveryRequest("TO THE DEPOT", depot), true, legs.back());
+        if ( result == DEADLINE_EXCEEDED )
+            late = true;
+        else if ( result != DELIVERY_SUCCESS )
+            return result;
+    }
+    // a deadline that passed after the last search polled it, or while legs were read off depot
+    // trees, doesn't show in any leg's result
+    if ( m_deadline != nullptr  &&  m_deadline->expired() )
+        late = true;
+
+    m_generated = true;
+    m_depot = depot;
+    m_deliveries = orderedDeliveries;
+    m_legs.swap(legs);
+    m_commands.clear();
+    m_totalDistance = 0;
+    m_totalCrowDistance = 0;
+    for ( size_t i = 0 ; i < m_legs.size() ; i++ )
+    {
+        m_commands.insert(m_commands.end(), m_legs[i].commands.begin(), m_legs[i].commands.end());
+        m_totalDistance += m_legs[i].distance;
+        m_totalCrowDistance += m_legs[i].crowDistance;
+    }
+    return late ? DEADLINE_EXCEEDED : DELIVERY_SUCCESS;
+}
+
+DeliveryResult DeliveryPlanImpl::insertDelivery(const DeliveryRequest& request)
+{
+    TRACE_SPAN("DeliveryPlan::insertDelivery");
+    ALLOC_SCOPE(ALLOC_PLANNER);
+    if ( !m_generated )
+        return BAD_COORD;
+    if ( m_legs.empty() )
+        return generate(m_depot, vector<DeliveryRequest>(1, request), nullptr);
+    DeliveryResult valid = validate(m_depot, vector<DeliveryRequest>(1, request));
+    if ( valid != DELIVERY_SUCCESS )
+        return valid;
+
+    int n = m_deliveries.size();
+
+    // new legs haven't been routed yet, so estimate them from the crow-flies distance scaled
+    // by how much longer than the crow flies this plan's roads turned out to be
+    double circuity = 1;
+    if ( m_totalCrowDistance > 0  &&  m_totalDistance > m_totalCrowDistance )
+        circuity = m_totalDistance / m_totalCrowDistance;
+
+    // schedule summaries over plan positions: 0 is the depot, 1..n the deliveries, n+1 the depot
+    // again. Travel times come from crow-flies distances, as in the optimizer, not road miles
+    bool timed = request.hasTimeWindow();
+    for ( int i = 0 ; i < n ; i++ )
+        timed = timed || m_deliveries[i].hasTimeWindow();
+    vector<ScheduleSegment> forward, backward;
+    if ( timed )
+    {
+        vector<ScheduleSegment> stop;
+        stop.push_back(scheduleForStop(0, numeric_limits<double>::infinity(), 0));
+        for ( int i = 0 ; i < n ; i++ )
+            stop.push_back(scheduleForStop(m_deliveries[i].earliestArrival, m_deliveries[i].latestArrival, m_deliveries[i].serviceTime));
+        stop.push_back(stop[0]);
+
+        forward.resize(n + 2);
+        backward.resize(n + 2);
+        forward[0] = stop[0];
+        for ( int k = 1 ; k <= n + 1 ; k++ )
+            forward[k] = concatenate(forward[k-1], travelMinutes(m_legs[k-1].crowDistance, m_averageSpeed), stop[k]);
+        backward[n+1] = stop[n+1];
+        for ( int k = n ; k >= 0 ; k-- )
+            backward[k] = concatenate(stop[k], travelMinutes(m_legs[k].crowDistance, m_averageSpeed), backward[k+1]);
+    }
+    ScheduleSegment inserted = scheduleForStop(request.earliestArrival, request.latestArrival, request.serviceTime);
+
+    // cheapest insertion: leg k runs from position k to position k+1
+    int bestLeg = -1;
+    double bestDetour = numeric_limits<double>::infinity();
+    for ( int k = 0 ; k <= n ; k++ )
+    {
+        const GeoCoord& a = (k == 0) ? m_depot : m_deliveries[k-1].location;
+        const GeoCoord& b = (k == n) ? m_depot : m_deliveries[k].location;
+        double crowToNew = distanceEarthMiles(a, request.location);
+        double crowFromNew = distanceEarthMiles(request.location, b);
+        double detour = (crowToNew + crowFromNew) * circuity - m_legs[k].distance;
+        if ( detour >= bestDetour )
+            continue;
+        if ( timed )
+        {
+            ScheduleSegment s = concatenate(forward[k], travelMinutes(crowToNew, m_averageSpeed), inserted);
+            s = concatenate(s, travelMinutes(crowFromNew, m_averageSpeed), backward[k+1]);
+            if ( !isFeasible(s) )
+                continue;
+        }
+        bestDetour = detour;
+        bestLeg = k;
+    }
+    if ( bestLeg == -1 )
+        return TIME_WINDOW_VIOLATION;
+
+    // route only the two legs around the new stop
+    int k = bestLeg;
+    const GeoCoord& a = (k == 0) ? m_depot : m_deliveries[k-1].location;
+    PlanLeg toNew, fromNew;
+    DeliveryResult toResult = routeLeg(router(), a, request, false, toNew);
+    if ( toResult != DELIVERY_SUCCESS  &&  toResult != DEADLINE_EXCEEDED )
+        return toResult;
+    DeliveryResult result;
+    if ( k == n )
+        result = routeLeg(router(), request.location, DeliveryRequest("TO THE DEPOT", m_depot), true, fromNew);
+    else
+        result = routeLeg(router(), request.location, m_deliveries[k], false, fromNew);
+    if ( result != DELIVERY_SUCCESS  &&  result != DEADLINE_EXCEEDED )
+        return result;
+    if ( toResult == DEADLINE_EXCEEDED  ||  (m_deadline != nullptr  &&  m_deadline->expired()) )
+        result = DEADLINE_EXCEEDED;
+
+    // splice the new legs' commands in where the old leg's were
+    int offset = 0;
+    for ( int i = 0 ; i < k ; i++ )
+        offset += m_legs[i].commands.size();
+    vector<DeliveryCommand>::iterator at = m_commands.erase(m_commands.begin() + offset,
+                                                            m_commands.begin() + offset + m_legs[k].commands.size());
+    at = m_commands.insert(at, fromNew.commands.begin(), fromNew.commands.end());
+    m_commands.insert(at, toNew.commands.begin(), toNew.commands.end());
+
+    m_totalDistance += toNew.distance + fromNew.distance - m_legs[k].distance;
+    m_totalCrowDistance += toNew.crowDistance + fromNew.crowDistance - m_legs[k].crowDistance;
+    // the old leg keeps its reroute tree, since it still ends at the same stop
+    m_deliveries.insert(m_deliveries.begin() + k, request);
+    m_legs[k].route.swap(fromNew.route);
+    m_legs[k].commands.swap(fromNew.commands);
+    m_legs[k].segmentCommands.swap(fromNew.segmentCommands);
+    m_legs[k].distance = fromNew.distance;
+    m_legs[k].crowDistance = fromNew.crowDistance;
+    m_legs.insert(m_legs.begin() + k, PlanLeg());
+    m_legs[k].route.swap(toNew.route);
+    m_legs[k].commands.swap(toNew.commands);
+    m_legs[k].segmentCommands.swap(toNew.segmentCommands);
+    m_legs[k].distance = toNew.distance;
+    m_legs[k].crowDistance = toNew.crowDistance;
+    return result;
+}
+
+  // the rest of the leg from position, up the leg's tree to its stop. The tree is built the first
+  // time the leg is rerouted; a driver who goes wrong once tends to again. A position between
+  // intersections starts from the nearest one that can still reach the stop. The tree holds
+  // shortest-distance routes, so under any other route cost the rest of the leg is searched
+DeliveryResult DeliveryPlanImpl::walkRerouteTree(int leg, const GeoCoord& position, PlanLeg& remainder)
+{
+    const StreetGraph* g = m_streetMap->graph();
+    bool backToDepot = leg == int(m_deliveries.size());
+    const GeoCoord& stop = backToDepot ? m_depot : m_deliveries[leg].location;
+    if ( g == nullptr )
+        return router().generatePointToPointRoute(position, stop, remainder.route, remainder.distance);
+
+    int from = g->findNode(position), to = g->findNode(stop);
+    if ( to == -1 )
+        return BAD_COORD;
+    if ( from == -1 )
+        from = g->nearestNode(position, g->component(to));
+    if ( from == -1 )
+        return BAD_COORD;
+    if ( m_routeCost != SHORTEST_DISTANCE )
+        return router().generatePointToPointRoute(g->coord(from), stop, remainder.route, remainder.distance);
+    const DepotTrees* trees = depotTrees();
+    if ( backToDepot  &&  trees != nullptr  &&  trees->hasDepot(stop) )
+        return trees->routeToDepot(g->coord(from), stop, remainder.route, remainder.distance);
+    vector<int>& tree = m_legs[leg].rerouteTree;
+    if ( tree.empty() )
+        g->shortestPathTree(to, tree);
+    remainder.route.clear();
+    remainder.distance = 0;
+    if ( from != to  &&  tree[from] == -1 )
+        return NO_ROUTE;
+    for ( int v = from ; v != to ; )
+    {
+        int e = tree[v];
+        int parent = g->edgeSource(e);
+        remainder.route.push_back(StreetSegment(g->coord(v), g->coord(parent), g->streetName(g->edgeName(e))));
+        remainder.distance += g->edgeMiles(e);
+        v = parent;
+    }
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult DeliveryPlanImpl::reroute(int leg, const GeoCoord& position)
+{
+    TRACE_SPAN("DeliveryPlan::reroute");
+    ALLOC_SCOPE(ALLOC_PLANNER);
+    if ( leg < 0  ||  leg >= int(m_legs.size()) )
+        return BAD_COORD;
+    PlanLeg remainder;
+    DeliveryResult result = walkRerouteTree(leg, position, remainder);
+    if ( result != DELIVERY_SUCCESS  &&  result != DEADLINE_EXCEEDED )
+        return result;
+    bool backToDepot = leg == int(m_deliveries.size());
+    describeLeg(position, backToDepot ? DeliveryRequest("TO THE DEPOT", m_depot) : m_deliveries[leg], backToDepot, remainder);
+
+    // only this leg's commands change
+    int offset = legFirstCommand(leg);
+    vector<DeliveryCommand>::iterator at = m_commands.erase(m_commands.begin() + offset,
+                                                            m_commands.begin() + offset + m_legs[leg].commands.size());
+    m_commands.insert(at, remainder.commands.begin(), remainder.commands.end());
+
+    PlanLeg& current = m_legs[leg];
+    m_totalDistance += remainder.distance - current.distance;
+    m_totalCrowDistance += remainder.crowDistance - current.crowDistance;
+    current.route.swap(remainder.route);
+    current.commands.swap(remainder.commands);
+    current.segmentCommands.swap(remainder.segmentCommands);
+    current.distance = remainder.distance;
+    current.crowDistance = remainder.crowDistance;
+    return result;
+}
+
+const vector<DeliveryRequest>& DeliveryPlanImpl::deliveries() const
+{
+    return m_deliveries;
+}
+
+const vector<DeliveryCommand>& DeliveryPlanImpl::commands() const
+{
+    return m_commands;
+}
+
+double DeliveryPlanImpl::totalDistanceTravelled() const
+{
+    return m_totalDistance;
+}
+
+int DeliveryPlanImpl::legCount() const
+{
+    return m_legs.size();
+}
+
+const list<StreetSegment>& DeliveryPlanImpl::legRoute(int leg) const
+{
+    return m_legs[leg].route;
+}
+
+int DeliveryPlanImpl::legFirstCommand(int leg) const
+{
+    int first = 0;
+    for ( int i = 0 ; i < leg ; i++ )
+        first += m_legs[i].commands.size();
+    return first;
+}
+
+const vector<int>& DeliveryPlanImpl::legSegmentCommands(int leg) const
+{
+    return m_legs[leg].segmentCommands;
+}
+
+void DeliveryPlanImpl::setAverageSpeed(double milesPerHour)
+{
+    if ( milesPerHour > 0 )
+        m_averageSpeed = milesPerHour;
+}
+
+void DeliveryPlanImpl::setRouteCost(RouteCost cost)
+{
+    m_routeCost = cost;
+    m_router.reset();
+}
+
+void DeliveryPlanImpl::useDepotTrees(const DepotTrees* trees)
+{
+    m_depotTrees = trees;
+}
+
+void DeliveryPlanImpl::setDeadline(const Deadline* deadline)
+{
+    m_deadline = deadline;
+    if ( m_router != nullptr )
+        m_router->setDeadline(deadline);
+}
+
+//******************** DeliveryPlan functions *********************************
+
+// These functions simply delegate to DeliveryPlanImpl's functions.
+
+DeliveryPlan::DeliveryPlan(const StreetMap* sm)
+{
+    m_impl = new DeliveryPlanImpl(sm);
+}
+
+DeliveryPlan::~DeliveryPlan()
+{
+    delete m_impl;
+}
+
+DeliveryResult DeliveryPlan::generate(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+                                      DeliveryCommandSink* sink)
+{
+    return m_impl->generate(depot, deliveries, sink);
+}
+
+DeliveryResult DeliveryPlan::insertDelivery(const DeliveryRequest& request)
+{
+    return m_impl->insertDelivery(request);
+}
+
+const vector<DeliveryRequest>& DeliveryPlan::deliveries() const
+{
+    return m_impl->deliveries();
+}
+
+const vector<DeliveryCommand>& DeliveryPlan::commands() const
+{
+    return m_impl->commands();
+}
+
+double DeliveryPlan::totalDistanceTravelled() const
+{
+    return m_impl->totalDistanceTravelled();
+}
+
+int DeliveryPlan::legCount() const
+{
+    return m_impl->legCount();
+}
+
+const list<StreetSegment>& DeliveryPlan::legRoute(int leg) const
+{
+    return m_impl->legRoute(leg);
+}
+
+int DeliveryPlan::legFirstCommand(int leg) const
+{
+    return m_impl->legFirstCommand(leg);
+}
+
+const vector<int>& DeliveryPlan::legSegmentCommands(int leg) const
+{
+    return m_impl->legSegmentCommands(leg);
+}
+
+DeliveryResult DeliveryPlan::reroute(int leg, const GeoCoord& position)
+{
+    return m_impl->reroute(leg, position);
+}
+
+void DeliveryPlan::setAverageSpeed(double milesPerHour)
+{
+    m_impl->setAverageSpeed(milesPerHour);
+}
+
+void DeliveryPlan::setRouteCost(RouteCost cost)
+{
+    m_impl->setRouteCost(cost);
+}
+
+void DeliveryPlan::useDepotTrees(const DepotTrees* trees)
+{
+    m_impl->useDepotTrees(trees);
+}
+
+void DeliveryPlan::setDeadline(const Deadline* deadline)
+{
+    m_impl->setDeadline(deadline);
+}
@@ -8,14 +8,21 @@
 
 
 #include "provided.h"
+#include "StreetRouter.h"
+#include "Trace.h"
+#include "AllocStats.h"
 #include <vector>
 #include <cassert>
 
 using namespace std;
 
-vector<DeliveryCommand> segmentsToCommands (list<StreetSegment>& segments, DeliveryRequest& request)
+// commandOfSegment gets, for each segment, the index of the command that covers it
+vector<DeliveryCommand> segmentsToCommands (list<StreetSegment>& segments, DeliveryRequest& request, vector<int>& commandOfSegment)
 {
+    TRACE_SPAN("segmentsToCommands");
+    ALLOC_SCOPE(ALLOC_PLANNER);
     vector<DeliveryCommand> commandVec;
+    commandOfSegment.clear();
     // iterate through the segments
     
     if ( segments.empty() )
@@ -92,6 +99,7 @@ vector<DeliveryCommand> segmentsToCommands (list<StreetSegment>& segments, Deliv
             command.initAsProceedCommand(direction, streetName, segmentLength);
             commandVec.push_back(command);
         }
+        commandOfSegment.push_back(commandVec.size() - 1);
 
         // our segment is the end segment, so we must deliver too
         if ( it->end == request.location)
@@ -117,13 +125,24 @@ public:
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        DeliveryCommandSink& sink,
+        double& totalDistanceTravelled) const;
+    void setDeadline(const Deadline* deadline);
+    void setRouteCost(RouteCost cost);
 private:
     const StreetMap* m_streetMap;
+    const Deadline* m_deadline;
+    RouteCost m_routeCost;
 };
 
 DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm)
 {
     m_streetMap = sm;
+    m_deadline = nullptr;
+    m_routeCost = SHORTEST_DISTANCE;
 }
 
 DeliveryPlannerImpl::~DeliveryPlannerImpl()
@@ -136,70 +155,52 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    
     totalDistanceTravelled = 0;
-    
-    // first, reorder the deliveries vector
-    double oldCrows;
-    double newCrows;
-    DeliveryOptimizer optimizer(m_streetMap);
-    vector<DeliveryRequest> orderedDeliveries = deliveries;
-    optimizer.optimizeDeliveryOrder(depot, orderedDeliveries, oldCrows, newCrows);
-    
-    // initilaize some temp data structures that we need
-    PointToPointRouter segmentRouter(m_streetMap);
-    list<StreetSegment> segmentRoute;
-    vector<DeliveryCommand> commandsPerSegment;
-    double segmentDistance;
-    DeliveryResult routerResult;
-    
-    // generate point to point route from depot to first location
-    routerResult = segmentRouter.generatePointToPointRoute(depot, orderedDeliveries[0].location, segmentRoute, segmentDistance);
-    if ( routerResult != DELIVERY_SUCCESS )
-        return routerResult;
-    totalDistanceTravelled += segmentDistance;
-    
-    // convert the segment route to commands, and add the commands to the commands vector
-    commandsPerSegment = segmentsToCommands(segmentRoute, orderedDeliveries[0]);
-    for ( int k = 0 ; k < commandsPerSegment.size() ; k++)
-        commands.push_back(commandsPerSegment[k]);
-    commandsPerSegment.clear();
-    
-    // for each ordered delivery point, find point to point route between
-    for (int i = 0 ; i < orderedDeliveries.size() - 1 ; i++)
-    {
-        routerResult = segmentRouter.generatePointToPointRoute(orderedDeliveries[i].location, orderedDeliveries[i+1].location, segmentRoute, segmentDistance);
-        if ( routerResult != DELIVERY_SUCCESS )
-        return routerResult;
-        totalDistanceTravelled += segmentDistance;
-        
-        // convert segment route to commands, and add the commands to the commands vector
-        commandsPerSegment = segmentsToCommands(segmentRoute, orderedDeliveries[i + 1]); // start at 1 because we already delivered 0
-        for ( int k = 0 ; k < commandsPerSegment.size() ; k++)
-            commands.push_back(commandsPerSegment[k]);
-        commandsPerSegment.clear();
-    }
-    
-    // find point to point route from last ordered delivery
-    routerResult = segmentRouter.generatePointToPointRoute(orderedDeliveries[orderedDeliveries.size() - 1].location, depot, segmentRoute, segmentDistance);
-    if ( routerResult != DELIVERY_SUCCESS )
-    return routerResult;
-    totalDistanceTravelled += segmentDistance;
-    
-    // convert segment route to commands, and add the commands to the commands vector
-    
-    // we must make a psuedo delivery to the depot, that we can later delete
-    
-    DeliveryRequest endRequest("TO THE DEPOT", depot);
-    commandsPerSegment = segmentsToCommands(segmentRoute, endRequest);
-    for ( int k = 0 ; k < commandsPerSegment.size() ; k++)
-        commands.push_back(commandsPerSegment[k]);
-    commandsPerSegment.clear();
-    
-    // now just remove that last pseudo delivery request
-    commands.pop_back();
-    
-    return DELIVERY_SUCCESS;
+
+    // the plan orders the deliveries, routes each leg and converts it to commands
+    DeliveryPlan plan(m_streetMap);
+    plan.setDeadline(m_deadline);
+    plan.setRouteCost(m_routeCost);
+    DeliveryResult result = plan.generate(depot, deliveries);
+    if ( result != DELIVERY_SUCCESS  &&  result != DEADLINE_EXCEEDED )
+        return result;
+
+    totalDistanceTravelled = plan.totalDistanceTravelled();
+    const vector<DeliveryCommand>& planCommands = plan.commands();
+    for ( size_t k = 0 ; k < planCommands.size() ; k++ )
+        commands.push_back(planCommands[k]);
+
+    return result;
+}
+
+DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    DeliveryCommandSink& sink,
+    double& totalDistanceTravelled) const
+{
+    totalDistanceTravelled = 0;
+
+    // the plan hands sink each leg's commands as they're ready
+    DeliveryPlan plan(m_streetMap);
+    plan.setDeadline(m_deadline);
+    plan.setRouteCost(m_routeCost);
+    DeliveryResult result = plan.generate(depot, deliveries, &sink);
+    if ( result != DELIVERY_SUCCESS  &&  result != DEADLINE_EXCEEDED )
+        return result;
+
+    totalDistanceTravelled = plan.totalDistanceTravelled();
+    return result;
+}
+
+void DeliveryPlannerImpl::setDeadline(const Deadline* deadline)
+{
+    m_deadline = deadline;
+}
+
+void DeliveryPlannerImpl::setRouteCost(RouteCost cost)
+{
+    m_routeCost = cost;
 }
 
 //******************** DeliveryPlanner functions ******************************
@@ -226,4 +227,21 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
 }
 
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    DeliveryCommandSink& sink,
+    double& totalDistanceTravelled) const
+{
+    return m_impl->generateDeliveryPlan(depot, deliveries, sink, totalDistanceTravelled);
+}
+
+void DeliveryPlanner::setDeadline(const Deadline* deadline)
+{
+    m_impl->setDeadline(deadline);
+}
 
+void DeliveryPlanner::setRouteCost(RouteCost cost)
+{
+    m_impl->setRouteCost(cost);
+}
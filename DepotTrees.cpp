@@ -0,0 +1,264 @@
+//
+//  DepotTrees.cpp
+//  Goober Eats
+//
+
+#include "DepotTrees.h"
+#include "StreetGraph.h"
+#include "Trace.h"
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const unsigned int TREE_FILE_MAGIC = 0x32504547;  // "GEP2"
+const int TREE_HEADER_WORDS = 6;                    // magic, nodes, edges, depots, map checksum (2 words)
+
+class DepotTreesImpl
+{
+public:
+    DepotTreesImpl(const StreetMap* sm);
+    ~DepotTreesImpl();
+    bool build(const vector<GeoCoord>& depots, string treeFile) const;
+    bool load(string treeFile);
+    bool hasDepot(const GeoCoord& depot) const;
+    DeliveryResult routeFromDepot(const GeoCoord& depot, const GeoCoord& stop,
+                                  list<StreetSegment>& route, double& totalDistanceTravelled) const;
+    DeliveryResult routeToDepot(const GeoCoord& stop, const GeoCoord& depot,
+                                list<StreetSegment>& route, double& totalDistanceTravelled) const;
+private:
+    void unmap();
+    const int* treeOf(int depotNode) const;
+    DeliveryResult walk(const GeoCoord& depot, const GeoCoord& stop, bool outbound,
+                        list<StreetSegment>& route, double& totalDistanceTravelled) const;
+
+    const StreetMap* m_streetMap;
+    void* m_mapped;
+    size_t m_mappedBytes;
+    int m_depotCount;
+    const int* m_depotNodes;
+    const int* m_trees;             // m_depotCount trees of nodeCount() entries
+};
+
+DepotTreesImpl::DepotTreesImpl(const StreetMap* sm)
+{
+    m_streetMap = sm;
+    m_mapped = nullptr;
+    m_mappedBytes = 0;
+    m_depotCount = 0;
+    m_depotNodes = nullptr;
+    m_trees = nullptr;
+}
+
+DepotTreesImpl::~DepotTreesImpl()
+{
+    unmap();
+}
+
+void DepotTreesImpl::unmap()
+{
+    if ( m_mapped != nullptr )
+        munmap(m_mapped, m_mappedBytes);
+    m_mapped = nullptr;
+    m_depotCount = 0;
+}
+
+bool DepotTreesImpl::build(const vector<GeoCoord>& depots, string treeFile) const
+{
+    const StreetGraph* graph = m_streetMap->graph();
+    if ( graph == nullptr )
+        return false;
+    const StreetGraph& g = *graph;
+    int n = g.nodeCount();
+
+    vector<int> depotNodes;
+    for ( size_t i = 0 ; i < depots.size() ; i++ )
+    {
+        int node = g.findNode(depots[i]);
+        if ( node == -1 )
+            return false;
+        depotNodes.push_back(node);
+    }
+
+    ofstream out(treeFile, ios::binary);
+    if ( !out )
+        return false;
+    unsigned long long checksum = g.checksum();
+    int header[TREE_HEADER_WORDS] = { int(TREE_FILE_MAGIC), n, g.edgeCount(), int(depotNodes.size()),
+                                      int(checksum & 0xFFFFFFFF), int(checksum >> 32) };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(depotNodes.data()), depotNodes.size() * sizeof(int));
+
+    vector<int> parentEdge;
+    for ( size_t d = 0 ; d < depotNodes.size() ; d++ )
+    {
+        g.shortestPathTree(depotNodes[d], parentEdge);
+        out.write(reinterpret_cast<const char*>(parentEdge.data()), n * sizeof(int));
+    }
+    return bool(out);
+}
+
+bool DepotTreesImpl::load(string treeFile)
+{
+    unmap();
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr )
+        return false;
+
+    int fd = open(treeFile.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0  &&  size_t(info.st_size) >= TREE_HEADER_WORDS * sizeof(int);
+    if ( ok )
+    {
+        m_mappedBytes = info.st_size;
+        m_mapped = mmap(nullptr, m_mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+        if ( m_mapped == MAP_FAILED )
+            m_mapped = nullptr;
+    }
+    close(fd); // the mapping stays valid without the descriptor
+    if ( m_mapped == nullptr )
+        return false;
+
+    // a file for another map, or a damaged one, would send the walks off the ends of the arrays
+    const int* words = static_cast<const int*>(m_mapped);
+    int n = g->nodeCount(), edges = g->edgeCount();
+    int depots = words[3];
+    unsigned long long checksum = (unsigned long long)(unsigned int)words[5] << 32 | (unsigned int)words[4];
+    size_t expected = (TREE_HEADER_WORDS + size_t(depots) + size_t(depots) * n) * sizeof(int);
+    ok = words[0] == int(TREE_FILE_MAGIC)  &&  words[1] == n  &&  words[2] == edges  &&  depots >= 0  &&
+         m_mappedBytes == expected  &&  checksum == g->checksum();
+    const int* depotNodes = words + TREE_HEADER_WORDS;
+    const int* trees = depotNodes + depots;
+    for ( int d = 0 ; ok  &&  d < depots ; d++ )
+        ok = depotNodes[d] >= 0  &&  depotNodes[d] < n;
+    for ( size_t i = 0 ; ok  &&  i < size_t(depots) * n ; i++ )
+        ok = trees[i] >= -1  &&  trees[i] < edges;
+    if ( !ok )
+    {
+        unmap();
+        return false;
+    }
+    m_depotCount = depots;
+    m_depotNodes = depotNodes;
+    m_trees = trees;
+    return true;
+}
+
+const int* DepotTreesImpl::treeOf(int depotNode) const
+{
+    for ( int d = 0 ; d < m_depotCount ; d++ )
+    {
+        if ( m_depotNodes[d] == depotNode )
+            return m_trees + size_t(d) * m_streetMap->graph()->nodeCount();
+    }
+    return nullptr;
+}
+
+bool DepotTreesImpl::hasDepot(const GeoCoord& depot) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  m_depotCount == 0 )
+        return false;
+    int node = g->findNode(depot);
+    return node != -1  &&  treeOf(node) != nullptr;
+}
+
+  // follows the tree from stop up to the depot; outbound routes are that path turned around
+DeliveryResult DepotTreesImpl::walk(const GeoCoord& depot, const GeoCoord& stop, bool outbound,
+                                    list<StreetSegment>& route, double& totalDistanceTravelled) const
+{
+    TRACE_SPAN("DepotTrees::walk");
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  m_depotCount == 0 )
+        return BAD_COORD;
+    int depotNode = g->findNode(depot), stopNode = g->findNode(stop);
+    const int* tree = depotNode == -1 ? nullptr : treeOf(depotNode);
+    if ( tree == nullptr  ||  stopNode == -1 )
+        return BAD_COORD;
+
+    route.clear();
+    totalDistanceTravelled = 0;
+    if ( stopNode == depotNode )
+        return DELIVERY_SUCCESS;
+    if ( tree[stopNode] == -1 )
+        return NO_ROUTE;
+
+    // load() checked every entry is an edge, but only building the tree makes it one, so a damaged
+    // file could still lead off the tree or round in circles
+    for ( int v = stopNode, steps = 0 ; v != depotNode ; steps++ )
+    {
+        int e = tree[v];
+        if ( e == -1  ||  steps == g->nodeCount() )
+        {
+            route.clear();
+            totalDistanceTravelled = 0;
+            return NO_ROUTE;
+        }
+        int parent = g->edgeSource(e);
+        if ( outbound )
+            route.push_front(g->segment(parent, e));
+        else
+            route.push_back(StreetSegment(g->coord(v), g->coord(parent), g->streetName(g->edgeName(e))));
+        totalDistanceTravelled += g->edgeMiles(e);
+        v = parent;
+    }
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult DepotTreesImpl::routeFromDepot(const GeoCoord& depot, const GeoCoord& stop,
+                                              list<StreetSegment>& route, double& totalDistanceTravelled) const
+{
+    return walk(depot, stop, true, route, totalDistanceTravelled);
+}
+
+DeliveryResult DepotTreesImpl::routeToDepot(const GeoCoord& stop, const GeoCoord& depot,
+                                            list<StreetSegment>& route, double& totalDistanceTravelled) const
+{
+    return walk(depot, stop, false, route, totalDistanceTravelled);
+}
+
+//******************** DepotTrees functions ***********************************
+
+// These functions simply delegate to DepotTreesImpl's functions.
+
+DepotTrees::DepotTrees(const StreetMap* sm)
+{
+    m_impl = new DepotTreesImpl(sm);
+}
+
+DepotTrees::~DepotTrees()
+{
+    delete m_impl;
+}
+
+bool DepotTrees::build(const vector<GeoCoord>& depots, string treeFile) const
+{
+    return m_impl->build(depots, treeFile);
+}
+
+bool DepotTrees::load(string treeFile)
+{
+    return m_impl->load(treeFile);
+}
+
+bool DepotTrees::hasDepot(const GeoCoord& depot) const
+{
+    return m_impl->hasDepot(depot);
+}
+
+DeliveryResult DepotTrees::routeFromDepot(const GeoCoord& depot, const GeoCoord& stop,
+                                          list<StreetSegment>& route, double& totalDistanceTravelled) const
+{
+    return m_impl->routeFromDepot(depot, stop, route, totalDistanceTravelled);
+}
+
+DeliveryResult DepotTrees::routeToDepot(const GeoCoord& stop, const GeoCoord& depot,
+                                        list<StreetSegment>& route, double& totalDistanceTravelled) const
+{
+    return m_impl->routeToDepot(stop, depot, route, totalDistanceTravelled);
+}
@@ -0,0 +1,48 @@
+
+#ifndef DEPOT_TREES_INCLUDED
+#define DEPOT_TREES_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <vector>
+#include <list>
+
+// DepotTrees.h
+
+// Shortest-path trees from depots that never move, worked out once and kept on disk, so the
+// legs out of and back into a depot are read off the tree instead of searched for.
+//
+// Every street in the map goes both ways at the same length, so the tree of shortest paths out
+// of a depot, read backwards, is also the tree of shortest paths into it: one tree per depot
+// covers both directions. For each intersection the tree holds the street (edge) it's entered by
+// on the way out from the depot, or -1 for the depot itself and anything it can't reach. That's
+// 4 bytes per intersection per depot.
+//
+// The file is a header (magic, the map's node and edge counts, the number of depots, the map's
+// StreetGraph::checksum), the node number of each depot, then each depot's tree. load() maps it
+// into memory rather than reading it. A file built from a different map is refused, and so is one
+// with a depot or edge number out of range, so load() reads every entry once to check.
+
+class DepotTreesImpl;
+
+class DepotTrees
+{
+public:
+    DepotTrees(const StreetMap* sm);
+    ~DepotTrees();
+    bool build(const std::vector<GeoCoord>& depots, std::string treeFile) const;
+    bool load(std::string treeFile);
+    bool hasDepot(const GeoCoord& depot) const;
+      // BAD_COORD if depot has no tree or stop isn't an intersection
+    DeliveryResult routeFromDepot(const GeoCoord& depot, const GeoCoord& stop,
+                                  std::list<StreetSegment>& route, double& totalDistanceTravelled) const;
+    DeliveryResult routeToDepot(const GeoCoord& stop, const GeoCoord& depot,
+                                std::list<StreetSegment>& route, double& totalDistanceTravelled) const;
+      // We prevent a DepotTrees object from being copied or assigned.
+    DepotTrees(const DepotTrees&) = delete;
+    DepotTrees& operator=(const DepotTrees&) = delete;
+private:
+    DepotTreesImpl* m_impl;
+};
+
+#endif // DEPOT_TREES_INCLUDED
@@ -0,0 +1,195 @@
+//
+//  GraphMemory.cpp
+//  Goober Eats
+//
+
+#include "GraphMemory.h"
+#include <new>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+// in front of every block, so freeing knows how it was made; a whole cache line keeps the
+// array behind it aligned to one
+const size_t BLOCK_HEADER_BYTES = 64;
+
+struct BlockHeader
+{
+    size_t mappedBytes;     // 0 if the block came from operator new
+};
+
+// MPOL_PREFERRED, from linux/mempolicy.h: use the node while it has room, not beyond
+const int PREFER_NODE_POLICY = 1;
+
+thread_local PagePolicy t_pages = DEFAULT_PAGES;
+thread_local int t_numaNode = -1;
+
+PlacementScope::PlacementScope(PagePolicy pages, int numaNode)
+{
+    m_previousPages = t_pages;
+    m_previousNode = t_numaNode;
+    t_pages = pages;
+    t_numaNode = numaNode;
+}
+
+PlacementScope::~PlacementScope()
+{
+    t_pages = m_previousPages;
+    t_numaNode = m_previousNode;
+}
+
+int numaNodeCount()
+{
+    static int nodes = []() {
+        int n = 0;
+        while ( ifstream("/sys/devices/system/node/node" + to_string(n) + "/cpulist") )
+            n++;
+        return n > 0 ? n : 1;
+    }();
+    return nodes;
+}
+
+int currentNumaNode()
+{
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+    if ( syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 )
+        return node;
+#endif
+    return 0;
+}
+
+bool bindThreadToNode(int node)
+{
+    // cpulist is ranges like "0-3,8-11"
+    ifstream list("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    string ranges;
+    if ( node < 0  ||  !getline(list, ranges) )
+        return false;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    istringstream in(ranges);
+    string range;
+    int count = 0;
+    while ( getline(in, range, ',') )
+    {
+        size_t dash = range.find('-');
+        int first = stoi(range);
+        int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last  &&  cpu < CPU_SETSIZE; cpu++, count++)
+            CPU_SET(cpu, &cpus);
+    }
+    return count > 0  &&  sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+long long hugePageBytes()
+{
+    ifstream rollup("/proc/self/smaps_rollup");
+    string line;
+    while ( getline(rollup, line) )
+    {
+        // "AnonHugePages:      4096 kB"
+        if ( line.compare(0, 14, "AnonHugePages:") == 0 )
+        {
+            long long kb = 0;
+            istringstream(line.substr(14)) >> kb;
+            return kb * 1024;
+        }
+    }
+    return -1;
+}
+
+  // a mapping of bytes (a multiple of HUGE_PAGE_BYTES) starting on a huge page boundary, with
+  // the kernel asked to use huge pages for it; nullptr if there's no address space left
+static void* mapTransparent(size_t bytes)
+{
+    // map a huge page extra and trim the ends, since mmap only promises small page alignment
+    size_t padded = bytes + HUGE_PAGE_BYTES;
+    void* mapped = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( mapped == MAP_FAILED )
+        return nullptr;
+    char* start = static_cast<char*>(mapped);
+    char* aligned = start + (HUGE_PAGE_BYTES - reinterpret_cast<size_t>(start) % HUGE_PAGE_BYTES) % HUGE_PAGE_BYTES;
+    if ( aligned > start )
+        munmap(start, aligned - start);
+    if ( start + padded > aligned + bytes )
+        munmap(aligned + bytes, start + padded - (aligned + bytes));
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, bytes, MADV_HUGEPAGE); // only advice: a kernel without THP ignores it
+#endif
+    return aligned;
+}
+
+static void* mapExplicit(size_t bytes)
+{
+#ifdef MAP_HUGETLB
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if ( mapped != MAP_FAILED )
+        return mapped;
+#endif
+    return mapTransparent(bytes);   // the pool is empty or too small
+}
+
+  // before anything touches the pages, which is when the kernel picks where they go
+static void bindToNode(void* start, size_t bytes, int node)
+{
+#ifdef SYS_mbind
+    const int MASK_BITS = 8 * sizeof(unsigned long);
+    if ( node < 0  ||  node >= MASK_BITS )
+        return;
+    unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, start, bytes, PREFER_NODE_POLICY, &mask, MASK_BITS, 0);
+#endif
+}
+
+void* allocateGraphMemory(size_t bytes)
+{
+    size_t total = bytes + BLOCK_HEADER_BYTES;
+    char* start = nullptr;
+    size_t mappedBytes = 0;
+    if ( t_pages != DEFAULT_PAGES  &&  total >= HUGE_PAGE_BYTES )
+    {
+        mappedBytes = (total + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+        void* mapped = t_pages == EXPLICIT_HUGE_PAGES ? mapExplicit(mappedBytes) : mapTransparent(mappedBytes);
+        start = static_cast<char*>(mapped);
+        if ( start != nullptr  &&  t_numaNode >= 0 )
+            bindToNode(start, mappedBytes, t_numaNode);
+    }
+    else if ( t_numaNode >= 0  &&  total >= size_t(sysconf(_SC_PAGESIZE)) )
+    {
+        // small pages of its own, so binding it doesn't move whatever shares them
+        size_t page = sysconf(_SC_PAGESIZE);
+        mappedBytes = (total + page - 1) / page * page;
+        void* mapped = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        start = mapped == MAP_FAILED ? nullptr : static_cast<char*>(mapped);
+        if ( start != nullptr )
+            bindToNode(start, mappedBytes, t_numaNode);
+    }
+    if ( start == nullptr )
+    {
+        start = static_cast<char*>(::operator new(total));
+        mappedBytes = 0;
+    }
+    reinterpret_cast<BlockHeader*>(start)->mappedBytes = mappedBytes;
+    return start + BLOCK_HEADER_BYTES;
+}
+
+void freeGraphMemory(void* block)
+{
+    if ( block == nullptr )
+        return;
+    char* start = static_cast<char*>(block) - BLOCK_HEADER_BYTES;
+    size_t mappedBytes = reinterpret_cast<BlockHeader*>(start)->mappedBytes;
+    if ( mappedBytes > 0 )
+        munmap(start, mappedBytes);
+    else
+        ::operator delete(start);
+}
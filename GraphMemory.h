@@ -0,0 +1,88 @@
+#ifndef GRAPH_MEMORY_INCLUDED
+#define GRAPH_MEMORY_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+// GraphMemory.h
+
+// Where the arrays of a StreetGraph or ChainGraph live. By default they're ordinary heap
+// blocks, like everything else. A search jumps all over them, though, so on a big map it
+// spends much of its time on TLB misses, and on a machine with more than one socket half the
+// routing threads read them from the other socket's memory. StreetMap::setGraphPlacement()
+// can ask for better before load():
+//
+//   DEFAULT_PAGES              operator new
+//   TRANSPARENT_HUGE_PAGES     mmap, aligned to a huge page, with madvise(MADV_HUGEPAGE); the
+//                              kernel backs it with huge pages when it can spare them and with
+//                              small ones when it can't
+//   EXPLICIT_HUGE_PAGES        mmap(MAP_HUGETLB) from the pool reserved with vm.nr_hugepages,
+//                              or TRANSPARENT_HUGE_PAGES when the pool can't cover it
+//
+// and with replicatePerNode, a copy of the street graph on every NUMA node (each bound there
+// with mbind), along with its ChainGraph, handed by StreetMap::graph() and chains() to whichever
+// thread asks from that node. A thread that wants its node's copy should bindThreadToNode()
+// first, or the scheduler may move it off that node after it asks. With one node there's one
+// copy, as before.
+//
+// Arrays smaller than a huge page get small pages: from operator new, or pages of their own when
+// they're bound to a node. The arrays are GraphArrays, whose allocator places each block by the
+// PlacementScope innermost on the allocating thread, and remembers how, so a block is freed
+// the right way wherever that happens.
+
+enum PagePolicy
+{
+    DEFAULT_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES
+};
+
+struct GraphPlacement
+{
+    PagePolicy pages;
+    bool replicatePerNode;
+};
+
+int numaNodeCount();                // 1 without NUMA support
+int currentNumaNode();              // of the CPU this thread is on right now
+bool bindThreadToNode(int node);    // keep this thread on that node's CPUs; false if it can't
+
+  // bytes of this process's memory the kernel has actually given huge pages, or -1 if it
+  // won't say
+long long hugePageBytes();
+
+  // graph arrays allocated on this thread for the rest of the enclosing block are placed like
+  // this; numaNode -1 leaves them wherever the kernel puts them
+class PlacementScope
+{
+public:
+    PlacementScope(PagePolicy pages, int numaNode);
+    ~PlacementScope();
+    PlacementScope(const PlacementScope&) = delete;
+    PlacementScope& operator=(const PlacementScope&) = delete;
+private:
+    PagePolicy m_previousPages;
+    int m_previousNode;
+};
+
+void* allocateGraphMemory(size_t bytes);
+void freeGraphMemory(void* block);
+
+template<typename T>
+struct GraphAllocator
+{
+    typedef T value_type;
+    GraphAllocator() {}
+    template<typename U>
+    GraphAllocator(const GraphAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(allocateGraphMemory(n * sizeof(T))); }
+    void deallocate(T* p, size_t) { freeGraphMemory(p); }
+};
+
+template<typename T, typename U>
+bool operator==(const GraphAllocator<T>&, const GraphAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const GraphAllocator<T>&, const GraphAllocator<U>&) { return false; }
+
+template<typename T>
+using GraphArray = std::vector<T, GraphAllocator<T>>;
+
+#endif // GRAPH_MEMORY_INCLUDED
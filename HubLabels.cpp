@@ -0,0 +1,481 @@
+//
+//  HubLabels.cpp
+//  Goober Eats
+//
+
+#include "HubLabels.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <queue>
+#include <fstream>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+// the query compares this many hubs from each list at a time; the all-pairs compare inside a
+// block has no data-dependent branches, so it vectorizes
+const int LABEL_LANES = 4;
+
+// shortest-path trees sampled to rank the intersections
+const int RANKING_SAMPLES = 32;
+
+const unsigned int LABEL_FILE_MAGIC = 0x4c485547;  // "GUHL"
+const float UNREACHABLE = numeric_limits<float>::infinity();
+
+class HubLabelsImpl
+{
+public:
+    HubLabelsImpl(const StreetMap* sm);
+    ~HubLabelsImpl();
+    bool build(bool withPaths);
+    bool save(string labelFile) const;
+    bool load(string labelFile);
+    DeliveryResult distance(const GeoCoord& start, const GeoCoord& end, double& miles) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const;
+    double averageLabelSize() const;
+    bool hasPaths() const;
+private:
+    void rankNodes(vector<int>& byRank) const;
+    float query(int a, int b, int& bestA, int& bestB) const;
+    int entryFor(int node, int hub) const;
+    void walkToHub(int node, int hub, vector<int>& path) const;
+
+    const StreetMap* m_streetMap;
+
+    // labels of node v are entries m_labelStart[v]..m_labelStart[v+1]-1, sorted by hub rank
+    vector<int> m_labelStart;
+    vector<int> m_hub;          // rank of the hub
+    vector<float> m_miles;
+    vector<int> m_parent;       // next node toward the hub; empty without paths
+    vector<int> m_hubNode;      // node of each rank
+};
+
+HubLabelsImpl::HubLabelsImpl(const StreetMap* sm)
+{
+    m_streetMap = sm;
+}
+
+HubLabelsImpl::~HubLabelsImpl()
+{
+}
+
+  // nodes that many sampled shortest-path trees hang from come first; those are the ones that
+  // cover the most other pairs, so taking them early keeps everyone else's labels short
+void HubLabelsImpl::rankNodes(vector<int>& byRank) const
+{
+    const StreetGraph& g = *m_streetMap->graph();
+    int n = g.nodeCount();
+    vector<double> coverage(n, 0);
+    vector<double> dist(n);
+    vector<int> parent(n), settled, below(n);
+    mt19937 rng(n);
+    typedef pair<double, int> Entry;
+    for ( int sample = 0 ; sample < RANKING_SAMPLES  &&  n > 0 ; sample++ )
+    {
+        int root = rng() % n;
+        fill(dist.begin(), dist.end(), -1);
+        settled.clear();
+        priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+        dist[root] = 0;
+        parent[root] = -1;
+        open.push(Entry(0, root));
+        while ( !open.empty() )
+        {
+            Entry top = open.top();
+            open.pop();
+            int v = top.second;
+            if ( top.first > dist[v] )
+                continue;
+            settled.push_back(v);
+            for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+            {
+                int w = g.edgeTarget(e);
+                double d = top.first + g.edgeMiles(e);
+                if ( dist[w] < 0  ||  d < dist[w] )
+                {
+                    dist[w] = d;
+                    parent[w] = v;
+                    open.push(Entry(d, w));
+                }
+            }
+        }
+        // subtree sizes, leaves first
+        for ( int i = settled.size() - 1 ; i >= 0 ; i-- )
+            below[settled[i]] = 1;
+        for ( int i = settled.size() - 1 ; i > 0 ; i-- )
+            below[parent[settled[i]]] += below[settled[i]];
+        for ( size_t i = 0 ; i < settled.size() ; i++ )
+            coverage[settled[i]] += below[settled[i]];
+    }
+
+    byRank.resize(n);
+    for ( int v = 0 ; v < n ; v++ )
+        byRank[v] = v;
+    sort(byRank.begin(), byRank.end(), [&](int a, int b) {
+        if ( coverage[a] != coverage[b] )
+            return coverage[a] > coverage[b];
+        return g.lastEdge(a) - g.firstEdge(a) > g.lastEdge(b) - g.firstEdge(b);
+    });
+}
+
+// Pruned Dijkstra from each hub in rank order. hubDist holds the current hub's own label spread
+// out by rank, so checking whether the labels so far already cover (hub, v) costs one pass over
+// v's label.
+bool HubLabelsImpl::build(bool withPaths)
+{
+    const StreetGraph* graph = m_streetMap->graph();
+    if ( graph == nullptr )
+        return false;
+    const StreetGraph& g = *graph;
+    int n = g.nodeCount();
+
+    rankNodes(m_hubNode);
+    vector<vector<int>> hubs(n);
+    vector<vector<float>> miles(n);
+    vector<vector<int>> parents(withPaths ? n : 0);
+
+    vector<float> hubDist(n, UNREACHABLE);
+    vector<double> dist(n, -1);
+    vector<int> parent(n), touched;
+    typedef pair<double, int> Entry;
+    for ( int rank = 0 ; rank < n ; rank++ )
+    {
+        int root = m_hubNode[rank];
+        for ( size_t i = 0 ; i < hubs[root].size() ; i++ )
+            hubDist[hubs[root][i]] = miles[root][i];
+
+        priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+        dist[root] = 0;
+        parent[root] = root;
+        touched.push_back(root);
+        open.push(Entry(0, root));
+        while ( !open.empty() )
+        {
+            Entry top = open.top();
+            open.pop();
+            int v = top.second;
+            if ( top.first > dist[v] )
+                continue;
+
+            bool covered = false;
+            for ( size_t i = 0 ; i < hubs[v].size()  &&  !covered ; i++ )
+                covered = hubDist[hubs[v][i]] + miles[v][i] <= top.first;
+            if ( covered )
+                continue; // and neither is anything beyond v
+
+            hubs[v].push_back(rank);
+            miles[v].push_back(top.first);
+            if ( withPaths )
+                parents[v].push_back(parent[v]);
+            for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+            {
+                int w = g.edgeTarget(e);
+                double d = top.first + g.edgeMiles(e);
+                if ( dist[w] < 0  ||  d < dist[w] )
+                {
+                    if ( dist[w] < 0 )
+                        touched.push_back(w);
+                    dist[w] = d;
+                    parent[w] = v;
+                    open.push(Entry(d, w));
+                }
+            }
+        }
+
+        for ( size_t i = 0 ; i < hubs[root].size() ; i++ )
+            hubDist[hubs[root][i]] = UNREACHABLE;
+        for ( size_t i = 0 ; i < touched.size() ; i++ )
+            dist[touched[i]] = -1;
+        touched.clear();
+    }
+
+    // flatten
+    m_labelStart.assign(n + 1, 0);
+    for ( int v = 0 ; v < n ; v++ )
+        m_labelStart[v + 1] = m_labelStart[v] + hubs[v].size();
+    m_hub.clear();
+    m_miles.clear();
+    m_parent.clear();
+    m_hub.reserve(m_labelStart[n]);
+    m_miles.reserve(m_labelStart[n]);
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        m_hub.insert(m_hub.end(), hubs[v].begin(), hubs[v].end());
+        m_miles.insert(m_miles.end(), miles[v].begin(), miles[v].end());
+        if ( withPaths )
+            m_parent.insert(m_parent.end(), parents[v].begin(), parents[v].end());
+    }
+    return true;
+}
+
+template<typename T>
+static void writeArray(ofstream& out, const vector<T>& v)
+{
+    unsigned int size = v.size();
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(v.data()), size * sizeof(T));
+}
+
+template<typename T>
+static bool readArray(ifstream& in, vector<T>& v)
+{
+    unsigned int size;
+    if ( !in.read(reinterpret_cast<char*>(&size), sizeof(size)) )
+        return false;
+    v.resize(size);
+    return bool(in.read(reinterpret_cast<char*>(v.data()), size * sizeof(T)));
+}
+
+  // magic, node and edge count of the map, then each array as its length and raw contents
+bool HubLabelsImpl::save(string labelFile) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  int(m_labelStart.size()) != g->nodeCount() + 1 )
+        return false;
+    ofstream out(labelFile, ios::binary);
+    if ( !out )
+        return false;
+    unsigned int header[3] = { LABEL_FILE_MAGIC, (unsigned int)g->nodeCount(), (unsigned int)g->edgeCount() };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    writeArray(out, m_labelStart);
+    writeArray(out, m_hub);
+    writeArray(out, m_miles);
+    writeArray(out, m_parent);
+    writeArray(out, m_hubNode);
+    return bool(out);
+}
+
+bool HubLabelsImpl::load(string labelFile)
+{
+    const StreetGraph* g = m_streetMap->graph();
+    ifstream in(labelFile, ios::binary);
+    unsigned int header[3];
+    if ( g == nullptr  ||  !in  ||  !in.read(reinterpret_cast<char*>(header), sizeof(header)) )
+        return false;
+    if ( header[0] != LABEL_FILE_MAGIC  ||  header[1] != unsigned(g->nodeCount())  ||  header[2] != unsigned(g->edgeCount()) )
+        return false;
+    bool ok = readArray(in, m_labelStart)  &&  readArray(in, m_hub)  &&  readArray(in, m_miles)  &&
+              readArray(in, m_parent)  &&  readArray(in, m_hubNode);
+    if ( !ok  ||  int(m_labelStart.size()) != g->nodeCount() + 1  ||  int(m_hub.size()) != m_labelStart.back()  ||
+         m_miles.size() != m_hub.size()  ||  (!m_parent.empty()  &&  m_parent.size() != m_hub.size()) )
+    {
+        m_labelStart.clear();
+        return false;
+    }
+    return true;
+}
+
+// Merges the two sorted labels a block of LABEL_LANES at a time. A block whose last hub is smaller
+// than the other block's last hub can't meet anything further along the other list, so it's done.
+float HubLabelsImpl::query(int a, int b, int& bestA, int& bestB) const
+{
+    const int* hubA = &m_hub[0] + m_labelStart[a];
+    const int* hubB = &m_hub[0] + m_labelStart[b];
+    const float* milesA = &m_miles[0] + m_labelStart[a];
+    const float* milesB = &m_miles[0] + m_labelStart[b];
+    int na = m_labelStart[a + 1] - m_labelStart[a];
+    int nb = m_labelStart[b + 1] - m_labelStart[b];
+
+    float best = UNREACHABLE;
+    bestA = bestB = -1;
+    int i = 0, j = 0;
+    while ( i + LABEL_LANES <= na  &&  j + LABEL_LANES <= nb )
+    {
+        float lane[LABEL_LANES];
+        for ( int k = 0 ; k < LABEL_LANES ; k++ )
+        {
+            lane[k] = UNREACHABLE;
+            for ( int l = 0 ; l < LABEL_LANES ; l++ )
+            {
+                float c = hubA[i + k] == hubB[j + l] ? milesA[i + k] + milesB[j + l] : UNREACHABLE;
+                lane[k] = c < lane[k] ? c : lane[k];
+            }
+        }
+        for ( int k = 0 ; k < LABEL_LANES ; k++ )
+        {
+            if ( lane[k] < best )
+            {
+                best = lane[k];
+                bestA = i + k;
+            }
+        }
+        int lastA = hubA[i + LABEL_LANES - 1], lastB = hubB[j + LABEL_LANES - 1];
+        if ( lastA <= lastB )
+            i += LABEL_LANES;
+        if ( lastB <= lastA )
+            j += LABEL_LANES;
+    }
+    while ( i < na  &&  j < nb )
+    {
+        if ( hubA[i] < hubB[j] )
+            i++;
+        else if ( hubB[j] < hubA[i] )
+            j++;
+        else
+        {
+            if ( milesA[i] + milesB[j] < best )
+            {
+                best = milesA[i] + milesB[j];
+                bestA = i;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    // the blocks only remember which of a's entries won; find b's
+    if ( bestA != -1 )
+    {
+        bestB = entryFor(b, hubA[bestA]) - m_labelStart[b];
+        bestA += m_labelStart[a];
+        bestB += m_labelStart[b];
+    }
+    return best;
+}
+
+  // index of node's entry for hub, which the caller knows is there
+int HubLabelsImpl::entryFor(int node, int hub) const
+{
+    return lower_bound(m_hub.begin() + m_labelStart[node], m_hub.begin() + m_labelStart[node + 1], hub) - m_hub.begin();
+}
+
+  // every node on the way from node to the hub, node first. Each of them got the hub in its own
+  // label: the pruned search only went past nodes it labeled
+void HubLabelsImpl::walkToHub(int node, int hub, vector<int>& path) const
+{
+    path.clear();
+    path.push_back(node);
+    while ( node != m_hubNode[hub] )
+    {
+        node = m_parent[entryFor(node, hub)];
+        path.push_back(node);
+    }
+}
+
+DeliveryResult HubLabelsImpl::distance(const GeoCoord& start, const GeoCoord& end, double& miles) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  m_labelStart.empty() )
+        return BAD_COORD;
+    int a = g->findNode(start), b = g->findNode(end);
+    if ( a == -1  ||  b == -1 )
+        return BAD_COORD;
+    int bestA, bestB;
+    float best = query(a, b, bestA, bestB);
+    if ( bestA == -1 )
+        return NO_ROUTE;
+    miles = best;
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult HubLabelsImpl::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  m_labelStart.empty() )
+        return BAD_COORD;
+    int a = g->findNode(start), b = g->findNode(end);
+    if ( a == -1  ||  b == -1 )
+        return BAD_COORD;
+    route.clear();
+    totalDistanceTravelled = 0;
+    if ( a == b )
+        return DELIVERY_SUCCESS;
+    int bestA, bestB;
+    query(a, b, bestA, bestB);
+    if ( bestA == -1  ||  m_parent.empty() )
+        return NO_ROUTE;
+
+    // start up to the hub, then back down the end's side of it
+    vector<int> path, back;
+    walkToHub(a, m_hub[bestA], path);
+    walkToHub(b, m_hub[bestA], back);
+    path.insert(path.end(), back.rbegin() + 1, back.rend());
+
+    for ( size_t i = 0 ; i + 1 < path.size() ; i++ )
+    {
+        // the search relaxed the shortest of any parallel streets
+        int from = path[i], to = path[i + 1], edge = -1;
+        for ( int e = g->firstEdge(from) ; e < g->lastEdge(from) ; e++ )
+        {
+            if ( g->edgeTarget(e) == to  &&  (edge == -1  ||  g->edgeMiles(e) < g->edgeMiles(edge)) )
+                edge = e;
+        }
+        route.push_back(g->segment(from, edge));
+        totalDistanceTravelled += g->edgeMiles(edge);
+    }
+    return DELIVERY_SUCCESS;
+}
+
+double HubLabelsImpl::averageLabelSize() const
+{
+    if ( m_labelStart.size() < 2 )
+        return 0;
+    return double(m_hub.size()) / (m_labelStart.size() - 1);
+}
+
+bool HubLabelsImpl::hasPaths() const
+{
+    return !m_parent.empty();
+}
+
+//******************** HubLabels functions ************************************
+
+// These functions simply delegate to HubLabelsImpl's functions.
+
+HubLabels::HubLabels(const StreetMap* sm)
+{
+    m_impl = new HubLabelsImpl(sm);
+}
+
+HubLabels::~HubLabels()
+{
+    delete m_impl;
+}
+
+bool HubLabels::build(bool withPaths)
+{
+    return m_impl->build(withPaths);
+}
+
+bool HubLabels::save(string labelFile) const
+{
+    return m_impl->save(labelFile);
+}
+
+bool HubLabels::load(string labelFile)
+{
+    return m_impl->load(labelFile);
+}
+
+DeliveryResult HubLabels::distance(const GeoCoord& start, const GeoCoord& end, double& miles) const
+{
+    return m_impl->distance(start, end, miles);
+}
+
+DeliveryResult HubLabels::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+}
+
+double HubLabels::averageLabelSize() const
+{
+    return m_impl->averageLabelSize();
+}
+
+bool HubLabels::hasPaths() const
+{
+    return m_impl->hasPaths();
+}
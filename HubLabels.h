@@ -0,0 +1,51 @@
+
+#ifndef HUB_LABELS_INCLUDED
+#define HUB_LABELS_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <list>
+
+// HubLabels.h
+
+// Road distance between any two intersections by looking up two short lists instead of
+// searching the map, for callers that need many distances and few routes (fee quotes).
+//
+// build() ranks intersections by how many shortest paths run through them (estimated from a
+// sample of shortest-path trees) and runs a pruned search from each in rank order: a search
+// stops at any intersection whose distance is already answered by the hubs before it. Each
+// intersection ends up with a list of (hub, miles) pairs sorted by hub, and the distance between
+// two intersections is the best hub the two lists share. With paths, every pair also records the
+// next intersection toward its hub, so the route through the best hub can be spelled out.
+//
+// The label file is tied to the map it was built from; load() refuses a file whose node and
+// edge counts differ from the map's.
+
+class HubLabelsImpl;
+
+class HubLabels
+{
+public:
+    HubLabels(const StreetMap* sm);
+    ~HubLabels();
+    bool build(bool withPaths = false);
+    bool save(std::string labelFile) const;
+    bool load(std::string labelFile);
+      // BAD_COORD for a coordinate that isn't an intersection, NO_ROUTE if no street connects them
+    DeliveryResult distance(const GeoCoord& start, const GeoCoord& end, double& miles) const;
+      // needs labels built or saved with paths; NO_ROUTE otherwise
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled) const;
+    double averageLabelSize() const;
+    bool hasPaths() const;
+      // We prevent a HubLabels object from being copied or assigned.
+    HubLabels(const HubLabels&) = delete;
+    HubLabels& operator=(const HubLabels&) = delete;
+private:
+    HubLabelsImpl* m_impl;
+};
+
+#endif // HUB_LABELS_INCLUDED
@@ -0,0 +1,234 @@
+//
+//  LoadGenerator.cpp
+//  Goober Eats
+//
+
+#include "LoadGenerator.h"
+#include "StreetGraph.h"
+#include "Deadline.h"
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+const int LINEAR_BUCKETS = 256;     // values below this get a bucket each
+const int SUB_BUCKETS = 128;        // buckets per power of two above that
+const int HISTOGRAM_BUCKETS = LINEAR_BUCKETS + 56 * SUB_BUCKETS;
+
+  // values v..bucketTop(bucketOf(v)) share a bucket
+static int bucketOf(long long v)
+{
+    if ( v < LINEAR_BUCKETS )
+        return v;
+    int shift = 1;
+    while ( (v >> shift) >= 2 * SUB_BUCKETS )
+        shift++;
+    return LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + int(v >> shift) - SUB_BUCKETS;
+}
+
+static long long bucketTop(int bucket)
+{
+    if ( bucket < LINEAR_BUCKETS )
+        return bucket;
+    int shift = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+    long long sub = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+ : m_counts(HISTOGRAM_BUCKETS, 0)
+{
+    m_count = 0;
+    m_max = 0;
+    m_sum = 0;
+}
+
+void LatencyHistogram::record(long long micros)
+{
+    if ( micros < 0 )
+        micros = 0;
+    m_counts[bucketOf(micros)]++;
+    m_count++;
+    m_max = max(m_max, micros);
+    m_sum += micros;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for ( int i = 0 ; i < HISTOGRAM_BUCKETS ; i++ )
+        m_counts[i] += other.m_counts[i];
+    m_count += other.m_count;
+    m_max = max(m_max, other.m_max);
+    m_sum += other.m_sum;
+}
+
+double LatencyHistogram::mean() const
+{
+    return m_count == 0 ? 0 : m_sum / m_count;
+}
+
+long long LatencyHistogram::percentile(double p) const
+{
+    if ( m_count == 0 )
+        return 0;
+    long long rank = (long long)(p / 100 * m_count + 0.5);
+    rank = max(1LL, min(rank, m_count));
+    long long seen = 0;
+    for ( int i = 0 ; i < HISTOGRAM_BUCKETS ; i++ )
+    {
+        seen += m_counts[i];
+        if ( seen >= rank )
+            return min(bucketTop(i), m_max);
+    }
+    return m_max;
+}
+
+struct LoadBatch
+{
+    GeoCoord depot;
+    vector<DeliveryRequest> deliveries;
+};
+
+  // a random intersection in component
+static int randomNode(const StreetGraph& g, int component, mt19937& rng)
+{
+    uniform_int_distribution<int> node(0, g.nodeCount() - 1);
+    for ( ;; )
+    {
+        int v = node(rng);
+        if ( g.component(v) == component )
+            return v;
+    }
+}
+
+  // wanders from node along random streets until it has gone miles
+static int randomWalk(const StreetGraph& g, int node, double miles, mt19937& rng)
+{
+    const int MAX_STEPS = 1000;
+    double gone = 0;
+    for ( int step = 0 ; step < MAX_STEPS  &&  gone < miles ; step++ )
+    {
+        uniform_int_distribution<int> pick(g.firstEdge(node), g.lastEdge(node) - 1);
+        int e = pick(rng);
+        gone += g.edgeMiles(e);
+        node = g.edgeTarget(e);
+    }
+    return node;
+}
+
+static bool makeBatches(const StreetGraph& g, const LoadProfile& profile, vector<LoadBatch>& batches)
+{
+    if ( g.nodeCount() == 0  ||  profile.minStops < 1  ||  profile.maxStops < profile.minStops )
+        return false;
+
+    // everything goes in the biggest component, so a failure means the planner failed
+    vector<int> size(g.componentCount(), 0);
+    for ( int v = 0 ; v < g.nodeCount() ; v++ )
+        size[g.component(v)]++;
+    int component = max_element(size.begin(), size.end()) - size.begin();
+
+    mt19937 rng(profile.seed);
+    uniform_int_distribution<int> stops(profile.minStops, profile.maxStops);
+    uniform_real_distribution<double> unit(0, 1);
+    batches.resize(profile.requests);
+    for ( int i = 0 ; i < profile.requests ; i++ )
+    {
+        LoadBatch& batch = batches[i];
+        batch.depot = g.coord(randomNode(g, component, rng));
+        int count = stops(rng);
+        bool clustered = unit(rng) < profile.clusteredFraction;
+        int centre = randomNode(g, component, rng);
+        for ( int k = 0 ; k < count ; k++ )
+        {
+            int v = clustered ? randomWalk(g, centre, unit(rng) * profile.clusterMiles, rng) : randomNode(g, component, rng);
+            batch.deliveries.push_back(DeliveryRequest("item " + to_string(k + 1), g.coord(v)));
+        }
+    }
+    return true;
+}
+
+struct WorkerTally
+{
+    LatencyHistogram latency;
+    int results[5] = { 0, 0, 0, 0, 0 }; // by DeliveryResult
+};
+
+bool runLoad(const StreetMap* sm, const LoadProfile& profile, LoadReport& report)
+{
+    const StreetGraph* g = sm->graph();
+    vector<LoadBatch> batches;
+    if ( g == nullptr  ||  profile.threads < 1  ||  !makeBatches(*g, profile, batches) )
+        return false;
+
+    typedef chrono::steady_clock Clock;
+    atomic<int> next(0);
+    vector<WorkerTally> tallies(profile.threads);
+    Clock::time_point start = Clock::now();
+
+    auto work = [&](int t) {
+        DeliveryPlanner planner(sm);
+        vector<DeliveryCommand> commands;
+        double miles;
+        for ( int i = next++ ; i < int(batches.size()) ; i = next++ )
+        {
+            Clock::time_point due = Clock::now();
+            if ( profile.requestsPerSecond > 0 )
+            {
+                due = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(i / profile.requestsPerSecond));
+                this_thread::sleep_until(due);
+            }
+            double budget = profile.deadlineMillis - chrono::duration<double, milli>(Clock::now() - due).count();
+            Deadline deadline(budget);
+            planner.setDeadline(profile.deadlineMillis > 0 ? &deadline : nullptr);
+            DeliveryResult result = planner.generateDeliveryPlan(batches[i].depot, batches[i].deliveries, commands, miles);
+            tallies[t].latency.record(chrono::duration_cast<chrono::microseconds>(Clock::now() - due).count());
+            tallies[t].results[result]++;
+        }
+    };
+    vector<thread> workers;
+    for ( int t = 1 ; t < profile.threads ; t++ )
+        workers.push_back(thread(work, t));
+    work(0);
+    for ( size_t t = 0 ; t < workers.size() ; t++ )
+        workers[t].join();
+    report.seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    report.latency = LatencyHistogram();
+    report.succeeded = report.badCoord = report.noRoute = report.timeWindowViolation = report.deadlineExceeded = 0;
+    for ( int t = 0 ; t < profile.threads ; t++ )
+    {
+        report.latency.merge(tallies[t].latency);
+        report.succeeded += tallies[t].results[DELIVERY_SUCCESS];
+        report.badCoord += tallies[t].results[BAD_COORD];
+        report.noRoute += tallies[t].results[NO_ROUTE];
+        report.timeWindowViolation += tallies[t].results[TIME_WINDOW_VIOLATION];
+        report.deadlineExceeded += tallies[t].results[DEADLINE_EXCEEDED];
+    }
+    return true;
+}
+
+void writeLoadReport(const LoadProfile& profile, const LoadReport& report, ostream& out)
+{
+    const LatencyHistogram& h = report.latency;
+    out.setf(ios::fixed);
+    out.precision(1);
+    out << h.count() << " requests from " << profile.threads << " threads";
+    if ( profile.requestsPerSecond > 0 )
+        out << " at " << profile.requestsPerSecond << "/s";
+    out << ", " << profile.minStops << "-" << profile.maxStops << " stops, seed " << profile.seed << endl;
+    out << "  latency ms: p50 " << h.percentile(50) / 1000.0 << "  p90 " << h.percentile(90) / 1000.0
+        << "  p99 " << h.percentile(99) / 1000.0 << "  p99.9 " << h.percentile(99.9) / 1000.0
+        << "  max " << h.maximum() / 1000.0 << "  mean " << h.mean() / 1000 << endl;
+    out.precision(2);
+    out << "  throughput: " << (report.succeeded + report.deadlineExceeded) / report.seconds << " plans/s over "
+        << report.seconds << " s";
+    if ( profile.deadlineMillis > 0 )
+        out << ", " << report.deadlineExceeded << " cut short by the " << profile.deadlineMillis << " ms deadline";
+    out << endl;
+    out << "  errors: " << report.badCoord << " bad coordinates, " << report.noRoute << " no route, "
+        << report.timeWindowViolation << " time window violations" << endl;
+}
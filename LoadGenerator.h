@@ -0,0 +1,75 @@
+
+#ifndef LOAD_GENERATOR_INCLUDED
+#define LOAD_GENERATOR_INCLUDED
+
+#include "provided.h"
+#include <vector>
+#include <iostream>
+
+// LoadGenerator.h
+
+// Drives DeliveryPlanner from several threads with made-up delivery batches, to see how
+// planning holds up under sustained load rather than one route at a time.
+//
+// Batches are drawn from the map's intersections before anything runs, from profile.seed alone,
+// so the same seed always sends the same requests in the same order. Each batch has a depot and
+// between minStops and maxStops deliveries, all in the biggest connected part of the map. A
+// clusteredFraction of batches put their stops within clusterMiles (by road) of one spot, the
+// way orders bunch up around a busy neighborhood; the rest spread them over the whole map.
+//
+// Requests are sent on a fixed schedule, request i at i / requestsPerSecond seconds, whether or
+// not a thread is free for it. Latency is measured from when a request was due, so time spent
+// waiting behind slow ones counts, as it would for a customer. With requestsPerSecond 0 each
+// thread sends its next request as soon as the last is done, and latency is just planning time.
+// With deadlineMillis, each request gets that long from when it was due (Deadline.h); the ones
+// that run out still count as answered, with a best-effort plan.
+
+struct LoadProfile
+{
+    int threads = 4;
+    double requestsPerSecond = 2;
+    int requests = 40;
+    int minStops = 2;
+    int maxStops = 6;
+    double clusteredFraction = 0.5;
+    double clusterMiles = 1;
+    unsigned int seed = 2020;
+    double deadlineMillis = 0;          // 0 for no limit
+};
+
+  // microsecond latencies in buckets no wider than 1/128 of their value, so any percentile is
+  // within 1% of exact however large the values get
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+    void record(long long micros);
+    void merge(const LatencyHistogram& other);
+    long long count() const { return m_count; }
+    long long maximum() const { return m_max; }
+    double mean() const;
+      // p from 0 to 100; the largest value of the bucket holding it
+    long long percentile(double p) const;
+private:
+    std::vector<long long> m_counts;
+    long long m_count;
+    long long m_max;
+    double m_sum;
+};
+
+struct LoadReport
+{
+    LatencyHistogram latency;           // of every request, however it came out
+    double seconds;                     // from the first request due to the last finished
+    int succeeded;
+    int badCoord;
+    int noRoute;
+    int timeWindowViolation;
+    int deadlineExceeded;               // answered, but best-effort
+};
+
+  // false if the map has no StreetGraph (a tiled map) or nowhere to put a batch
+bool runLoad(const StreetMap* sm, const LoadProfile& profile, LoadReport& report);
+void writeLoadReport(const LoadProfile& profile, const LoadReport& report, std::ostream& out);
+
+#endif // LOAD_GENERATOR_INCLUDED
@@ -0,0 +1,343 @@
+//
+//  MapPartitioner.cpp
+//  Goober Eats
+//
+
+#include "RegionalMap.h"
+#include "ExpandableHashMap.h"
+#include <vector>
+#include <functional>
+#include <queue>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+unsigned int hasher(const GeoCoord& g); // prototype, see StreetMap.cpp
+bool readMapFile(string mapFile, const function<void(const string& streetName,
+                                                     const string& startLat, const string& startLon,
+                                                     const string& endLat, const string& endLon)>& onSegment); // prototype, see StreetMap.cpp
+
+// a bisection is only accepted between 40% and 60% of the nodes, so cells stay balanced
+const double MIN_SPLIT_FRACTION = 0.4;
+
+struct RawSegment
+{
+    int from, to;
+    string name;
+};
+
+struct SplitNode
+{
+    int axis;           // 0 latitude, 1 longitude, -1 for a cell
+    double value;       // coordinates below value go left
+    int left, right;
+    int cell;
+};
+
+class MapPartitioner
+{
+public:
+    bool read(string mapFile);
+    void partition(int cellNodes);
+    bool write(string outDir) const;
+private:
+    int addNode(const GeoCoord& g);
+    int bisect(vector<int>& nodes, int cellNodes);
+    void computeShortcuts();
+    bool writeStreets(string file, const vector<int>& segments) const;
+
+    vector<GeoCoord> m_coords;
+    ExpandableHashMap<GeoCoord, int> m_nodeIds;
+    vector<RawSegment> m_segments;
+    vector<vector<int>> m_adjacent;         // segment indices touching each node
+    vector<int> m_cellOf;
+    vector<SplitNode> m_tree;
+    int m_cellCount;
+
+    struct Shortcut { int cell, from, to; double miles; };
+    vector<Shortcut> m_shortcuts;
+};
+
+int MapPartitioner::addNode(const GeoCoord& g)
+{
+    const int* id = m_nodeIds.find(g);
+    if ( id != nullptr )
+        return *id;
+    int newId = m_coords.size();
+    m_coords.push_back(g);
+    m_adjacent.push_back(vector<int>());
+    m_nodeIds.associate(g, newId);
+    return newId;
+}
+
+bool MapPartitioner::read(string mapFile)
+{
+    return readMapFile(mapFile, [this](const string& streetName, const string& sLat, const string& sLon,
+                                       const string& eLat, const string& eLon) {
+        RawSegment seg;
+        seg.from = addNode(GeoCoord(sLat, sLon));
+        seg.to = addNode(GeoCoord(eLat, eLon));
+        seg.name = streetName;
+        m_adjacent[seg.from].push_back(m_segments.size());
+        m_adjacent[seg.to].push_back(m_segments.size());
+        m_segments.push_back(seg);
+    });
+}
+
+// Splits nodes in two and recurses, returning the index of the subtree in m_tree. Candidate cuts
+// are scored by sweeping the nodes in coordinate order: a street is cut by a split at rank k when
+// one end ranks below k and the other doesn't, so a difference array gives every k's count at once.
+int MapPartitioner::bisect(vector<int>& nodes, int cellNodes)
+{
+    int self = m_tree.size();
+    m_tree.push_back(SplitNode());
+    int n = nodes.size();
+    if ( n <= cellNodes )
+    {
+        m_tree[self].axis = -1;
+        m_tree[self].cell = m_cellCount;
+        for ( int i = 0 ; i < n ; i++ )
+            m_cellOf[nodes[i]] = m_cellCount;
+        m_cellCount++;
+        return self;
+    }
+
+    // mark the subset so we can tell which streets lie inside it; the mark is unique to this
+    // call because the other half of our parent's split is still waiting its turn
+    const int INSIDE = -2 - self;
+    for ( int i = 0 ; i < n ; i++ )
+        m_cellOf[nodes[i]] = INSIDE;
+
+    int bestAxis = -1, bestRank = -1;
+    long long bestCut = -1;
+    vector<int> rank(m_coords.size());
+    vector<long long> cuts(n + 2);
+    for ( int axis = 0 ; axis < 2 ; axis++ )
+    {
+        sort(nodes.begin(), nodes.end(), [this, axis](int a, int b) {
+            return axis == 0 ? m_coords[a].latitude < m_coords[b].latitude : m_coords[a].longitude < m_coords[b].longitude;
+        });
+        for ( int i = 0 ; i < n ; i++ )
+            rank[nodes[i]] = i;
+
+        fill(cuts.begin(), cuts.end(), 0);
+        for ( int i = 0 ; i < n ; i++ )
+        {
+            for ( int s : m_adjacent[nodes[i]] )
+            {
+                int other = m_segments[s].from == nodes[i] ? m_segments[s].to : m_segments[s].from;
+                if ( m_cellOf[other] != INSIDE  ||  rank[other] <= i ) // count each street once
+                    continue;
+                cuts[i + 1]++;
+                cuts[rank[other] + 1]--;
+            }
+        }
+        long long running = 0;
+        for ( int k = 1 ; k < n ; k++ )
+        {
+            running += cuts[k];
+            if ( k < n * MIN_SPLIT_FRACTION  ||  k > n * (1 - MIN_SPLIT_FRACTION) )
+                continue;
+            double below = axis == 0 ? m_coords[nodes[k-1]].latitude : m_coords[nodes[k-1]].longitude;
+            double above = axis == 0 ? m_coords[nodes[k]].latitude : m_coords[nodes[k]].longitude;
+            if ( below == above ) // no coordinate separates these two
+                continue;
+            bool better = bestCut < 0  ||  running < bestCut  ||
+                          (running == bestCut  &&  abs(k - n / 2) < abs(bestRank - n / 2));
+            if ( better )
+            {
+                bestCut = running;
+                bestAxis = axis;
+                bestRank = k;
+            }
+        }
+    }
+
+    if ( bestAxis == -1 ) // every node in one spot; nothing to split
+    {
+        for ( int i = 0 ; i < n ; i++ )
+            m_cellOf[nodes[i]] = m_cellCount;
+        m_tree[self].axis = -1;
+        m_tree[self].cell = m_cellCount++;
+        return self;
+    }
+
+    sort(nodes.begin(), nodes.end(), [this, bestAxis](int a, int b) {
+        return bestAxis == 0 ? m_coords[a].latitude < m_coords[b].latitude : m_coords[a].longitude < m_coords[b].longitude;
+    });
+    const GeoCoord& pivot = m_coords[nodes[bestRank]];
+    m_tree[self].axis = bestAxis;
+    m_tree[self].value = bestAxis == 0 ? pivot.latitude : pivot.longitude;
+    m_tree[self].cell = -1;
+
+    vector<int> low(nodes.begin(), nodes.begin() + bestRank);
+    vector<int> high(nodes.begin() + bestRank, nodes.end());
+    nodes.clear();
+    int left = bisect(low, cellNodes);
+    int right = bisect(high, cellNodes);
+    m_tree[self].left = left;
+    m_tree[self].right = right;
+    return self;
+}
+
+  // all-pairs distances between each cell's boundary nodes, over streets inside that cell
+void MapPartitioner::computeShortcuts()
+{
+    vector<bool> boundary(m_coords.size(), false);
+    vector<vector<int>> cellBoundary(m_cellCount);
+    for ( size_t s = 0 ; s < m_segments.size() ; s++ )
+    {
+        int a = m_segments[s].from, b = m_segments[s].to;
+        if ( m_cellOf[a] == m_cellOf[b] )
+            continue;
+        for ( int v : { a, b } )
+        {
+            if ( !boundary[v] )
+            {
+                boundary[v] = true;
+                cellBoundary[m_cellOf[v]].push_back(v);
+            }
+        }
+    }
+
+    vector<double> dist(m_coords.size(), -1);
+    vector<int> touched;
+    for ( int c = 0 ; c < m_cellCount ; c++ )
+    {
+        for ( int source : cellBoundary[c] )
+        {
+            typedef pair<double, int> Entry;
+            priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+            dist[source] = 0;
+            touched.push_back(source);
+            open.push(Entry(0, source));
+            while ( !open.empty() )
+            {
+                Entry top = open.top();
+                open.pop();
+                int v = top.second;
+                if ( top.first > dist[v] )
+                    continue;
+                if ( v != source  &&  boundary[v] )
+                {
+                    Shortcut sc = { c, source, v, top.first };
+                    m_shortcuts.push_back(sc);
+                }
+                for ( int s : m_adjacent[v] )
+                {
+                    int w = m_segments[s].from == v ? m_segments[s].to : m_segments[s].from;
+                    if ( m_cellOf[w] != c )
+                        continue;
+                    double d = top.first + distanceEarthMiles(m_coords[v], m_coords[w]);
+                    if ( dist[w] < 0  ||  d < dist[w] )
+                    {
+                        if ( dist[w] < 0 )
+                            touched.push_back(w);
+                        dist[w] = d;
+                        open.push(Entry(d, w));
+                    }
+                }
+            }
+            for ( int v : touched )
+                dist[v] = -1;
+            touched.clear();
+        }
+    }
+}
+
+void MapPartitioner::partition(int cellNodes)
+{
+    if ( cellNodes < 1 )
+        cellNodes = 1;
+    m_cellOf.assign(m_coords.size(), -1);
+    m_tree.clear();
+    m_cellCount = 0;
+    vector<int> all(m_coords.size());
+    for ( size_t i = 0 ; i < all.size() ; i++ )
+        all[i] = i;
+    bisect(all, cellNodes);
+    computeShortcuts();
+}
+
+  // runs of same-named streets share one header, as in mapdata.txt
+bool MapPartitioner::writeStreets(string file, const vector<int>& segments) const
+{
+    ofstream out(file);
+    if ( !out )
+        return false;
+    for ( size_t i = 0 ; i < segments.size() ; )
+    {
+        size_t j = i;
+        while ( j < segments.size()  &&  m_segments[segments[j]].name == m_segments[segments[i]].name )
+            j++;
+        out << m_segments[segments[i]].name << '\n' << (j - i) << '\n';
+        for ( ; i < j ; i++ )
+        {
+            const RawSegment& seg = m_segments[segments[i]];
+            out << m_coords[seg.from].latitudeText << ' ' << m_coords[seg.from].longitudeText << ' '
+                << m_coords[seg.to].latitudeText << ' ' << m_coords[seg.to].longitudeText << '\n';
+        }
+    }
+    return bool(out);
+}
+
+bool MapPartitioner::write(string outDir) const
+{
+    ofstream index(outDir + "/index.txt");
+    if ( !index )
+        return false;
+    index.precision(17);
+    index << "cells " << m_cellCount << '\n';
+    // preorder, which is the order bisect() created them in
+    for ( size_t i = 0 ; i < m_tree.size() ; i++ )
+    {
+        if ( m_tree[i].axis == -1 )
+            index << "C " << m_tree[i].cell << '\n';
+        else
+            index << "S " << m_tree[i].axis << ' ' << m_tree[i].value << '\n';
+    }
+    if ( !index )
+        return false;
+
+    vector<vector<int>> inCell(m_cellCount);
+    vector<int> crossing;
+    for ( size_t s = 0 ; s < m_segments.size() ; s++ )
+    {
+        int c = m_cellOf[m_segments[s].from];
+        if ( c == m_cellOf[m_segments[s].to] )
+            inCell[c].push_back(s);
+        else
+            crossing.push_back(s);
+    }
+    for ( int c = 0 ; c < m_cellCount ; c++ )
+    {
+        if ( !writeStreets(outDir + "/cell_" + to_string(c) + ".txt", inCell[c]) )
+            return false;
+    }
+    if ( !writeStreets(outDir + "/overlay.txt", crossing) )
+        return false;
+
+    ofstream shortcuts(outDir + "/shortcuts.txt");
+    if ( !shortcuts )
+        return false;
+    shortcuts.precision(17);
+    for ( size_t i = 0 ; i < m_shortcuts.size() ; i++ )
+    {
+        const Shortcut& sc = m_shortcuts[i];
+        shortcuts << sc.cell << ' ' << m_coords[sc.from].latitudeText << ' ' << m_coords[sc.from].longitudeText << ' '
+                  << m_coords[sc.to].latitudeText << ' ' << m_coords[sc.to].longitudeText << ' ' << sc.miles << '\n';
+    }
+    return bool(shortcuts);
+}
+
+bool partitionMap(string mapFile, string outDir, int cellNodes)
+{
+    MapPartitioner partitioner;
+    if ( !partitioner.read(mapFile) )
+        return false;
+    partitioner.partition(cellNodes);
+    return partitioner.write(outDir);
+}
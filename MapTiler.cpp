@@ -0,0 +1,117 @@
+//
+//  MapTiler.cpp
+//  Goober Eats
+//
+
+#include "TiledMap.h"
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+bool readMapFile(string mapFile, const function<void(const string& streetName,
+                                                     const string& startLat, const string& startLon,
+                                                     const string& endLat, const string& endLon)>& onSegment); // prototype, see StreetMap.cpp
+
+struct TiledSegment
+{
+    string lat1, lon1, lat2, lon2;
+    string name;
+    int tile1, tile2;
+};
+
+  // runs of same-named streets share one header, as in mapdata.txt
+static bool writeTile(string file, const vector<TiledSegment>& segments, const vector<int>& inTile)
+{
+    ofstream out(file);
+    if ( !out )
+        return false;
+    for ( size_t i = 0 ; i < inTile.size() ; )
+    {
+        size_t j = i;
+        while ( j < inTile.size()  &&  segments[inTile[j]].name == segments[inTile[i]].name )
+            j++;
+        out << segments[inTile[i]].name << '\n' << (j - i) << '\n';
+        for ( ; i < j ; i++ )
+        {
+            const TiledSegment& seg = segments[inTile[i]];
+            out << seg.lat1 << ' ' << seg.lon1 << ' ' << seg.lat2 << ' ' << seg.lon2 << '\n';
+        }
+    }
+    return bool(out);
+}
+
+bool tileMap(string mapFile, string outDir, double tileDegrees)
+{
+    if ( !(tileDegrees > 0) )
+        return false;
+
+    vector<TiledSegment> segments;
+    bool read = readMapFile(mapFile, [&segments](const string& streetName, const string& sLat, const string& sLon,
+                                                 const string& eLat, const string& eLon) {
+        TiledSegment seg;
+        seg.lat1 = sLat;
+        seg.lon1 = sLon;
+        seg.lat2 = eLat;
+        seg.lon2 = eLon;
+        seg.name = streetName;
+        segments.push_back(seg);
+    });
+    if ( !read )
+        return false;
+    if ( segments.empty() )
+        return false;
+
+    // the grid starts on a multiple of the tile size and covers every coordinate
+    double minLat = 1e9, maxLat = -1e9, minLon = 1e9, maxLon = -1e9;
+    for ( size_t i = 0 ; i < segments.size() ; i++ )
+    {
+        GeoCoord a(segments[i].lat1, segments[i].lon1), b(segments[i].lat2, segments[i].lon2);
+        minLat = min(minLat, min(a.latitude, b.latitude));
+        maxLat = max(maxLat, max(a.latitude, b.latitude));
+        minLon = min(minLon, min(a.longitude, b.longitude));
+        maxLon = max(maxLon, max(a.longitude, b.longitude));
+    }
+    TileGrid grid;
+    grid.degrees = tileDegrees;
+    grid.originLat = floor(minLat / tileDegrees) * tileDegrees;
+    grid.originLon = floor(minLon / tileDegrees) * tileDegrees;
+    if ( grid.originLat > minLat ) // the multiplication can round up past the coordinate
+        grid.originLat -= tileDegrees;
+    if ( grid.originLon > minLon )
+        grid.originLon -= tileDegrees;
+    grid.rows = int(floor((maxLat - grid.originLat) / tileDegrees)) + 1;
+    grid.cols = int(floor((maxLon - grid.originLon) / tileDegrees)) + 1;
+
+    vector<vector<int>> inTile(grid.rows * grid.cols);
+    for ( size_t i = 0 ; i < segments.size() ; i++ )
+    {
+        TiledSegment& seg = segments[i];
+        seg.tile1 = grid.tileOf(GeoCoord(seg.lat1, seg.lon1));
+        seg.tile2 = grid.tileOf(GeoCoord(seg.lat2, seg.lon2));
+        if ( seg.tile1 < 0  ||  seg.tile2 < 0 )
+            return false;
+        inTile[seg.tile1].push_back(i);
+        if ( seg.tile2 != seg.tile1 )
+            inTile[seg.tile2].push_back(i);
+    }
+
+    ofstream index(outDir + "/tiles.txt");
+    if ( !index )
+        return false;
+    index.precision(17);
+    index << "tiles " << grid.degrees << ' ' << grid.originLat << ' ' << grid.originLon << ' '
+          << grid.rows << ' ' << grid.cols << '\n';
+    for ( size_t t = 0 ; t < inTile.size() ; t++ )
+    {
+        if ( inTile[t].empty() )
+            continue;
+        index << t << '\n';
+        if ( !writeTile(outDir + "/tile_" + to_string(t) + ".txt", segments, inTile[t]) )
+            return false;
+    }
+    return bool(index);
+}
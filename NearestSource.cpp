@@ -0,0 +1,271 @@
+//
+//  NearestSource.cpp
+//  Goober Eats
+//
+
+#include "NearestSource.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+// per-search arrays, sized to the graph once and cleared through m_touched afterwards
+struct SourceScratch
+{
+    typedef pair<double, int> Entry;
+
+    vector<double> dist;        // -1 where the search hasn't been
+    vector<int> owner;          // index of the source that reached each node first
+    vector<char> target;        // 1 for a target still to settle, 2 once settled
+    vector<int> touched;
+    vector<Entry> heap;
+
+    void prepare(int nodes)
+    {
+        if ( int(dist.size()) != nodes )
+        {
+            dist.assign(nodes, -1);
+            owner.assign(nodes, -1);
+            target.assign(nodes, 0);
+        }
+    }
+
+    void reset()
+    {
+        for ( size_t i = 0 ; i < touched.size() ; i++ )
+        {
+            dist[touched[i]] = -1;
+            owner[touched[i]] = -1;
+            target[touched[i]] = 0;
+        }
+        touched.clear();
+        heap.clear();
+    }
+};
+
+class NearestSourceImpl
+{
+public:
+    NearestSourceImpl(const StreetMap* sm);
+    ~NearestSourceImpl();
+    DeliveryResult nearest(const vector<GeoCoord>& sources, const GeoCoord& target,
+                           int& source, double& miles) const;
+    DeliveryResult nearestForEach(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                                  vector<int>& source, vector<double>& miles) const;
+    void assignWave(const vector<vector<GeoCoord>>& candidates, const vector<GeoCoord>& orders,
+                    vector<int>& source, vector<double>& miles, int threads) const;
+private:
+    bool search(SourceScratch& s, const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                vector<int>& source, vector<double>& miles) const;
+
+    const StreetMap* m_streetMap;
+    mutable SourceScratch m_scratch;
+};
+
+NearestSourceImpl::NearestSourceImpl(const StreetMap* sm)
+{
+    m_streetMap = sm;
+}
+
+NearestSourceImpl::~NearestSourceImpl()
+{
+}
+
+// Seeds every source at distance zero and runs until all targets are settled. Returns false if
+// no source is an intersection.
+bool NearestSourceImpl::search(SourceScratch& s, const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                               vector<int>& source, vector<double>& miles) const
+{
+    typedef SourceScratch::Entry Entry;
+    const StreetGraph& g = *m_streetMap->graph();
+    s.prepare(g.nodeCount());
+    source.assign(targets.size(), -1);
+    miles.assign(targets.size(), -1);
+
+    for ( size_t i = 0 ; i < sources.size() ; i++ )
+    {
+        int v = g.findNode(sources[i]);
+        if ( v == -1  ||  s.owner[v] != -1 ) // two drivers at one corner: the first listed wins
+            continue;
+        s.dist[v] = 0;
+        s.owner[v] = i;
+        s.touched.push_back(v);
+        s.heap.push_back(Entry(0, v));
+    }
+    if ( s.heap.empty() )
+    {
+        s.reset();
+        return false;
+    }
+    make_heap(s.heap.begin(), s.heap.end(), greater<Entry>());
+
+    vector<int> node(targets.size());
+    int remaining = 0;
+    for ( size_t i = 0 ; i < targets.size() ; i++ )
+    {
+        node[i] = g.findNode(targets[i]);
+        if ( node[i] != -1  &&  s.target[node[i]] == 0 )
+        {
+            s.target[node[i]] = 1;
+            s.touched.push_back(node[i]);
+            remaining++;
+        }
+    }
+
+    while ( remaining > 0  &&  !s.heap.empty() )
+    {
+        pop_heap(s.heap.begin(), s.heap.end(), greater<Entry>());
+        Entry top = s.heap.back();
+        s.heap.pop_back();
+        int v = top.second;
+        if ( top.first > s.dist[v] )
+            continue;
+        if ( s.target[v] == 1 )
+        {
+            s.target[v] = 2;
+            remaining--;
+        }
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+        {
+            int w = g.edgeTarget(e);
+            double d = top.first + g.edgeMiles(e);
+            if ( s.dist[w] >= 0  &&  d >= s.dist[w] )
+                continue;
+            if ( s.dist[w] < 0 )
+                s.touched.push_back(w);
+            s.dist[w] = d;
+            s.owner[w] = s.owner[v];
+            s.heap.push_back(Entry(d, w));
+            push_heap(s.heap.begin(), s.heap.end(), greater<Entry>());
+        }
+    }
+
+    for ( size_t i = 0 ; i < targets.size() ; i++ )
+    {
+        if ( node[i] != -1  &&  s.target[node[i]] == 2 )
+        {
+            source[i] = s.owner[node[i]];
+            miles[i] = s.dist[node[i]];
+        }
+    }
+    s.reset();
+    return true;
+}
+
+DeliveryResult NearestSourceImpl::nearest(const vector<GeoCoord>& sources, const GeoCoord& target,
+                                          int& source, double& miles) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    if ( g == nullptr  ||  g->findNode(target) == -1 )
+        return BAD_COORD;
+    vector<int> found;
+    vector<double> distance;
+    if ( !search(m_scratch, sources, vector<GeoCoord>(1, target), found, distance) )
+        return BAD_COORD;
+    if ( found[0] == -1 )
+        return NO_ROUTE;
+    source = found[0];
+    miles = distance[0];
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult NearestSourceImpl::nearestForEach(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                                                 vector<int>& source, vector<double>& miles) const
+{
+    if ( m_streetMap->graph() == nullptr  ||  !search(m_scratch, sources, targets, source, miles) )
+        return BAD_COORD;
+    return DELIVERY_SUCCESS;
+}
+
+  // threads take the next group of orders off a shared counter, so a slow search doesn't hold up
+  // a block
+void NearestSourceImpl::assignWave(const vector<vector<GeoCoord>>& candidates, const vector<GeoCoord>& orders,
+                                   vector<int>& source, vector<double>& miles, int threads) const
+{
+    source.assign(orders.size(), -1);
+    miles.assign(orders.size(), -1);
+    if ( m_streetMap->graph() == nullptr  ||  candidates.size() != orders.size() )
+        return;
+
+    // orders sorted by their candidates, so each group with one list is a run; group k is
+    // byCandidates[groupStart[k]] up to byCandidates[groupStart[k + 1]]
+    vector<int> byCandidates(orders.size());
+    iota(byCandidates.begin(), byCandidates.end(), 0);
+    sort(byCandidates.begin(), byCandidates.end(), [&](int a, int b) { return candidates[a] < candidates[b]; });
+    vector<int> groupStart;
+    for ( size_t k = 0 ; k < byCandidates.size() ; k++ )
+        if ( k == 0  ||  candidates[byCandidates[k]] != candidates[byCandidates[k - 1]] )
+            groupStart.push_back(k);
+    int groups = groupStart.size();
+    groupStart.push_back(byCandidates.size());
+
+    if ( threads < 1 )
+        threads = 1;
+    if ( threads > groups )
+        threads = groups;
+
+    atomic<int> next(0);
+    auto work = [&](SourceScratch& scratch) {
+        vector<GeoCoord> targets;
+        vector<int> found;
+        vector<double> distance;
+        for ( int k = next++ ; k < groups ; k = next++ )
+        {
+            targets.clear();
+            for ( int j = groupStart[k] ; j < groupStart[k + 1] ; j++ )
+                targets.push_back(orders[byCandidates[j]]);
+            if ( !search(scratch, candidates[byCandidates[groupStart[k]]], targets, found, distance) )
+                continue;
+            for ( int j = groupStart[k] ; j < groupStart[k + 1] ; j++ )
+            {
+                source[byCandidates[j]] = found[j - groupStart[k]];
+                miles[byCandidates[j]] = distance[j - groupStart[k]];
+            }
+        }
+    };
+
+    vector<SourceScratch> scratch(threads > 1 ? threads - 1 : 0);
+    vector<thread> workers;
+    for ( size_t t = 0 ; t < scratch.size() ; t++ )
+        workers.push_back(thread(work, ref(scratch[t])));
+    work(m_scratch); // this thread helps too
+    for ( size_t t = 0 ; t < workers.size() ; t++ )
+        workers[t].join();
+}
+
+//******************** NearestSource functions ********************************
+
+// These functions simply delegate to NearestSourceImpl's functions.
+
+NearestSource::NearestSource(const StreetMap* sm)
+{
+    m_impl = new NearestSourceImpl(sm);
+}
+
+NearestSource::~NearestSource()
+{
+    delete m_impl;
+}
+
+DeliveryResult NearestSource::nearest(const vector<GeoCoord>& sources, const GeoCoord& target,
+                                      int& source, double& miles) const
+{
+    return m_impl->nearest(sources, target, source, miles);
+}
+
+DeliveryResult NearestSource::nearestForEach(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                                             vector<int>& source, vector<double>& miles) const
+{
+    return m_impl->nearestForEach(sources, targets, source, miles);
+}
+
+void NearestSource::assignWave(const vector<vector<GeoCoord>>& candidates, const vector<GeoCoord>& orders,
+                               vector<int>& source, vector<double>& miles, int threads) const
+{
+    m_impl->assignWave(candidates, orders, source, miles, threads);
+}
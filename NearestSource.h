@@ -0,0 +1,51 @@
+
+#ifndef NEAREST_SOURCE_INCLUDED
+#define NEAREST_SOURCE_INCLUDED
+
+#include "provided.h"
+#include <vector>
+
+// NearestSource.h
+
+// Which of several depots or drivers is closest to an order by road.
+//
+// Every source is put in the queue at distance zero and one Dijkstra grows from all of them at
+// once; each intersection it settles is owned by whichever source got there first, which is the
+// nearest one. So one search answers a target, or a whole list of them (it stops once the last
+// target is settled), for about the cost of a single route.
+//
+// When orders can't all use the same sources (a driver without room, the wrong vehicle), each
+// order is searched over its own candidates. assignWave() gathers the orders whose candidate
+// lists are identical (the same sources in the same order) into one search for all their
+// targets, and runs those searches on several threads, each with its own scratch arrays.
+//
+// The calls are const but all search in the same scratch arrays (assignWave's helper threads
+// aside), so use one NearestSource per thread.
+//
+// Sources and targets must be intersections. A target that isn't one, or that no source can
+// reach, gets source -1. The calls need a map loaded with StreetMap::load (not tiled).
+
+class NearestSourceImpl;
+
+class NearestSource
+{
+public:
+    NearestSource(const StreetMap* sm);
+    ~NearestSource();
+      // BAD_COORD if target or every source isn't an intersection, NO_ROUTE if none reaches it
+    DeliveryResult nearest(const std::vector<GeoCoord>& sources, const GeoCoord& target,
+                           int& source, double& miles) const;
+      // BAD_COORD if no source is an intersection
+    DeliveryResult nearestForEach(const std::vector<GeoCoord>& sources, const std::vector<GeoCoord>& targets,
+                                  std::vector<int>& source, std::vector<double>& miles) const;
+      // order i is served from candidates[i]; source[i] indexes into candidates[i]
+    void assignWave(const std::vector<std::vector<GeoCoord>>& candidates, const std::vector<GeoCoord>& orders,
+                    std::vector<int>& source, std::vector<double>& miles, int threads) const;
+      // We prevent a NearestSource object from being copied or assigned.
+    NearestSource(const NearestSource&) = delete;
+    NearestSource& operator=(const NearestSource&) = delete;
+private:
+    NearestSourceImpl* m_impl;
+};
+
+#endif // NEAREST_SOURCE_INCLUDED
@@ -0,0 +1,214 @@
+
+#ifndef OPEN_SET_INCLUDED
+#define OPEN_SET_INCLUDED
+
+#include <vector>
+
+// OpenSet.h
+
+// The open set of a graph search: states waiting to be looked at, smallest key first. Both kinds
+// have the same interface, so searchStreetGraph and ChainGraph::route can take either.
+//
+//   void prepare(int states);          states are numbered 0 to states - 1
+//   void grow(int states);             more states, for a search that finds its graph as it
+//                                      goes; whatever is waiting stays
+//   bool empty() const;
+//   void push(int state, double key);  add state, or lower its key if it's already waiting
+//   OpenEntry pop();                   remove and return the waiting state with the smallest key
+//   void clear();
+//
+// QuaternaryHeap keeps each state at most once and really lowers a key in place, so it never
+// holds more entries than there are states waiting. RadixHeap is for searches whose popped keys
+// never go down, as A* with a heuristic that never overestimates; it keeps keys as whole
+// millionths and files entries in buckets by the highest bit they differ from the last key
+// popped in, so pushing is constant time and each entry moves between buckets at most 64 times.
+// A lowered key is just pushed again, and the search skips the state when the stale entry
+// comes out.
+
+struct OpenEntry
+{
+    double key;
+    int state;
+};
+
+class QuaternaryHeap
+{
+public:
+    void prepare(int states)
+    {
+        if ( int(m_position.size()) != states )
+            m_position.assign(states, -1);
+    }
+
+    void grow(int states)
+    {
+        if ( int(m_position.size()) < states )
+            m_position.resize(states, -1);
+    }
+
+    bool empty() const { return m_heap.empty(); }
+
+    void push(int state, double key)
+    {
+        int at = m_position[state];
+        if ( at == -1 )
+        {
+            at = m_heap.size();
+            m_heap.push_back(OpenEntry{ key, state });
+        }
+        else if ( key < m_heap[at].key )
+            m_heap[at].key = key;
+        else
+            return;
+        siftUp(at);
+    }
+
+    OpenEntry pop()
+    {
+        OpenEntry top = m_heap[0];
+        m_position[top.state] = -1;
+        OpenEntry last = m_heap.back();
+        m_heap.pop_back();
+        if ( !m_heap.empty() )
+            siftDown(last);
+        return top;
+    }
+
+    void clear()
+    {
+        for ( size_t i = 0 ; i < m_heap.size() ; i++ )
+            m_position[m_heap[i].state] = -1;
+        m_heap.clear();
+    }
+
+private:
+    std::vector<OpenEntry> m_heap;      // each entry's four children are at 4i+1 to 4i+4
+    std::vector<int> m_position;        // index in m_heap of each state, or -1
+
+    void place(int at, const OpenEntry& entry)
+    {
+        m_heap[at] = entry;
+        m_position[entry.state] = at;
+    }
+
+    void siftUp(int at)
+    {
+        OpenEntry entry = m_heap[at];
+        while ( at > 0 )
+        {
+            int parent = (at - 1) / 4;
+            if ( m_heap[parent].key <= entry.key )
+                break;
+            place(at, m_heap[parent]);
+            at = parent;
+        }
+        place(at, entry);
+    }
+
+      // entry goes into the hole left at the root
+    void siftDown(const OpenEntry& entry)
+    {
+        int size = m_heap.size(), at = 0;
+        for (;;)
+        {
+            int first = 4 * at + 1;
+            if ( first >= size )
+                break;
+            int smallest = first;
+            int end = first + 4 < size ? first + 4 : size;
+            for ( int child = first + 1 ; child < end ; child++ )
+                if ( m_heap[child].key < m_heap[smallest].key )
+                    smallest = child;
+            if ( m_heap[smallest].key >= entry.key )
+                break;
+            place(at, m_heap[smallest]);
+            at = smallest;
+        }
+        place(at, entry);
+    }
+};
+
+  // RadixHeap keys are whole multiples of one over this: a millionth of a mile, or of a minute
+const double RADIX_KEY_SCALE = 1e6;
+
+class RadixHeap
+{
+public:
+    RadixHeap() : m_last(0), m_size(0) {}
+
+    void prepare(int) {}
+    void grow(int) {}
+
+    bool empty() const { return m_size == 0; }
+
+      // a key a rounding error below the last one popped is taken as equal to it
+    void push(int state, double key)
+    {
+        unsigned long long scaled = key > 0 ? (unsigned long long)(key * RADIX_KEY_SCALE) : 0;
+        if ( scaled < m_last )
+            scaled = m_last;
+        m_buckets[bucketOf(scaled)].push_back(Item{ scaled, state });
+        m_size++;
+    }
+
+    OpenEntry pop()
+    {
+        if ( m_buckets[0].empty() )
+        {
+            // the smallest key is in the first bucket that isn't empty; it becomes the last key
+            // popped, and everything else in its bucket spreads out into lower ones
+            int b = 1;
+            while ( m_buckets[b].empty() )
+                b++;
+            std::vector<Item>& bucket = m_buckets[b];
+            m_last = bucket[0].key;
+            for ( size_t i = 1 ; i < bucket.size() ; i++ )
+                if ( bucket[i].key < m_last )
+                    m_last = bucket[i].key;
+            for ( size_t i = 0 ; i < bucket.size() ; i++ )
+                m_buckets[bucketOf(bucket[i].key)].push_back(bucket[i]);
+            bucket.clear();
+        }
+        Item top = m_buckets[0].back();
+        m_buckets[0].pop_back();
+        m_size--;
+        return OpenEntry{ top.key / RADIX_KEY_SCALE, top.state };
+    }
+
+    void clear()
+    {
+        for ( int b = 0 ; b < BUCKETS ; b++ )
+            m_buckets[b].clear();
+        m_last = 0;
+        m_size = 0;
+    }
+
+private:
+    struct Item
+    {
+        unsigned long long key;
+        int state;
+    };
+
+    static const int BUCKETS = 65;
+
+    std::vector<Item> m_buckets[BUCKETS];   // bucket b holds keys whose highest bit differing from
+    unsigned long long m_last;              // m_last is bit b - 1; bucket 0 holds keys equal to it
+    int m_size;
+
+    int bucketOf(unsigned long long key) const
+    {
+        unsigned long long differ = key ^ m_last;
+        int b = 0;
+#if defined(__GNUC__)
+        if ( differ != 0 )
+            b = 64 - __builtin_clzll(differ);
+#else
+        for ( ; differ != 0 ; differ >>= 1 )
+            b++;
+#endif
+        return b;
+    }
+};
+
+#endif // OPEN_SET_INCLUDED
@@ -7,61 +7,29 @@
 //
 
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include "RoutingPolicies.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include "Deadline.h"
 #include <list>
-#include <queue>
-#include <set>
+#include <vector>
+#include <memory>
+#include <algorithm>
 using namespace std;
 
-struct geoStruct
-{
-    geoStruct()
-    {
-        coord = GeoCoord("34.0547000","-118.4794734");
-        end = GeoCoord("34.0544590","-118.4801137");
-        pathLengthSoFar = 0;
-        streetName = "";
-        
-    }
-    geoStruct(GeoCoord c, GeoCoord e, double pathLength, string sn)
-    {
-        coord = c;
-        end = e;
-        pathLengthSoFar = pathLength;
-        streetName = sn;
-    }
-    
-    GeoCoord coord;
-    GeoCoord end;
-    string streetName;
-    double pathLengthSoFar;
-};
+// The search runs over node numbers, not coordinates. Each tile it reaches (the whole graph, on
+// a map that isn't tiled) gets a block of state numbers, one per node of the tile, and the
+// queue holds just a key and a state number. A node at the far end of a street leaving its
+// tile is in the tile it was reached from too; when it comes off the queue there, the search
+// carries on, at no cost, from the same corner in its own tile, which has all of its streets.
+// Only tiles being looked at are held, so the map's limit on resident tiles still holds.
 
-bool operator==(const geoStruct& lhs, const geoStruct& rhs)
+struct TileSpan
 {
-    if ( lhs.coord == rhs.coord)
-        return true;
-    return false;
-}
-
-unsigned int hasher(const geoStruct& gs)
-{
-    return std::hash<string>()(gs.coord.latitudeText + gs.coord.longitudeText);
-}
-
-class cmpFunction
-{
-public:
-    bool operator()(const geoStruct& a, const geoStruct& b)
-    {
-        if ( a.pathLengthSoFar + distanceEarthMiles(a.coord, a.end) >
-             b.pathLengthSoFar + distanceEarthMiles(b.coord, b.end) )
-            return true;
-        else
-            return false;
-    }
+    int tile;
+    int base;           // state number of the tile's node 0
 };
- 
 
 class PointToPointRouterImpl
 {
@@ -73,18 +41,66 @@ public:
         const GeoCoord& end,
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+    void setDeadline(const Deadline* deadline);
 private:
+    int baseOf(int tile, const StreetGraph& g) const;
+    const TileSpan& spanOf(int state) const;
+    void reset() const;
+
     const StreetMap* m_streetMap;
+    const Deadline* m_deadline;
+
+    // kept between searches, and cleared through m_spans and the scratch's touched list
+    mutable SearchScratch m_scratch;
+    mutable vector<double> m_estimate;      // crow-flies miles to the end, per state
+    mutable vector<TileSpan> m_spans;       // in order of base
+    mutable vector<int> m_tileSpan;         // index into m_spans of each tile, or -1
+    mutable int m_states;
 };
 
 PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm)
 {
     m_streetMap = sm;
+    m_deadline = nullptr;
+    m_states = 0;
 }
 
 PointToPointRouterImpl::~PointToPointRouterImpl()
 {
     
+}
+
+  // the first state number of tile, giving the tile a block of them if this search hasn't yet
+int PointToPointRouterImpl::baseOf(int tile, const StreetGraph& g) const
+{
+    if ( tile >= int(m_tileSpan.size()) )
+        m_tileSpan.resize(tile + 1, -1);
+    if ( m_tileSpan[tile] == -1 )
+    {
+        m_tileSpan[tile] = m_spans.size();
+        m_spans.push_back(TileSpan{ tile, m_states });
+        m_states += g.nodeCount();
+        m_scratch.grow(m_states);
+        if ( int(m_estimate.size()) < m_states )
+            m_estimate.resize(m_states);
+    }
+    return m_spans[m_tileSpan[tile]].base;
+}
+
+const TileSpan& PointToPointRouterImpl::spanOf(int state) const
+{
+    vector<TileSpan>::const_iterator after = upper_bound(m_spans.begin(), m_spans.end(), state,
+        [](int s, const TileSpan& span) { return s < span.base; });
+    return *(after - 1);
+}
+
+void PointToPointRouterImpl::reset() const
+{
+    m_scratch.reset();
+    for ( size_t i = 0 ; i < m_spans.size() ; i++ )
+        m_tileSpan[m_spans[i].tile] = -1;
+    m_spans.clear();
+    m_states = 0;
 }
 
 DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
@@ -93,13 +109,23 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const
 {
+    TRACE_SPAN("generatePointToPointRoute");
+    ALLOC_SCOPE(ALLOC_ROUTER);
     
-    vector<StreetSegment> dummy;
-    if ( m_streetMap->getSegmentsThatStartWith(start, dummy) == false)
-        return BAD_COORD;
-    if (m_streetMap->getSegmentsThatStartWith(end, dummy) ==  false)
+    int startTile = m_streetMap->tileOf(start.latitude, start.longitude);
+    int endTile = m_streetMap->tileOf(end.latitude, end.longitude);
+    shared_ptr<const StreetGraph> startGraph = m_streetMap->tileGraph(startTile);
+    shared_ptr<const StreetGraph> endGraph = m_streetMap->tileGraph(endTile);
+    int a = startGraph ? startGraph->findNode(start) : -1;
+    int b = endGraph ? endGraph->findNode(end) : -1;
+    if ( a == -1  ||  b == -1 )
         return BAD_COORD;
     
+    // no street joins different components, so don't search the whole of one to find that out
+    int startComponent = m_streetMap->componentOf(start);
+    if ( startComponent != -1  &&  startComponent != m_streetMap->componentOf(end) )
+        return NO_ROUTE;
+    
     route.clear();
     
     if (start == end)
@@ -107,63 +133,124 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         totalDistanceTravelled = 0;
         return DELIVERY_SUCCESS;
     }
-        
-    set<GeoCoord> geoCoordVisited;
-    priority_queue<geoStruct, vector<geoStruct>, cmpFunction> coordQueue;
-    ExpandableHashMap<geoStruct, geoStruct> locationOfPreviousCoord;
-    
-    coordQueue.push(geoStruct(start, end, 0, ""));
-    geoCoordVisited.insert(start);
-    
-    while (coordQueue.empty() == false)
+
+    SearchScratch& s = m_scratch;
+    double endLat = endGraph->latitude(b), endLon = endGraph->longitude(b);
+    double weight = 1;
+    auto push = [&](int state, double c, double estimate, int from, int edge) {
+        if ( s.cost[state] >= 0  &&  c >= s.cost[state] )
+            return;
+        if ( s.cost[state] < 0 )
+            s.touched.push_back(state);
+        s.cost[state] = c;
+        s.previous[state] = from;
+        s.via[state] = edge;            // -1 for the step from one tile's copy of a node to its own
+        m_estimate[state] = estimate;
+        s.open.push(state, c + weight * estimate);
+    };
+
+    int endState = baseOf(endTile, *endGraph) + b;
+    push(baseOf(startTile, *startGraph) + a, 0, earthMiles(startGraph->latitude(a), startGraph->longitude(a), endLat, endLon), -1, -1);
+    endGraph.reset();
+
+    // the tile being looked at; the search mostly stays in one for a while
+    shared_ptr<const StreetGraph> g = startGraph;
+    int gTile = startTile;
+    startGraph.reset();
+
+    int reached = -1;
+    unsigned int polls = 0;
+    while ( !s.open.empty() )
     {
-        // pop the top of the stack
-        geoStruct current;
-        current.coord = coordQueue.top().coord;
-        current.end = end;
-        current.pathLengthSoFar = coordQueue.top().pathLengthSoFar;
-        current.streetName = coordQueue.top().streetName;
-        coordQueue.pop();
-        
-        // if the current coord is the end, we're done
-        if (current.coord == end)
+        // out of time: requeue what's waiting by the weighted estimate and finish from there
+        if ( weight == 1  &&  deadlinePassed(m_deadline, polls) )
         {
-            totalDistanceTravelled = current.pathLengthSoFar;
-            
-            geoStruct cc = current;
-            geoStruct backwards = *(locationOfPreviousCoord.find(cc));
-            while ( true )
+            weight = DEADLINE_ROUTE_WEIGHT;
+            s.open.clear();
+            for ( size_t i = 0 ; i < s.touched.size() ; i++ )
             {
-                route.push_front(StreetSegment(backwards.coord, cc.coord, cc.streetName));
-                cc = backwards;
-                if (locationOfPreviousCoord.find(backwards) != nullptr)
-                    backwards = *(locationOfPreviousCoord.find(backwards));
-                else
-                    break;
+                int state = s.touched[i];
+                if ( !s.closed[state] )
+                    s.open.push(state, s.cost[state] + weight * m_estimate[state]);
             }
-            return DELIVERY_SUCCESS;
         }
-            
-        // get the street segments connecting to the current coord
-        vector<StreetSegment> connectingSegments;
-        m_streetMap->getSegmentsThatStartWith(current.coord, connectingSegments);
-        for ( int i = 0 ; i < connectingSegments.size() ; i++)
+
+        int state = s.open.pop().state;
+        if ( s.closed[state] )
+            continue;
+        s.closed[state] = 1;
+        if ( state == endState )
         {
-            set<GeoCoord> :: iterator it;
-            it = geoCoordVisited.find(connectingSegments[i].end);
-            if ( it == geoCoordVisited.end() ) // the connecting coord has not been visited
-            {
-                GeoCoord nextCoord(connectingSegments[i].end);
-                double dist = current.pathLengthSoFar + distanceEarthMiles(current.coord, nextCoord);
-                geoStruct nextStruct(nextCoord, end, dist,connectingSegments[i].name);
-                
-                coordQueue.push(nextStruct);
-                locationOfPreviousCoord.associate(nextStruct, current);
-                geoCoordVisited.insert(nextCoord);
-            }
+            reached = state;
+            break;
+        }
+
+        TileSpan span = spanOf(state);
+        if ( span.tile != gTile )
+        {
+            g = m_streetMap->tileGraph(span.tile);
+            gTile = span.tile;
+            if ( !g )
+                continue;
+        }
+        int v = state - span.base;
+        double c = s.cost[state];
+
+        int home = m_streetMap->tileOf(g->latitude(v), g->longitude(v));
+        if ( home != span.tile )
+        {
+            // only some of its streets are here
+            shared_ptr<const StreetGraph> homeGraph = m_streetMap->tileGraph(home);
+            int w = homeGraph ? homeGraph->findNode(g->coord(v)) : -1;
+            if ( w != -1 )
+                push(baseOf(home, *homeGraph) + w, c, m_estimate[state], state, -1);
+            continue;
+        }
+        for ( int e = g->firstEdge(v) ; e < g->lastEdge(v) ; e++ )
+        {
+            int w = g->edgeTarget(e);
+            double wLat = g->latitude(w), wLon = g->longitude(w);
+            push(span.base + w, c + g->edgeMiles(e), earthMiles(wLat, wLon, endLat, endLon), state, e);
+            // the search will carry on from there soon, so start reading its tile now
+            int next = m_streetMap->tileOf(wLat, wLon);
+            if ( next != span.tile )
+                m_streetMap->prefetchTile(next);
         }
     }
-    return DELIVERY_SUCCESS;
+    g.reset();
+    if ( reached == -1 )
+    {
+        reset();
+        return NO_ROUTE; // ran out of streets without reaching the end
+    }
+
+    // back from the end, then forwards again turning each edge into a segment
+    vector<int> path;
+    for ( int state = reached ; s.previous[state] != -1 ; state = s.previous[state] )
+        if ( s.via[state] != -1 )
+            path.push_back(state);
+    totalDistanceTravelled = s.cost[reached];
+    GeoCoord at = start;
+    for ( size_t i = path.size() ; i-- > 0 ; )
+    {
+        TileSpan span = spanOf(s.previous[path[i]]);
+        if ( span.tile != gTile  ||  !g )
+        {
+            g = m_streetMap->tileGraph(span.tile);
+            gTile = span.tile;
+        }
+        int e = s.via[path[i]];
+        GeoCoord to = g->coord(g->edgeTarget(e));
+        route.push_back(StreetSegment(at, to, g->streetName(g->edgeName(e))));
+        at = to;
+    }
+    reset();
+    return weight == 1 ? DELIVERY_SUCCESS : DEADLINE_EXCEEDED;
+}
+
+void PointToPointRouterImpl::setDeadline(const Deadline* deadline)
+{
+    m_deadline = deadline;
 }
 
 //******************** PointToPointRouter functions ***************************
@@ -190,3 +277,7 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
     return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
 }
 
+void PointToPointRouter::setDeadline(const Deadline* deadline)
+{
+    m_impl->setDeadline(deadline);
+}
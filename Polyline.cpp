@@ -0,0 +1,461 @@
+//
+//  Polyline.cpp
+//  Goober Eats
+//
+
+#include "Polyline.h"
+#include "ExpandableHashMap.h"
+#include <functional>
+#include <cctype>
+
+using namespace std;
+
+const unsigned char ROUTE_MAGIC = 'R';
+const unsigned char PLAN_MAGIC = 'P';
+const unsigned char POLYLINE_VERSION = 2;
+
+const long long FIXED_SCALE = 10000000;     // 1e-7 degrees
+const int FIXED_DECIMALS = 7;
+
+// each segment starts with a varint whose bit 0 says whether it carries on the run before it:
+// starting where the last segment ended, on the same street, under the same command. If it does,
+// the rest is the zigzag latitude difference of its end, and only the longitude difference
+// follows. If not, the rest is a tag: bit 0 says the segment doesn't start where the last one
+// ended, the next two bits are the command index difference (3 means it follows as a varint),
+// and the rest refers to the street name
+const unsigned int CONTINUES_RUN = 1;
+const unsigned int NAME_NEW = 0;            // name text follows and gets the next number
+const unsigned int NAME_SAME = 1;           // same as the previous segment
+const unsigned int NAME_FIRST_ID = 2;       // name k is sent as k + 2
+const unsigned int COMMAND_ESCAPE = 3;
+
+unsigned int hasher(const string& s); // prototype, see StreetMap.cpp
+
+// almost every street name ends in one of these, so a new name is sent as the number of its
+// ending (0 for none) and the text before it
+const char* const STREET_SUFFIXES[] = {
+    " Drive", " Avenue", " Street", " Road", " Way", " Place", " Lane", " Boulevard",
+    " Court", " Terrace", " Circle", " Plaza"
+};
+const unsigned int STREET_SUFFIX_COUNT = sizeof(STREET_SUFFIXES) / sizeof(STREET_SUFFIXES[0]);
+
+static unsigned long long zigzag(long long v)
+{
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static long long unzigzag(unsigned long long z)
+{
+    return (long long)(z >> 1) ^ -(long long)(z & 1);
+}
+
+  // degrees text to 1e-7 degree units, without going through a double
+static long long toFixed(const string& text)
+{
+    size_t i = 0;
+    bool negative = false;
+    if ( i < text.size()  &&  (text[i] == '-' || text[i] == '+') )
+    {
+        negative = (text[i] == '-');
+        i++;
+    }
+    long long whole = 0;
+    for ( ; i < text.size()  &&  isdigit(text[i]) ; i++ )
+        whole = whole * 10 + (text[i] - '0');
+    long long fraction = 0;
+    int digits = 0;
+    if ( i < text.size()  &&  text[i] == '.' )
+    {
+        for ( i++ ; i < text.size()  &&  isdigit(text[i]) ; i++ )
+        {
+            if ( digits < FIXED_DECIMALS )
+            {
+                fraction = fraction * 10 + (text[i] - '0');
+                digits++;
+            }
+        }
+    }
+    for ( ; digits < FIXED_DECIMALS ; digits++ )
+        fraction *= 10;
+    long long value = whole * FIXED_SCALE + fraction;
+    return negative ? -value : value;
+}
+
+static string fromFixed(long long value)
+{
+    string text;
+    if ( value < 0 )
+    {
+        text += '-';
+        value = -value;
+    }
+    text += to_string(value / FIXED_SCALE);
+    text += '.';
+    string fraction = to_string(value % FIXED_SCALE);
+    text.append(FIXED_DECIMALS - fraction.size(), '0');
+    text += fraction;
+    return text;
+}
+
+class PolylineWriter
+{
+public:
+    PolylineWriter(vector<unsigned char>& out);
+    void writeVarint(unsigned long long v);
+    void writeText(const string& s);
+    void writeSegment(const StreetSegment& seg, int command);
+private:
+    void writePointDelta(long long lat, long long lon);
+    void writeName(const string& name);
+
+    vector<unsigned char>& m_out;
+    ExpandableHashMap<string, int> m_nameIds;
+    int m_lastName;
+    long long m_lat, m_lon;                 // where the last segment ended
+    int m_command;
+};
+
+PolylineWriter::PolylineWriter(vector<unsigned char>& out)
+ : m_out(out)
+{
+    m_lastName = -1;
+    m_lat = 0;
+    m_lon = 0;
+    m_command = 0;
+}
+
+void PolylineWriter::writeVarint(unsigned long long v)
+{
+    while ( v >= 0x80 )
+    {
+        m_out.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    m_out.push_back(v);
+}
+
+void PolylineWriter::writeText(const string& s)
+{
+    writeVarint(s.size());
+    m_out.insert(m_out.end(), s.begin(), s.end());
+}
+
+void PolylineWriter::writePointDelta(long long lat, long long lon)
+{
+    writeVarint(zigzag(lat - m_lat));
+    writeVarint(zigzag(lon - m_lon));
+    m_lat = lat;
+    m_lon = lon;
+}
+
+void PolylineWriter::writeName(const string& name)
+{
+    size_t stem = name.size();
+    unsigned int suffix = 0;
+    for ( unsigned int k = 0 ; k < STREET_SUFFIX_COUNT  &&  suffix == 0 ; k++ )
+    {
+        size_t length = char_traits<char>::length(STREET_SUFFIXES[k]);
+        if ( name.size() > length  &&  name.compare(name.size() - length, length, STREET_SUFFIXES[k]) == 0 )
+        {
+            stem = name.size() - length;
+            suffix = k + 1;
+        }
+    }
+    writeVarint(suffix);
+    writeVarint(stem);
+    m_out.insert(m_out.end(), name.begin(), name.begin() + stem);
+}
+
+void PolylineWriter::writeSegment(const StreetSegment& seg, int command)
+{
+    long long startLat = toFixed(seg.start.latitudeText), startLon = toFixed(seg.start.longitudeText);
+    bool jump = (startLat != m_lat || startLon != m_lon);
+
+    const int* known = m_nameIds.find(seg.name);
+    unsigned int nameRef;
+    if ( known == nullptr )
+        nameRef = NAME_NEW;
+    else if ( *known == m_lastName )
+        nameRef = NAME_SAME;
+    else
+        nameRef = *known + NAME_FIRST_ID;
+
+    unsigned int commandDelta = command - m_command;
+    unsigned int commandCode = commandDelta < COMMAND_ESCAPE ? commandDelta : COMMAND_ESCAPE;
+
+    long long endLat = toFixed(seg.end.latitudeText), endLon = toFixed(seg.end.longitudeText);
+    if ( !jump  &&  nameRef == NAME_SAME  &&  commandDelta == 0 )
+    {
+        writeVarint((zigzag(endLat - m_lat) << 1) | CONTINUES_RUN);
+        writeVarint(zigzag(endLon - m_lon));
+        m_lat = endLat;
+        m_lon = endLon;
+        return;
+    }
+
+    unsigned int tag = ((nameRef * 4 + commandCode) << 1) | (jump ? 1 : 0);
+    writeVarint(tag << 1);
+    if ( jump )
+        writePointDelta(startLat, startLon);
+    if ( nameRef == NAME_NEW )
+    {
+        int id = m_nameIds.size();
+        m_nameIds.associate(seg.name, id);
+        writeName(seg.name);
+        m_lastName = id;
+    }
+    else if ( nameRef != NAME_SAME )
+        m_lastName = *known;
+    if ( commandCode == COMMAND_ESCAPE )
+        writeVarint(commandDelta - COMMAND_ESCAPE);
+    writePointDelta(endLat, endLon);
+    m_command = command;
+}
+
+class PolylineReader
+{
+public:
+    PolylineReader(const vector<unsigned char>& data);
+    bool readByte(unsigned char& b);
+    bool readVarint(unsigned long long& v);
+    bool readCount(int& n);
+    bool readText(string& s);
+    bool readSegment(StreetSegment& seg, int& command);
+private:
+    bool readPointDelta(long long& lat, long long& lon);
+    bool readName(string& name);
+
+    const vector<unsigned char>& m_data;
+    size_t m_pos;
+    vector<string> m_names;
+    int m_lastName;
+    long long m_lat, m_lon;
+    int m_command;
+};
+
+PolylineReader::PolylineReader(const vector<unsigned char>& data)
+ : m_data(data)
+{
+    m_pos = 0;
+    m_lastName = -1;
+    m_lat = 0;
+    m_lon = 0;
+    m_command = 0;
+}
+
+bool PolylineReader::readByte(unsigned char& b)
+{
+    if ( m_pos >= m_data.size() )
+        return false;
+    b = m_data[m_pos++];
+    return true;
+}
+
+bool PolylineReader::readVarint(unsigned long long& v)
+{
+    v = 0;
+    for ( int shift = 0 ; shift < 64 ; shift += 7 )
+    {
+        unsigned char b;
+        if ( !readByte(b) )
+            return false;
+        v |= (unsigned long long)(b & 0x7f) << shift;
+        if ( (b & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+
+bool PolylineReader::readCount(int& n)
+{
+    unsigned long long v;
+    if ( !readVarint(v)  ||  v > m_data.size() ) // every counted thing takes at least a byte
+        return false;
+    n = v;
+    return true;
+}
+
+bool PolylineReader::readText(string& s)
+{
+    int length;
+    if ( !readCount(length)  ||  m_pos + length > m_data.size() )
+        return false;
+    s.assign(m_data.begin() + m_pos, m_data.begin() + m_pos + length);
+    m_pos += length;
+    return true;
+}
+
+bool PolylineReader::readPointDelta(long long& lat, long long& lon)
+{
+    unsigned long long zLat, zLon;
+    if ( !readVarint(zLat)  ||  !readVarint(zLon) )
+        return false;
+    m_lat += unzigzag(zLat);
+    m_lon += unzigzag(zLon);
+    lat = m_lat;
+    lon = m_lon;
+    return true;
+}
+
+bool PolylineReader::readName(string& name)
+{
+    unsigned long long suffix;
+    if ( !readVarint(suffix)  ||  suffix > STREET_SUFFIX_COUNT  ||  !readText(name) )
+        return false;
+    if ( suffix > 0 )
+        name += STREET_SUFFIXES[suffix - 1];
+    return true;
+}
+
+bool PolylineReader::readSegment(StreetSegment& seg, int& command)
+{
+    unsigned long long head;
+    if ( !readVarint(head) )
+        return false;
+    if ( head & CONTINUES_RUN )
+    {
+        unsigned long long zLon;
+        if ( m_lastName < 0  ||  !readVarint(zLon) )
+            return false;
+        seg.start = GeoCoord(fromFixed(m_lat), fromFixed(m_lon));
+        m_lat += unzigzag(head >> 1);
+        m_lon += unzigzag(zLon);
+        seg.end = GeoCoord(fromFixed(m_lat), fromFixed(m_lon));
+        seg.name = m_names[m_lastName];
+        command = m_command;
+        return true;
+    }
+    unsigned long long tag = head >> 1;
+    bool jump = tag & 1;
+    unsigned long long commandCode = (tag >> 1) & 3;
+    unsigned long long nameRef = tag >> 3;
+
+    long long lat = m_lat, lon = m_lon;
+    if ( jump  &&  !readPointDelta(lat, lon) )
+        return false;
+    seg.start = GeoCoord(fromFixed(lat), fromFixed(lon));
+
+    if ( nameRef == NAME_NEW )
+    {
+        string name;
+        if ( !readName(name) )
+            return false;
+        m_names.push_back(name);
+        m_lastName = m_names.size() - 1;
+    }
+    else if ( nameRef != NAME_SAME )
+    {
+        if ( nameRef - NAME_FIRST_ID >= m_names.size() )
+            return false;
+        m_lastName = nameRef - NAME_FIRST_ID;
+    }
+    if ( m_lastName < 0 )
+        return false;
+    seg.name = m_names[m_lastName];
+
+    unsigned long long commandDelta = commandCode;
+    if ( commandCode == COMMAND_ESCAPE )
+    {
+        if ( !readVarint(commandDelta) )
+            return false;
+        commandDelta += COMMAND_ESCAPE;
+    }
+    m_command += commandDelta;
+    command = m_command;
+
+    if ( !readPointDelta(lat, lon) )
+        return false;
+    seg.end = GeoCoord(fromFixed(lat), fromFixed(lon));
+    return true;
+}
+
+void encodeRoute(const list<StreetSegment>& route, vector<unsigned char>& out)
+{
+    out.clear();
+    out.push_back(ROUTE_MAGIC);
+    out.push_back(POLYLINE_VERSION);
+    PolylineWriter writer(out);
+    writer.writeVarint(route.size());
+    for ( list<StreetSegment>::const_iterator it = route.begin() ; it != route.end() ; it++ )
+        writer.writeSegment(*it, 0);
+}
+
+bool decodeRoute(const vector<unsigned char>& data, list<StreetSegment>& route)
+{
+    route.clear();
+    PolylineReader reader(data);
+    unsigned char magic, version;
+    if ( !reader.readByte(magic)  ||  !reader.readByte(version)  ||  magic != ROUTE_MAGIC  ||  version != POLYLINE_VERSION )
+        return false;
+    int count;
+    if ( !reader.readCount(count) )
+        return false;
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        StreetSegment seg;
+        int command;
+        if ( !reader.readSegment(seg, command) )
+            return false;
+        route.push_back(seg);
+    }
+    return true;
+}
+
+void encodePlan(const DeliveryPlan& plan, vector<unsigned char>& out)
+{
+    out.clear();
+    out.push_back(PLAN_MAGIC);
+    out.push_back(POLYLINE_VERSION);
+    PolylineWriter writer(out);
+    writer.writeVarint(plan.legCount());
+    for ( int leg = 0 ; leg < plan.legCount() ; leg++ )
+    {
+        if ( leg < int(plan.deliveries().size()) )
+            writer.writeText(plan.deliveries()[leg].item);
+        else
+            writer.writeText("");
+
+        const list<StreetSegment>& route = plan.legRoute(leg);
+        const vector<int>& commands = plan.legSegmentCommands(leg);
+        int first = plan.legFirstCommand(leg);
+        writer.writeVarint(route.size());
+        int i = 0;
+        for ( list<StreetSegment>::const_iterator it = route.begin() ; it != route.end() ; it++, i++ )
+            writer.writeSegment(*it, first + commands[i]);
+    }
+}
+
+bool decodePlan(const vector<unsigned char>& data, DecodedPlan& plan)
+{
+    plan.legs.clear();
+    plan.segmentCommands.clear();
+    plan.items.clear();
+    PolylineReader reader(data);
+    unsigned char magic, version;
+    if ( !reader.readByte(magic)  ||  !reader.readByte(version)  ||  magic != PLAN_MAGIC  ||  version != POLYLINE_VERSION )
+        return false;
+    int legs;
+    if ( !reader.readCount(legs) )
+        return false;
+    plan.legs.resize(legs);
+    plan.segmentCommands.resize(legs);
+    for ( int leg = 0 ; leg < legs ; leg++ )
+    {
+        string item;
+        int count;
+        if ( !reader.readText(item)  ||  !reader.readCount(count) )
+            return false;
+        if ( leg < legs - 1 )
+            plan.items.push_back(item);
+        for ( int i = 0 ; i < count ; i++ )
+        {
+            StreetSegment seg;
+            int command;
+            if ( !reader.readSegment(seg, command) )
+                return false;
+            plan.legs[leg].push_back(seg);
+            plan.segmentCommands[leg].push_back(command);
+        }
+    }
+    return true;
+}
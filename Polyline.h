@@ -0,0 +1,39 @@
+
+#ifndef POLYLINE_INCLUDED
+#define POLYLINE_INCLUDED
+
+#include "provided.h"
+#include <list>
+#include <string>
+#include <vector>
+
+// Polyline.h
+
+// Compact wire format for routes and whole plans, for sending to the driver app.
+//
+// Coordinates are sent as 1e-7 degree integers (the precision of mapdata.txt), each point
+// as the zigzag varint difference from the one before. Street names are sent once, the first
+// time they are used, as their text less a common ending like " Avenue", which goes as a
+// number; after that they're referred to by number. In a plan each segment also carries the
+// index of the DeliveryCommand it belongs to, as a difference from the previous segment's.
+// Most segments carry straight on from the one before, on the same street and command, and
+// those are sent as nothing but their end point. The encoder writes straight into the output
+// buffer in one pass over the route.
+//
+// Decoded coordinates are printed back with seven decimals, which reproduces the text of any
+// coordinate that was written that way (all of mapdata.txt is).
+
+struct DecodedPlan
+{
+    std::vector<std::list<StreetSegment>> legs;
+    std::vector<std::vector<int>> segmentCommands;   // command index of each segment, per leg
+    std::vector<std::string> items;                  // delivered at the end of each leg but the last
+};
+
+void encodeRoute(const std::list<StreetSegment>& route, std::vector<unsigned char>& out);
+bool decodeRoute(const std::vector<unsigned char>& data, std::list<StreetSegment>& route);
+
+void encodePlan(const DeliveryPlan& plan, std::vector<unsigned char>& out);
+bool decodePlan(const std::vector<unsigned char>& data, DecodedPlan& plan);
+
+#endif // POLYLINE_INCLUDED
@@ -0,0 +1,55 @@
+
+#ifndef REGIONAL_MAP_INCLUDED
+#define REGIONAL_MAP_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <list>
+
+// RegionalMap.h
+
+// Sharded maps for regions too big to hold in one StreetMap.
+//
+// partitionMap() splits a map file offline into cells of roughly cellNodes intersections by
+// recursive bisection, picking each cut near the middle along whichever axis severs the fewest
+// streets. It writes, into outDir:
+//   index.txt        the bisection tree, so a coordinate's cell is found without loading anything
+//   cell_<k>.txt     the streets that lie inside cell k, in mapdata.txt format
+//   overlay.txt      the streets that cross from one cell to another, in mapdata.txt format
+//   shortcuts.txt    for each cell, the shortest distance inside it between every pair of its
+//                    boundary intersections (ends of crossing streets)
+//
+// A RegionalRouter loads the index, the crossing streets and the shortcuts, and at query time
+// only the cells holding the two ends of the route. The search runs on real streets inside those
+// two cells and on shortcuts everywhere else; each shortcut on the final path is expanded by
+// loading its cell just long enough to route across it.
+
+bool partitionMap(std::string mapFile, std::string outDir, int cellNodes);
+
+class RegionalRouterImpl;
+
+class RegionalRouter
+{
+public:
+    RegionalRouter(int maxResidentCells = 4);
+    ~RegionalRouter();
+    bool load(std::string partitionDir);
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled) const;
+    int cellCount() const;
+    int residentCellCount() const;
+      // street graph bytes of the cells loaded right now, and of what stays loaded throughout:
+      // the crossing streets and the shortcuts
+    size_t residentCellBytes() const;
+    size_t overlayBytes() const;
+      // We prevent a RegionalRouter object from being copied or assigned.
+    RegionalRouter(const RegionalRouter&) = delete;
+    RegionalRouter& operator=(const RegionalRouter&) = delete;
+private:
+    RegionalRouterImpl* m_impl;
+};
+
+#endif // REGIONAL_MAP_INCLUDED
@@ -0,0 +1,398 @@
+//
+//  RegionalRouter.cpp
+//  Goober Eats
+//
+
+#include "RegionalMap.h"
+#include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <list>
+#include <queue>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+unsigned int hasher(const GeoCoord& g); // prototype, see StreetMap.cpp
+
+struct CellSplit
+{
+    int axis;           // 0 latitude, 1 longitude, -1 for a cell
+    double value;       // coordinates below value go left
+    int left, right;
+    int cell;
+};
+
+struct Shortcut
+{
+    GeoCoord to;
+    double miles;
+    int cell;
+};
+
+  // how the search reached a coordinate
+struct RegionalLabel
+{
+    double miles;
+    GeoCoord previous;
+    string streetName;
+    int viaCell;        // -1 for a real street, otherwise the cell a shortcut crossed
+    bool settled;
+};
+
+struct RegionalEntry
+{
+    double estimate;
+    double miles;
+    GeoCoord coord;
+};
+
+bool operator>(const RegionalEntry& lhs, const RegionalEntry& rhs)
+{
+    return lhs.estimate > rhs.estimate;
+}
+
+class RegionalRouterImpl
+{
+public:
+    RegionalRouterImpl(int maxResidentCells);
+    ~RegionalRouterImpl();
+    bool load(string partitionDir);
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const;
+    int cellCount() const;
+    int residentCellCount() const;
+    size_t residentCellBytes() const;
+    size_t overlayBytes() const;
+private:
+    int readSplit(istream& in);
+    int cellOf(const GeoCoord& g) const;
+    shared_ptr<const StreetMap> cell(int c) const;
+    bool exists(const GeoCoord& g, const StreetMap& cellMap) const;
+
+    string m_dir;
+    vector<CellSplit> m_splits;
+    int m_cellCount;
+    StreetMap m_crossing;                                   // streets between cells
+    ExpandableHashMap<GeoCoord, vector<Shortcut>> m_shortcuts;
+    int m_shortcutCount;
+    int m_shortcutStarts;
+
+    // most recently used first
+    int m_maxResident;
+    mutable list<pair<int, shared_ptr<const StreetMap>>> m_resident;
+    mutable mutex m_residentLock;
+};
+
+RegionalRouterImpl::RegionalRouterImpl(int maxResidentCells)
+{
+    m_maxResident = maxResidentCells < 2 ? 2 : maxResidentCells; // a query needs its two end cells at once
+    m_cellCount = 0;
+    m_shortcutCount = 0;
+    m_shortcutStarts = 0;
+}
+
+RegionalRouterImpl::~RegionalRouterImpl()
+{
+}
+
+int RegionalRouterImpl::readSplit(istream& in)
+{
+    string kind;
+    if ( !(in >> kind) )
+        return -1;
+    int self = m_splits.size();
+    m_splits.push_back(CellSplit());
+    if ( kind == "C" )
+    {
+        m_splits[self].axis = -1;
+        if ( !(in >> m_splits[self].cell) )
+            return -1;
+        return self;
+    }
+    if ( !(in >> m_splits[self].axis >> m_splits[self].value) )
+        return -1;
+    int left = readSplit(in);
+    int right = readSplit(in);
+    if ( left < 0  ||  right < 0 )
+        return -1;
+    m_splits[self].left = left;
+    m_splits[self].right = right;
+    return self;
+}
+
+bool RegionalRouterImpl::load(string partitionDir)
+{
+    m_dir = partitionDir;
+    m_splits.clear();
+    m_shortcuts.reset();
+    m_shortcutCount = 0;
+    m_shortcutStarts = 0;
+    m_resident.clear();
+
+    ifstream index(partitionDir + "/index.txt");
+    string word;
+    if ( !index  ||  !(index >> word >> m_cellCount)  ||  word != "cells" )
+        return false;
+    if ( readSplit(index) != 0 )
+        return false;
+
+    if ( !m_crossing.load(partitionDir + "/overlay.txt") )
+        return false;
+
+    ifstream shortcuts(partitionDir + "/shortcuts.txt");
+    if ( !shortcuts )
+        return false;
+    string line;
+    while ( getline(shortcuts, line) )
+    {
+        istringstream iss(line);
+        int c;
+        string fLat, fLon, tLat, tLon;
+        double miles;
+        if ( !(iss >> c >> fLat >> fLon >> tLat >> tLon >> miles) )
+            continue;
+        GeoCoord from(fLat, fLon);
+        Shortcut sc = { GeoCoord(tLat, tLon), miles, c };
+        vector<Shortcut>* existing = m_shortcuts.find(from);
+        if ( existing != nullptr )
+            existing->push_back(sc);
+        else
+        {
+            m_shortcuts.associate(from, vector<Shortcut>(1, sc));
+            m_shortcutStarts++;
+        }
+        m_shortcutCount++;
+    }
+    return true;
+}
+
+int RegionalRouterImpl::cellOf(const GeoCoord& g) const
+{
+    int i = 0;
+    while ( m_splits[i].axis != -1 )
+    {
+        double v = m_splits[i].axis == 0 ? g.latitude : g.longitude;
+        i = v < m_splits[i].value ? m_splits[i].left : m_splits[i].right;
+    }
+    return m_splits[i].cell;
+}
+
+  // loads the cell if it isn't resident, evicting the least recently used one past the limit
+shared_ptr<const StreetMap> RegionalRouterImpl::cell(int c) const
+{
+    lock_guard<mutex> guard(m_residentLock);
+    for ( list<pair<int, shared_ptr<const StreetMap>>>::iterator it = m_resident.begin() ; it != m_resident.end() ; it++ )
+    {
+        if ( it->first == c )
+        {
+            m_resident.splice(m_resident.begin(), m_resident, it);
+            return m_resident.front().second;
+        }
+    }
+    shared_ptr<StreetMap> loaded(new StreetMap);
+    if ( !loaded->load(m_dir + "/cell_" + to_string(c) + ".txt") )
+        return nullptr;
+    m_resident.push_front(make_pair(c, shared_ptr<const StreetMap>(loaded)));
+    while ( int(m_resident.size()) > m_maxResident )
+        m_resident.pop_back();
+    return m_resident.front().second;
+}
+
+  // a coordinate is on the map if a street inside its cell or a crossing street starts there
+bool RegionalRouterImpl::exists(const GeoCoord& g, const StreetMap& cellMap) const
+{
+    vector<StreetSegment> dummy;
+    return cellMap.getSegmentsThatStartWith(g, dummy)  ||  m_crossing.getSegmentsThatStartWith(g, dummy);
+}
+
+DeliveryResult RegionalRouterImpl::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+{
+    if ( m_splits.empty() )
+        return BAD_COORD;
+
+    int startCell = cellOf(start), endCell = cellOf(end);
+    shared_ptr<const StreetMap> startMap = cell(startCell);
+    shared_ptr<const StreetMap> endMap = cell(endCell);
+    if ( !startMap  ||  !endMap  ||  !exists(start, *startMap)  ||  !exists(end, *endMap) )
+        return BAD_COORD;
+
+    route.clear();
+    totalDistanceTravelled = 0;
+    if ( start == end )
+        return DELIVERY_SUCCESS;
+
+    // A* over real streets in the two end cells, crossing streets, and shortcuts through every other cell
+    ExpandableHashMap<GeoCoord, RegionalLabel> labels;
+    priority_queue<RegionalEntry, vector<RegionalEntry>, greater<RegionalEntry>> open;
+    RegionalLabel first = { 0, start, "", -1, false };
+    labels.associate(start, first);
+    open.push(RegionalEntry{ distanceEarthMiles(start, end), 0, start });
+
+    vector<StreetSegment> segs;
+    bool found = false;
+    while ( !open.empty() )
+    {
+        RegionalEntry current = open.top();
+        open.pop();
+        RegionalLabel* label = labels.find(current.coord);
+        if ( label->settled  ||  current.miles > label->miles )
+            continue;
+        label->settled = true;
+        if ( current.coord == end )
+        {
+            found = true;
+            break;
+        }
+
+        auto relax = [&](const GeoCoord& to, double miles, const string& name, int viaCell) {
+            RegionalLabel* existing = labels.find(to);
+            if ( existing != nullptr  &&  (existing->settled  ||  existing->miles <= miles) )
+                return;
+            RegionalLabel next = { miles, current.coord, name, viaCell, false };
+            labels.associate(to, next);
+            open.push(RegionalEntry{ miles + distanceEarthMiles(to, end), miles, to });
+        };
+
+        int c = cellOf(current.coord);
+        if ( c == startCell  ||  c == endCell )
+        {
+            const StreetMap& cellMap = (c == startCell) ? *startMap : *endMap;
+            if ( cellMap.getSegmentsThatStartWith(current.coord, segs) )
+            {
+                for ( size_t i = 0 ; i < segs.size() ; i++ )
+                    relax(segs[i].end, current.miles + distanceEarthMiles(segs[i].start, segs[i].end), segs[i].name, -1);
+            }
+        }
+        else
+        {
+            const vector<Shortcut>* shortcuts = m_shortcuts.find(current.coord);
+            if ( shortcuts != nullptr )
+            {
+                for ( size_t i = 0 ; i < shortcuts->size() ; i++ )
+                    relax((*shortcuts)[i].to, current.miles + (*shortcuts)[i].miles, "", (*shortcuts)[i].cell);
+            }
+        }
+        if ( m_crossing.getSegmentsThatStartWith(current.coord, segs) )
+        {
+            for ( size_t i = 0 ; i < segs.size() ; i++ )
+                relax(segs[i].end, current.miles + distanceEarthMiles(segs[i].start, segs[i].end), segs[i].name, -1);
+        }
+    }
+    if ( !found )
+        return NO_ROUTE;
+
+    // walk back from the end, expanding shortcuts by routing across their cells
+    GeoCoord at = end;
+    while ( at != start )
+    {
+        const RegionalLabel* label = labels.find(at);
+        if ( label->viaCell == -1 )
+        {
+            route.push_front(StreetSegment(label->previous, at, label->streetName));
+            totalDistanceTravelled += distanceEarthMiles(label->previous, at);
+        }
+        else
+        {
+            shared_ptr<const StreetMap> crossed = cell(label->viaCell);
+            if ( !crossed )
+                return NO_ROUTE;
+            PointToPointRouter router(crossed.get());
+            list<StreetSegment> inside;
+            double miles;
+            if ( router.generatePointToPointRoute(label->previous, at, inside, miles) != DELIVERY_SUCCESS )
+                return NO_ROUTE;
+            route.splice(route.begin(), inside);
+            totalDistanceTravelled += miles;
+        }
+        at = label->previous;
+    }
+    return DELIVERY_SUCCESS;
+}
+
+int RegionalRouterImpl::cellCount() const
+{
+    return m_cellCount;
+}
+
+int RegionalRouterImpl::residentCellCount() const
+{
+    lock_guard<mutex> guard(m_residentLock);
+    return m_resident.size();
+}
+
+size_t RegionalRouterImpl::residentCellBytes() const
+{
+    lock_guard<mutex> guard(m_residentLock);
+    size_t bytes = 0;
+    for ( list<pair<int, shared_ptr<const StreetMap>>>::const_iterator it = m_resident.begin() ; it != m_resident.end() ; it++ )
+        bytes += it->second->graph()->memoryBytes();
+    return bytes;
+}
+
+size_t RegionalRouterImpl::overlayBytes() const
+{
+    // each shortcut start is a table entry holding a vector
+    size_t shortcutBytes = m_shortcutCount * sizeof(Shortcut)
+                         + m_shortcutStarts * (sizeof(GeoCoord) + sizeof(vector<Shortcut>) + 2 * sizeof(void*));
+    const StreetGraph* crossing = m_crossing.graph();
+    return shortcutBytes + (crossing != nullptr ? crossing->memoryBytes() : 0);
+}
+
+//******************** RegionalRouter functions *******************************
+
+// These functions simply delegate to RegionalRouterImpl's functions.
+
+RegionalRouter::RegionalRouter(int maxResidentCells)
+{
+    m_impl = new RegionalRouterImpl(maxResidentCells);
+}
+
+RegionalRouter::~RegionalRouter()
+{
+    delete m_impl;
+}
+
+bool RegionalRouter::load(string partitionDir)
+{
+    return m_impl->load(partitionDir);
+}
+
+DeliveryResult RegionalRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+}
+
+int RegionalRouter::cellCount() const
+{
+    return m_impl->cellCount();
+}
+
+int RegionalRouter::residentCellCount() const
+{
+    return m_impl->residentCellCount();
+}
+
+size_t RegionalRouter::residentCellBytes() const
+{
+    return m_impl->residentCellBytes();
+}
+
+size_t RegionalRouter::overlayBytes() const
+{
+    return m_impl->overlayBytes();
+}
@@ -0,0 +1,253 @@
+
+#ifndef ROUTING_POLICIES_INCLUDED
+#define ROUTING_POLICIES_INCLUDED
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include "OpenSet.h"
+#include "Deadline.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// RoutingPolicies.h
+
+// The A* search behind StreetRouter, written once as a template over what an edge costs and how
+// the remaining cost is estimated, so each combination is compiled with its own inner loop.
+//
+// A cost policy has
+//   static const bool TURN_AWARE;
+//   double edge(const StreetGraph& g, int e) const;              cost of driving edge e
+//   double turn(const StreetGraph& g, int in, int out) const;    extra cost of going from in to out
+// A policy that isn't TURN_AWARE is searched over intersections and turn() is never called.
+// One that is gets searched over edges, since arriving at a corner from different streets
+// costs different amounts to leave.
+//
+// A heuristic policy has
+//   double estimate(const StreetGraph& g, int node, int target) const;
+// which must never be more than the real cost from node to target, or routes stop being the
+// cheapest.
+
+  // distanceEarthMiles, for coordinates already unpacked into doubles
+inline double earthMiles(double lat1, double lon1, double lat2, double lon2)
+{
+    static const double earthRadiusKm = 6371.0;
+    const double milesPerKm = 1 / 1.609344;
+    double lat1r = deg2rad(lat1);
+    double lon1r = deg2rad(lon1);
+    double lat2r = deg2rad(lat2);
+    double lon2r = deg2rad(lon2);
+    double u = std::sin((lat2r - lat1r) / 2);
+    double v = std::sin((lon2r - lon1r) / 2);
+    return 2.0 * earthRadiusKm * std::asin(std::sqrt(u * u + std::cos(lat1r) * std::cos(lat2r) * v * v)) * milesPerKm;
+}
+
+// street classes, guessed from the last word of the name; mapdata.txt has nothing better
+enum StreetClass
+{
+    FREEWAY, ARTERIAL, COLLECTOR, LOCAL_STREET, FOOTPATH, STREET_CLASS_COUNT
+};
+
+StreetClass classifyStreet(const std::string& name);
+
+  // typical driving speed of each class
+const double CLASS_SPEED_MPH[STREET_CLASS_COUNT] = { 55, 35, 25, 20, 3 };
+
+// TurnPenaltyCost charges these, in miles, for a bend of more than TURN_DEGREES
+const double TURN_DEGREES = 30;
+const double U_TURN_DEGREES = 150;
+const double RIGHT_TURN_MILES = 0.02;
+const double LEFT_TURN_MILES = 0.05;
+const double U_TURN_MILES = 0.25;
+
+// AvoidHighwayCost makes freeway miles count this many times over
+const double HIGHWAY_AVOIDANCE_FACTOR = 10;
+
+struct DistanceCost
+{
+    static const bool TURN_AWARE = false;
+    double edge(const StreetGraph& g, int e) const { return g.edgeMiles(e); }
+    double turn(const StreetGraph&, int, int) const { return 0; }
+};
+
+  // minutes, at the class speed of each street
+struct TravelTimeCost
+{
+    static const bool TURN_AWARE = false;
+    const double* minutesPerMile;           // per street name
+    double edge(const StreetGraph& g, int e) const { return g.edgeMiles(e) * minutesPerMile[g.edgeName(e)]; }
+    double turn(const StreetGraph&, int, int) const { return 0; }
+};
+
+struct TurnPenaltyCost
+{
+    static const bool TURN_AWARE = true;
+    const int* edgeSource;                  // start node of each edge
+    double edge(const StreetGraph& g, int e) const { return g.edgeMiles(e); }
+    double turn(const StreetGraph& g, int in, int out) const
+    {
+        // the same angle DeliveryPlanner measures between two segments, 0 to 360 counterclockwise
+        int a = edgeSource[in], b = g.edgeTarget(in), c = g.edgeTarget(out);
+        double angle1 = std::atan2(g.latitude(b) - g.latitude(a), g.longitude(b) - g.longitude(a));
+        double angle2 = std::atan2(g.latitude(c) - g.latitude(b), g.longitude(c) - g.longitude(b));
+        double angle = rad2deg(angle2 - angle1);
+        if ( angle < 0 )
+            angle += 360;
+        double bend = angle < 180 ? angle : 360 - angle;
+        if ( bend <= TURN_DEGREES )
+            return 0;
+        if ( bend > U_TURN_DEGREES )
+            return U_TURN_MILES;
+        return angle < 180 ? LEFT_TURN_MILES : RIGHT_TURN_MILES;
+    }
+};
+
+struct AvoidHighwayCost
+{
+    static const bool TURN_AWARE = false;
+    const double* factor;                   // per street name
+    double edge(const StreetGraph& g, int e) const { return g.edgeMiles(e) * factor[g.edgeName(e)]; }
+    double turn(const StreetGraph&, int, int) const { return 0; }
+};
+
+  // straight-line miles times a scale no bigger than the cheapest cost per mile on any street
+struct CrowFliesHeuristic
+{
+    double scale;
+    double estimate(const StreetGraph& g, int node, int target) const
+    {
+        return scale * earthMiles(g.latitude(node), g.longitude(node), g.latitude(target), g.longitude(target));
+    }
+};
+
+  // arrays for one search at a time, cleared through touched afterwards; OpenSet is one of the
+  // queues in OpenSet.h
+template<typename OpenSet>
+struct SearchArrays
+{
+    std::vector<double> cost;       // -1 where the search hasn't been
+    std::vector<int> previous;      // state the best way in came from
+    std::vector<int> via;           // edge taken into each state
+    std::vector<char> closed;
+    std::vector<int> touched;
+    OpenSet open;
+
+    void prepare(int states)
+    {
+        if ( int(cost.size()) != states )
+        {
+            cost.assign(states, -1);
+            previous.assign(states, -1);
+            via.assign(states, -1);
+            closed.assign(states, 0);
+        }
+        open.prepare(states);
+    }
+
+      // as OpenSet::grow; states already touched keep what they have
+    void grow(int states)
+    {
+        if ( int(cost.size()) < states )
+        {
+            cost.resize(states, -1);
+            previous.resize(states, -1);
+            via.resize(states, -1);
+            closed.resize(states, 0);
+        }
+        open.grow(states);
+    }
+
+    void reset()
+    {
+        for ( size_t i = 0 ; i < touched.size() ; i++ )
+        {
+            cost[touched[i]] = -1;
+            closed[touched[i]] = 0;
+        }
+        touched.clear();
+        open.clear();
+    }
+};
+
+typedef SearchArrays<QuaternaryHeap> SearchScratch;
+typedef SearchArrays<RadixHeap> RadixSearchScratch;
+
+// A* from start to end. A state is an intersection, or for a TURN_AWARE cost the edge that was
+// just driven (at its end node). Leaves the edges of the cheapest route in edges, first to last,
+// and returns DELIVERY_SUCCESS, or NO_ROUTE if end can't be reached. Once deadline passes, the
+// states waiting are requeued with the estimate counted DEADLINE_ROUTE_WEIGHT times over and the
+// search finishes from there, returning DEADLINE_EXCEEDED with the route it found.
+template<typename Cost, typename Heuristic, typename OpenSet>
+DeliveryResult searchStreetGraph(const StreetGraph& g, int start, int end, const Cost& cost, const Heuristic& heuristic,
+                                 SearchArrays<OpenSet>& s, std::vector<int>& edges, const Deadline* deadline = nullptr)
+{
+    s.prepare(Cost::TURN_AWARE ? g.edgeCount() : g.nodeCount());
+    edges.clear();
+
+    double weight = 1;
+    auto push = [&](int state, int node, double c, int from, int edge) {
+        if ( s.cost[state] >= 0  &&  c >= s.cost[state] )
+            return;
+        if ( s.cost[state] < 0 )
+            s.touched.push_back(state);
+        s.cost[state] = c;
+        s.previous[state] = from;
+        s.via[state] = edge;
+        s.open.push(state, c + weight * heuristic.estimate(g, node, end));
+    };
+
+    if ( Cost::TURN_AWARE )
+    {
+        for ( int e = g.firstEdge(start) ; e < g.lastEdge(start) ; e++ )
+            push(e, g.edgeTarget(e), cost.edge(g, e), -1, e);
+    }
+    else
+        push(start, start, 0, -1, -1);
+
+    int reached = -1;
+    unsigned int polls = 0;
+    while ( !s.open.empty() )
+    {
+        if ( weight == 1  &&  deadlinePassed(deadline, polls) )
+        {
+            weight = DEADLINE_ROUTE_WEIGHT;
+            s.open.clear();
+            for ( size_t i = 0 ; i < s.touched.size() ; i++ )
+            {
+                int state = s.touched[i];
+                int node = Cost::TURN_AWARE ? g.edgeTarget(state) : state;
+                if ( !s.closed[state] )
+                    s.open.push(state, s.cost[state] + weight * heuristic.estimate(g, node, end));
+            }
+        }
+        int state = s.open.pop().state;
+        if ( s.closed[state] )
+            continue;
+        s.closed[state] = 1;
+        double reachedCost = s.cost[state];
+        int node = Cost::TURN_AWARE ? g.edgeTarget(state) : state;
+        if ( node == end )
+        {
+            reached = state;
+            break;
+        }
+        for ( int e = g.firstEdge(node) ; e < g.lastEdge(node) ; e++ )
+        {
+            double c = reachedCost + cost.edge(g, e);
+            if ( Cost::TURN_AWARE )
+                push(e, g.edgeTarget(e), c + cost.turn(g, state, e), state, e);
+            else
+                push(g.edgeTarget(e), g.edgeTarget(e), c, state, e);
+        }
+    }
+
+    for ( int state = reached ; state != -1  &&  s.via[state] != -1 ; state = s.previous[state] )
+        edges.push_back(s.via[state]);
+    std::reverse(edges.begin(), edges.end());
+    s.reset();
+    if ( reached == -1 )
+        return NO_ROUTE;
+    return weight == 1 ? DELIVERY_SUCCESS : DEADLINE_EXCEEDED;
+}
+
+#endif // ROUTING_POLICIES_INCLUDED
@@ -0,0 +1,192 @@
+//
+//  ServiceArea.cpp
+//  Goober Eats
+//
+
+#include "ServiceArea.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+class ServiceAreaImpl
+{
+public:
+    ServiceAreaImpl(const StreetMap* sm);
+    ~ServiceAreaImpl();
+    DeliveryResult reachableWithin(const GeoCoord& origin, double maxMiles,
+                                   vector<GeoCoord>& reached, vector<double>& miles) const;
+    DeliveryResult checkAddresses(const GeoCoord& origin, double maxMiles,
+                                  const vector<GeoCoord>& addresses, vector<bool>& within) const;
+private:
+    typedef pair<double, int> Entry;
+
+    int search(int origin, double maxMiles, int targets) const;
+    void resetScratch() const;
+
+    const StreetMap* m_streetMap;
+
+    // scratch kept between searches; m_dist is -1 for nodes the current search hasn't reached
+    mutable vector<double> m_dist;
+    mutable vector<char> m_target;
+    mutable vector<int> m_touched;
+    mutable vector<int> m_settled;
+    mutable vector<Entry> m_heap;
+};
+
+ServiceAreaImpl::ServiceAreaImpl(const StreetMap* sm)
+{
+    m_streetMap = sm;
+}
+
+ServiceAreaImpl::~ServiceAreaImpl()
+{
+}
+
+void ServiceAreaImpl::resetScratch() const
+{
+    for ( size_t i = 0 ; i < m_touched.size() ; i++ )
+    {
+        m_dist[m_touched[i]] = -1;
+        m_target[m_touched[i]] = 0;
+    }
+    m_touched.clear();
+    m_settled.clear();
+    m_heap.clear();
+}
+
+// Dijkstra from origin that never queues a node beyond maxMiles. With targets > 0 it also stops
+// once that many nodes marked in m_target have been settled. Settled nodes are left in
+// m_settled, nearest first; returns how many targets were settled.
+int ServiceAreaImpl::search(int origin, double maxMiles, int targets) const
+{
+    const StreetGraph& g = *m_streetMap->graph();
+    if ( int(m_dist.size()) != g.nodeCount() )
+    {
+        m_dist.assign(g.nodeCount(), -1);
+        m_target.assign(g.nodeCount(), 0);
+    }
+
+    int found = 0;
+    m_dist[origin] = 0;
+    m_touched.push_back(origin);
+    m_heap.push_back(Entry(0, origin));
+    while ( !m_heap.empty() )
+    {
+        pop_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+        Entry top = m_heap.back();
+        m_heap.pop_back();
+        int v = top.second;
+        if ( top.first > m_dist[v] )
+            continue;
+        m_settled.push_back(v);
+        if ( m_target[v] == 1 )
+        {
+            m_target[v] = 2; // counted
+            if ( ++found == targets )
+                break;
+        }
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+        {
+            int w = g.edgeTarget(e);
+            double d = top.first + g.edgeMiles(e);
+            if ( d > maxMiles  ||  (m_dist[w] >= 0  &&  d >= m_dist[w]) )
+                continue;
+            if ( m_dist[w] < 0  &&  m_target[w] == 0 )
+                m_touched.push_back(w);
+            m_dist[w] = d;
+            m_heap.push_back(Entry(d, w));
+            push_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+        }
+    }
+    return found;
+}
+
+DeliveryResult ServiceAreaImpl::reachableWithin(const GeoCoord& origin, double maxMiles,
+                                                vector<GeoCoord>& reached, vector<double>& miles) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    int start = g == nullptr ? -1 : g->findNode(origin);
+    if ( start == -1 )
+        return BAD_COORD;
+
+    reached.clear();
+    miles.clear();
+    if ( maxMiles < 0 )
+        return DELIVERY_SUCCESS;
+    search(start, maxMiles, 0);
+    reached.reserve(m_settled.size());
+    miles.reserve(m_settled.size());
+    for ( size_t i = 0 ; i < m_settled.size() ; i++ )
+    {
+        reached.push_back(g->coord(m_settled[i]));
+        miles.push_back(m_dist[m_settled[i]]);
+    }
+    resetScratch();
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult ServiceAreaImpl::checkAddresses(const GeoCoord& origin, double maxMiles,
+                                               const vector<GeoCoord>& addresses, vector<bool>& within) const
+{
+    const StreetGraph* g = m_streetMap->graph();
+    int start = g == nullptr ? -1 : g->findNode(origin);
+    if ( start == -1 )
+        return BAD_COORD;
+
+    within.assign(addresses.size(), false);
+    if ( maxMiles < 0 )
+        return DELIVERY_SUCCESS;
+    if ( int(m_dist.size()) != g->nodeCount() )
+    {
+        m_dist.assign(g->nodeCount(), -1);
+        m_target.assign(g->nodeCount(), 0);
+    }
+
+    vector<int> node(addresses.size());
+    int targets = 0;
+    for ( size_t i = 0 ; i < addresses.size() ; i++ )
+    {
+        node[i] = g->findNode(addresses[i]);
+        if ( node[i] != -1  &&  m_target[node[i]] == 0 ) // the same address can be listed twice
+        {
+            m_target[node[i]] = 1;
+            m_touched.push_back(node[i]);
+            targets++;
+        }
+    }
+    if ( targets > 0 )
+        search(start, maxMiles, targets);
+    for ( size_t i = 0 ; i < addresses.size() ; i++ )
+        within[i] = node[i] != -1  &&  m_target[node[i]] == 2;
+    resetScratch();
+    return DELIVERY_SUCCESS;
+}
+
+//******************** ServiceArea functions **********************************
+
+// These functions simply delegate to ServiceAreaImpl's functions.
+
+ServiceArea::ServiceArea(const StreetMap* sm)
+{
+    m_impl = new ServiceAreaImpl(sm);
+}
+
+ServiceArea::~ServiceArea()
+{
+    delete m_impl;
+}
+
+DeliveryResult ServiceArea::reachableWithin(const GeoCoord& origin, double maxMiles,
+                                            vector<GeoCoord>& reached, vector<double>& miles) const
+{
+    return m_impl->reachableWithin(origin, maxMiles, reached, miles);
+}
+
+DeliveryResult ServiceArea::checkAddresses(const GeoCoord& origin, double maxMiles,
+                                           const vector<GeoCoord>& addresses, vector<bool>& within) const
+{
+    return m_impl->checkAddresses(origin, maxMiles, addresses, within);
+}
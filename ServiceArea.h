@@ -0,0 +1,43 @@
+
+#ifndef SERVICE_AREA_INCLUDED
+#define SERVICE_AREA_INCLUDED
+
+#include "provided.h"
+#include <vector>
+
+// ServiceArea.h
+
+// Which intersections a depot can reach within a road distance, from a single search instead
+// of one route per address.
+//
+// The search settles intersections in order of road distance and never goes past maxMiles, so
+// an intersection exactly at the limit is in and anything beyond it is never looked at. The
+// distance array and heap are kept between calls, and only the entries a search touched are
+// cleared afterwards, so repeated small searches don't pay for the size of the map. The calls are
+// const but share that scratch, so use one ServiceArea per thread.
+//
+// Both calls need a map loaded with StreetMap::load (not tiled), and return BAD_COORD if the
+// origin isn't an intersection. An address that isn't an intersection is simply not reachable.
+
+class ServiceAreaImpl;
+
+class ServiceArea
+{
+public:
+    ServiceArea(const StreetMap* sm);
+    ~ServiceArea();
+      // every intersection within maxMiles of origin, nearest first, with its road distance
+    DeliveryResult reachableWithin(const GeoCoord& origin, double maxMiles,
+                                   std::vector<GeoCoord>& reached, std::vector<double>& miles) const;
+      // within[i] is whether addresses[i] is within maxMiles; the search stops as soon as
+      // every address has been settled
+    DeliveryResult checkAddresses(const GeoCoord& origin, double maxMiles,
+                                  const std::vector<GeoCoord>& addresses, std::vector<bool>& within) const;
+      // We prevent a ServiceArea object from being copied or assigned.
+    ServiceArea(const ServiceArea&) = delete;
+    ServiceArea& operator=(const ServiceArea&) = delete;
+private:
+    ServiceAreaImpl* m_impl;
+};
+
+#endif // SERVICE_AREA_INCLUDED
@@ -0,0 +1,768 @@
+//
+//  StreetGraph.cpp
+//  Goober Eats
+//
+
+#include "StreetGraph.h"
+#include "OpenSet.h"
+#include <algorithm>
+#include <list>
+
+using namespace std;
+
+unsigned int hasher(const GeoCoord& g); // prototype, see StreetMap.cpp
+unsigned int hasher(const string& s);   // prototype, see StreetMap.cpp
+
+const int FIXED_DECIMALS = 7;
+const long long FIXED_SCALE = 10000000;     // 1e-7 degrees
+const unsigned char TEXT_FORMAT = 0xFF;
+
+  // every output bit depends on every input bit, and no two inputs give the same output
+static unsigned long long mix64(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+unsigned int hasher(const CoordKey& k)
+{
+    // mix both halves so the low bits the buckets use depend on every input bit
+    unsigned long long h = (unsigned long long)(unsigned int)k.lat << 32 | (unsigned int)k.lon;
+    return mix64(h ^ (unsigned long long)k.format << 56);
+}
+
+  // succeeds only for text that formatFixed() would write back exactly: an optional '-',
+  // digits without a leading zero, and an optional '.' with one to seven digits
+static bool parseFixed(const string& text, int& value, int& decimals)
+{
+    size_t i = 0;
+    bool negative = false;
+    if ( i < text.size()  &&  text[i] == '-' )
+    {
+        negative = true;
+        i++;
+    }
+    size_t wholeStart = i;
+    long long v = 0;
+    for ( ; i < text.size()  &&  text[i] >= '0'  &&  text[i] <= '9' ; i++ )
+    {
+        v = v * 10 + (text[i] - '0');
+        if ( v > 214 ) // keeps the scaled value inside an int
+            return false;
+    }
+    size_t wholeDigits = i - wholeStart;
+    if ( wholeDigits == 0  ||  (wholeDigits > 1  &&  text[wholeStart] == '0') )
+        return false;
+
+    decimals = 0;
+    if ( i < text.size()  &&  text[i] == '.' )
+    {
+        for ( i++ ; i < text.size()  &&  text[i] >= '0'  &&  text[i] <= '9' ; i++ )
+        {
+            if ( ++decimals > FIXED_DECIMALS )
+                return false;
+            v = v * 10 + (text[i] - '0');
+        }
+        if ( decimals == 0 )
+            return false;
+    }
+    if ( i != text.size() )
+        return false;
+    for ( int d = decimals ; d < FIXED_DECIMALS ; d++ )
+        v *= 10;
+    if ( v > 2147483647LL )
+        return false;
+    if ( negative  &&  v == 0 ) // "-0" would come back as "0"
+        return false;
+    value = negative ? -v : v;
+    return true;
+}
+
+static string formatFixed(int value, int decimals)
+{
+    char buffer[24];
+    char* p = buffer + sizeof(buffer);
+    *--p = '\0';
+    long long v = value < 0 ? -(long long)value : value;
+    for ( int d = decimals ; d < FIXED_DECIMALS ; d++ )
+        v /= 10;
+    for ( int d = 0 ; d < decimals ; d++ )
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    }
+    if ( decimals > 0 )
+        *--p = '.';
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while ( v > 0 );
+    if ( value < 0 )
+        *--p = '-';
+    return string(p);
+}
+
+static bool makeKey(const GeoCoord& g, CoordKey& key)
+{
+    int latDecimals, lonDecimals;
+    if ( !parseFixed(g.latitudeText, key.lat, latDecimals)  ||  !parseFixed(g.longitudeText, key.lon, lonDecimals) )
+        return false;
+    key.format = latDecimals << 4 | lonDecimals;
+    return true;
+}
+
+// FrozenCoordTable tuning: keys per bucket on average, and how many displacements a bucket of
+// more than one key tries, per slot in the table, before the build starts over with a new seed
+const int FROZEN_KEYS_PER_BUCKET = 2;
+const unsigned int FROZEN_PASSES = 16;
+
+FrozenCoordTable::FrozenCoordTable()
+{
+    m_seed = 0;
+}
+
+void FrozenCoordTable::clear()
+{
+    m_displacement.clear();
+    m_slots.clear();
+    m_seed = 0;
+}
+
+  // 32 low bits pick the bucket, 32 high bits are the fingerprint
+unsigned long long FrozenCoordTable::hash(const CoordKey& key) const
+{
+    unsigned long long h = (unsigned long long)(unsigned int)key.lat << 32 | (unsigned int)key.lon;
+    return mix64(h ^ mix64(m_seed << 8 | key.format));
+}
+
+int FrozenCoordTable::bucketOf(unsigned long long h) const
+{
+    return ((h & 0xFFFFFFFF) * m_displacement.size()) >> 32;
+}
+
+  // where a key's slots start and the stride between them
+void FrozenCoordTable::probe(unsigned long long h, unsigned int& first, unsigned int& stride) const
+{
+    unsigned long long slots = m_slots.size();
+    unsigned long long g = mix64(h);
+    first = ((g & 0xFFFFFFFF) * slots) >> 32;
+    stride = ((g >> 32) * slots) >> 32;
+}
+
+  // displacement d is the pair (d / slots, d % slots): that many strides, then a plain offset,
+  // so a lone key can be put in any slot at all
+int FrozenCoordTable::slotOf(unsigned long long h, unsigned int displacement) const
+{
+    unsigned long long slots = m_slots.size();
+    unsigned int first, stride;
+    probe(h, first, stride);
+    return (first + displacement / slots * stride + displacement % slots) % slots;
+}
+
+void FrozenCoordTable::build(const vector<CoordKey>& keys, const vector<int>& nodes)
+{
+    clear();
+    if ( keys.empty() )
+        return;
+    for ( m_seed = 0 ; !tryBuild(keys, nodes) ; m_seed++ )
+        ;
+}
+
+bool FrozenCoordTable::tryBuild(const vector<CoordKey>& keys, const vector<int>& nodes)
+{
+    int n = keys.size();
+    unsigned int tableSize = n;
+    int buckets = (n + FROZEN_KEYS_PER_BUCKET - 1) / FROZEN_KEYS_PER_BUCKET;
+    m_displacement.assign(buckets, 0);
+    m_slots.assign(n, Slot{ 0, -1 });
+
+    // keys grouped by bucket
+    vector<unsigned long long> h(n);
+    vector<int> bucketStart(buckets + 1, 0), byBucket(n);
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        h[i] = hash(keys[i]);
+        bucketStart[bucketOf(h[i]) + 1]++;
+    }
+    for ( int b = 0 ; b < buckets ; b++ )
+        bucketStart[b + 1] += bucketStart[b];
+    vector<int> next(bucketStart.begin(), bucketStart.end() - 1);
+    for ( int i = 0 ; i < n ; i++ )
+        byBucket[next[bucketOf(h[i])]++] = i;
+
+    // biggest buckets first, while the table is still mostly empty
+    vector<int> order(buckets);
+    for ( int b = 0 ; b < buckets ; b++ )
+        order[b] = b;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+    });
+
+    vector<unsigned int> first(n), stride(n);
+    for ( int i = 0 ; i < n ; i++ )
+        probe(h[i], first[i], stride[i]);
+
+    // each bucket tries its displacements in order, a pass over the offsets for each stride count;
+    // the buckets of one key come last and just take the next free slot
+    vector<char> taken(n, 0);
+    vector<int> base, placed;
+    unsigned int nextFree = 0;
+    for ( int k = 0 ; k < buckets ; k++ )
+    {
+        int b = order[k], size = bucketStart[b + 1] - bucketStart[b];
+        if ( size == 0 )
+            break;
+        if ( size == 1 )
+        {
+            int key = byBucket[bucketStart[b]];
+            while ( taken[nextFree] )
+                nextFree++;
+            taken[nextFree] = 1;
+            m_displacement[b] = nextFree >= first[key] ? nextFree - first[key] : nextFree + n - first[key];
+            m_slots[nextFree] = Slot{ (unsigned int)(h[key] >> 32), nodes[key] };
+            continue;
+        }
+        unsigned int pass = 0, offset = 0;
+        base.resize(size);
+        for ( int i = 0 ; i < size ; i++ )
+            base[i] = first[byBucket[bucketStart[b] + i]];
+        for ( ; ; )
+        {
+            placed.clear();
+            for ( int i = 0 ; i < size ; i++ )
+            {
+                int slot = base[i] + offset < tableSize ? base[i] + offset : base[i] + offset - tableSize;
+                if ( taken[slot] )
+                    break;
+                taken[slot] = 1;
+                placed.push_back(slot);
+            }
+            if ( int(placed.size()) == size )
+                break;
+            for ( size_t i = 0 ; i < placed.size() ; i++ )
+                taken[placed[i]] = 0;
+            if ( ++offset == tableSize )
+            {
+                // two keys of the bucket share both their first slot and stride
+                if ( ++pass == FROZEN_PASSES )
+                    return false;
+                offset = 0;
+                for ( int i = 0 ; i < size ; i++ )
+                    base[i] = (base[i] + stride[byBucket[bucketStart[b] + i]]) % n;
+            }
+        }
+        m_displacement[b] = pass * n + offset;
+        for ( int i = 0 ; i < size ; i++ )
+        {
+            int key = byBucket[bucketStart[b] + i];
+            m_slots[placed[i]] = Slot{ (unsigned int)(h[key] >> 32), nodes[key] };
+        }
+    }
+    return true;
+}
+
+int FrozenCoordTable::find(const CoordKey& key) const
+{
+    if ( m_slots.empty() )
+        return -1;
+    unsigned long long h = hash(key);
+    const Slot& slot = m_slots[slotOf(h, m_displacement[bucketOf(h)])];
+    return slot.fingerprint == (unsigned int)(h >> 32) ? slot.node : -1;
+}
+
+void FrozenCoordTable::copyFrom(const FrozenCoordTable& other)
+{
+    m_displacement.assign(other.m_displacement.begin(), other.m_displacement.end());
+    m_slots.assign(other.m_slots.begin(), other.m_slots.end());
+    m_seed = other.m_seed;
+}
+
+size_t FrozenCoordTable::memoryBytes() const
+{
+    return m_displacement.size() * sizeof(unsigned int) + m_slots.size() * sizeof(Slot);
+}
+
+StreetGraph::StreetGraph()
+{
+    m_edgeStart.push_back(0);
+    m_componentCount = 0;
+    m_cellStart.push_back(0);
+    m_gridLat = m_gridLon = 0;
+    m_cellSize = 1;
+    m_gridRows = m_gridColumns = 0;
+    m_frozen = false;
+}
+
+void StreetGraph::clear()
+{
+    m_lat.clear();
+    m_lon.clear();
+    m_format.clear();
+    m_edgeStart.assign(1, 0);
+    m_component.clear();
+    m_componentCount = 0;
+    m_cellStart.assign(1, 0);
+    m_cellNodes.clear();
+    m_gridLat = m_gridLon = 0;
+    m_cellSize = 1;
+    m_gridRows = m_gridColumns = 0;
+    m_edgeTarget.clear();
+    m_edgeName.clear();
+    m_edgeMiles.clear();
+    m_names.clear();
+    m_nodeIds.reset();
+    m_frozenIds.clear();
+    m_frozen = false;
+    m_nameIds.reset();
+    m_textNodeIds.reset();
+    m_textCoords.clear();
+    m_pendingFrom.clear();
+}
+
+int StreetGraph::addNode(const GeoCoord& g)
+{
+    int existing = findNode(g);
+    if ( existing != -1 )
+        return existing;
+
+    int id = m_lat.size();
+    CoordKey key;
+    if ( makeKey(g, key) )
+        m_nodeIds.associate(key, id);
+    else
+    {
+        key.lat = int(g.latitude * FIXED_SCALE);
+        key.lon = int(g.longitude * FIXED_SCALE);
+        key.format = TEXT_FORMAT;
+        m_textNodeIds.associate(g, id);
+        m_textCoords.push_back(make_pair(id, g));
+    }
+    m_lat.push_back(key.lat);
+    m_lon.push_back(key.lon);
+    m_format.push_back(key.format);
+    return id;
+}
+
+int StreetGraph::addName(const string& name)
+{
+    const int* existing = m_nameIds.find(name);
+    if ( existing != nullptr )
+        return *existing;
+    int id = m_names.size();
+    m_names.push_back(name);
+    m_nameIds.associate(name, id);
+    return id;
+}
+
+void StreetGraph::addSegment(const GeoCoord& start, const GeoCoord& end, const string& name)
+{
+    int from = addNode(start);
+    int to = addNode(end);
+    int nameId = addName(name);
+    double miles = distanceEarthMiles(start, end);
+
+    m_pendingFrom.push_back(from);
+    m_edgeTarget.push_back(to);
+    m_edgeName.push_back(nameId);
+    m_edgeMiles.push_back(miles);
+
+    m_pendingFrom.push_back(to);
+    m_edgeTarget.push_back(from);
+    m_edgeName.push_back(nameId);
+    m_edgeMiles.push_back(miles);
+}
+
+  // counting sort of the edges by start node. Each node's edges end up newest first, the order
+  // the original per-coordinate segment vectors had
+void StreetGraph::finish()
+{
+    int n = m_lat.size();
+    int e = m_pendingFrom.size();
+    m_edgeStart.assign(n + 1, 0);
+    for ( int i = 0 ; i < e ; i++ )
+        m_edgeStart[m_pendingFrom[i] + 1]++;
+    for ( int v = 0 ; v < n ; v++ )
+        m_edgeStart[v + 1] += m_edgeStart[v];
+
+    vector<int> next(m_edgeStart.begin() + 1, m_edgeStart.end());
+    GraphArray<int> target(e), name(e);
+    GraphArray<double> miles(e);
+    for ( int i = 0 ; i < e ; i++ )
+    {
+        int slot = --next[m_pendingFrom[i]];
+        target[slot] = m_edgeTarget[i];
+        name[slot] = m_edgeName[i];
+        miles[slot] = m_edgeMiles[i];
+    }
+    m_edgeTarget.swap(target);
+    m_edgeName.swap(name);
+    m_edgeMiles.swap(miles);
+    vector<int>().swap(m_pendingFrom);
+    sort(m_textCoords.begin(), m_textCoords.end(),
+         [](const pair<int, GeoCoord>& a, const pair<int, GeoCoord>& b) { return a.first < b.first; });
+    labelComponents();
+    buildGrid();
+    freeze();
+}
+
+  // other must be finished; its frozen table comes across as it is, and the hash maps that
+  // ExpandableHashMap can't copy are rebuilt
+void StreetGraph::copyFrom(const StreetGraph& other)
+{
+    clear();
+    m_lat.assign(other.m_lat.begin(), other.m_lat.end());
+    m_lon.assign(other.m_lon.begin(), other.m_lon.end());
+    m_format.assign(other.m_format.begin(), other.m_format.end());
+    m_edgeStart.assign(other.m_edgeStart.begin(), other.m_edgeStart.end());
+    m_component.assign(other.m_component.begin(), other.m_component.end());
+    m_componentCount = other.m_componentCount;
+    m_cellStart.assign(other.m_cellStart.begin(), other.m_cellStart.end());
+    m_cellNodes.assign(other.m_cellNodes.begin(), other.m_cellNodes.end());
+    m_gridLat = other.m_gridLat;
+    m_gridLon = other.m_gridLon;
+    m_cellSize = other.m_cellSize;
+    m_gridRows = other.m_gridRows;
+    m_gridColumns = other.m_gridColumns;
+    m_edgeTarget.assign(other.m_edgeTarget.begin(), other.m_edgeTarget.end());
+    m_edgeName.assign(other.m_edgeName.begin(), other.m_edgeName.end());
+    m_edgeMiles.assign(other.m_edgeMiles.begin(), other.m_edgeMiles.end());
+    m_names = other.m_names;
+    for ( size_t id = 0 ; id < m_names.size() ; id++ )
+        m_nameIds.associate(m_names[id], id);
+    m_textCoords = other.m_textCoords;
+    for ( size_t i = 0 ; i < m_textCoords.size() ; i++ )
+        m_textNodeIds.associate(m_textCoords[i].second, m_textCoords[i].first);
+    m_frozenIds.copyFrom(other.m_frozenIds);
+    m_frozen = true;
+}
+
+  // nothing is added to a finished graph, so trade the building hash map for the perfect hash
+void StreetGraph::freeze()
+{
+    vector<CoordKey> keys;
+    vector<int> nodes;
+    for ( size_t v = 0 ; v < m_lat.size() ; v++ )
+    {
+        if ( m_format[v] == TEXT_FORMAT )
+            continue;
+        keys.push_back(CoordKey{ m_lat[v], m_lon[v], m_format[v] });
+        nodes.push_back(v);
+    }
+    m_frozenIds.build(keys, nodes);
+    m_nodeIds.reset();
+    m_frozen = true;
+}
+
+  // every street goes both ways, so a search from each unlabeled node finds its whole component
+void StreetGraph::labelComponents()
+{
+    int n = m_lat.size();
+    m_component.assign(n, -1);
+    m_componentCount = 0;
+    vector<int> stack;
+    for ( int root = 0 ; root < n ; root++ )
+    {
+        if ( m_component[root] != -1 )
+            continue;
+        m_component[root] = m_componentCount;
+        stack.push_back(root);
+        while ( !stack.empty() )
+        {
+            int v = stack.back();
+            stack.pop_back();
+            for ( int e = m_edgeStart[v] ; e < m_edgeStart[v + 1] ; e++ )
+            {
+                int w = m_edgeTarget[e];
+                if ( m_component[w] == -1 )
+                {
+                    m_component[w] = m_componentCount;
+                    stack.push_back(w);
+                }
+            }
+        }
+        m_componentCount++;
+    }
+}
+
+int StreetGraph::findNode(const GeoCoord& g) const
+{
+    CoordKey key;
+    if ( !makeKey(g, key) )
+    {
+        const int* id = m_textNodeIds.find(g);
+        return id == nullptr ? -1 : *id;
+    }
+    if ( m_frozen )
+    {
+        int node = m_frozenIds.find(key);
+        if ( node == -1  ||  m_lat[node] != key.lat  ||  m_lon[node] != key.lon  ||  m_format[node] != key.format )
+            return -1;
+        return node;
+    }
+    const int* id = m_nodeIds.find(key);
+    return id == nullptr ? -1 : *id;
+}
+
+const GeoCoord& StreetGraph::textCoord(int node) const
+{
+    vector<pair<int, GeoCoord>>::const_iterator it = lower_bound(m_textCoords.begin(), m_textCoords.end(), node,
+        [](const pair<int, GeoCoord>& entry, int id) { return entry.first < id; });
+    return it->second;
+}
+
+  // dividing the exact integer by 1e7 rounds once, to the same double stod gives for the text
+double StreetGraph::latitude(int node) const
+{
+    if ( m_format[node] == TEXT_FORMAT )
+        return textCoord(node).latitude;
+    return m_lat[node] / double(FIXED_SCALE);
+}
+
+double StreetGraph::longitude(int node) const
+{
+    if ( m_format[node] == TEXT_FORMAT )
+        return textCoord(node).longitude;
+    return m_lon[node] / double(FIXED_SCALE);
+}
+
+  // about this many nodes to a cell, so a lookup reads a few cells of a few nodes each
+const int NODES_PER_CELL = 4;
+
+  // cells are square in degrees, sized for NODES_PER_CELL over the box the nodes cover; a map
+  // that's a thin strip gets at most a cell per NODES_PER_CELL nodes along it
+void StreetGraph::buildGrid()
+{
+    int n = m_lat.size();
+    m_cellNodes.assign(n, 0);
+    if ( n == 0 )
+    {
+        m_cellStart.assign(1, 0);
+        m_gridRows = m_gridColumns = 0;
+        return;
+    }
+    int minLat = *min_element(m_lat.begin(), m_lat.end()), maxLat = *max_element(m_lat.begin(), m_lat.end());
+    int minLon = *min_element(m_lon.begin(), m_lon.end()), maxLon = *max_element(m_lon.begin(), m_lon.end());
+    double latSpan = double(maxLat) - minLat, lonSpan = double(maxLon) - minLon;
+    double cells = max(1.0, double(n) / NODES_PER_CELL);
+    m_cellSize = max(1.0, max(sqrt(latSpan * lonSpan / cells), max(latSpan, lonSpan) / cells));
+    m_gridLat = minLat;
+    m_gridLon = minLon;
+    m_gridRows = int(latSpan / m_cellSize) + 1;
+    m_gridColumns = int(lonSpan / m_cellSize) + 1;
+
+    // counting sort of the nodes by cell
+    vector<int> cellOf(n);
+    m_cellStart.assign(size_t(m_gridRows) * m_gridColumns + 1, 0);
+    for ( int v = 0 ; v < n ; v++ )
+    {
+        cellOf[v] = gridRow(m_lat[v]) * m_gridColumns + gridColumn(m_lon[v]);
+        m_cellStart[cellOf[v] + 1]++;
+    }
+    for ( size_t c = 1 ; c < m_cellStart.size() ; c++ )
+        m_cellStart[c] += m_cellStart[c - 1];
+    vector<int> next(m_cellStart.begin(), m_cellStart.end() - 1);
+    for ( int v = 0 ; v < n ; v++ )
+        m_cellNodes[next[cellOf[v]]++] = v;
+}
+
+  // the row and column a fixed-point coordinate falls in, clamped to the grid
+int StreetGraph::gridRow(double lat) const
+{
+    return max(0, min(m_gridRows - 1, int(floor((lat - m_gridLat) / m_cellSize))));
+}
+
+int StreetGraph::gridColumn(double lon) const
+{
+    return max(0, min(m_gridColumns - 1, int(floor((lon - m_gridLon) / m_cellSize))));
+}
+
+  // compares the fixed-point coordinates, with longitude shrunk by the cosine of the latitude,
+  // which is plenty to pick the closest of a few nearby corners. Cells are read a ring at a time
+  // around g's; everything in ring r is at least r-1 cells away, so once that's farther than the
+  // best so far no later ring can do better. Ties go to the lower node number
+int StreetGraph::nearestNode(const GeoCoord& g, int component) const
+{
+    double lat = g.latitude * FIXED_SCALE, lon = g.longitude * FIXED_SCALE;
+    double shrink = cos(deg2rad(g.latitude));
+    int row = gridRow(lat), column = gridColumn(lon);
+    int best = -1;
+    double bestSquared = 0;
+    for ( int ring = 0 ; ring <= max(m_gridRows, m_gridColumns) ; ring++ )
+    {
+        double gap = (ring - 1) * m_cellSize * shrink;
+        if ( best != -1  &&  gap > 0  &&  gap * gap > bestSquared )
+            break;
+        for ( int r = max(0, row - ring) ; r <= min(m_gridRows - 1, row + ring) ; r++ )
+        {
+            // the whole of the ring's top and bottom rows, just its two ends on the others
+            int step = (r == row - ring  ||  r == row + ring) ? 1 : max(1, 2 * ring);
+            for ( int c = column - ring ; c <= column + ring ; c += step )
+            {
+                if ( c < 0  ||  c >= m_gridColumns )
+                    continue;
+                int cell = r * m_gridColumns + c;
+                for ( int i = m_cellStart[cell] ; i < m_cellStart[cell + 1] ; i++ )
+                {
+                    int v = m_cellNodes[i];
+                    if ( component != -1  &&  m_component[v] != component )
+                        continue;
+                    double dLat = m_lat[v] - lat, dLon = (m_lon[v] - lon) * shrink;
+                    double squared = dLat * dLat + dLon * dLon;
+                    if ( best == -1  ||  squared < bestSquared  ||  (squared == bestSquared  &&  v < best) )
+                    {
+                        best = v;
+                        bestSquared = squared;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+GeoCoord StreetGraph::coord(int node) const
+{
+    if ( m_format[node] == TEXT_FORMAT )
+        return textCoord(node);
+
+    // fill the fields directly, so GeoCoord doesn't parse the text we just wrote
+    GeoCoord g;
+    g.latitudeText = formatFixed(m_lat[node], m_format[node] >> 4);
+    g.longitudeText = formatFixed(m_lon[node], m_format[node] & 0xF);
+    g.latitude = latitude(node);
+    g.longitude = longitude(node);
+    return g;
+}
+
+int StreetGraph::edgeSource(int edge) const
+{
+    return upper_bound(m_edgeStart.begin(), m_edgeStart.end(), edge) - m_edgeStart.begin() - 1;
+}
+
+  // node coordinates, then each node's edge targets in order: the same map read the same way
+  // always gives the same value, and a map that differs anywhere almost never does
+unsigned long long StreetGraph::checksum() const
+{
+    unsigned long long h = mix64(nodeCount()) ^ edgeCount();
+    for ( int v = 0 ; v < nodeCount() ; v++ )
+    {
+        h = mix64(h ^ ((unsigned long long)(unsigned int)m_lat[v] << 32 | (unsigned int)m_lon[v]));
+        for ( int e = m_edgeStart[v] ; e < m_edgeStart[v + 1] ; e++ )
+            h = mix64(h ^ (unsigned int)m_edgeTarget[e]);
+    }
+    return h;
+}
+
+StreetSegment StreetGraph::segment(int from, int edge) const
+{
+    return StreetSegment(coord(from), coord(m_edgeTarget[edge]), m_names[m_edgeName[edge]]);
+}
+
+void StreetGraph::shortestPathTree(int root, vector<int>& parentEdge) const
+{
+    int n = nodeCount();
+    vector<double> dist(n, -1);
+    parentEdge.assign(n, -1);
+    QuaternaryHeap open;
+    open.prepare(n);
+    dist[root] = 0;
+    open.push(root, 0);
+    while ( !open.empty() )
+    {
+        int v = open.pop().state;
+        for ( int e = firstEdge(v) ; e < lastEdge(v) ; e++ )
+        {
+            int w = m_edgeTarget[e];
+            double c = dist[v] + m_edgeMiles[e];
+            if ( w != root  &&  (dist[w] < 0  ||  c < dist[w]) )
+            {
+                dist[w] = c;
+                parentEdge[w] = e;
+                open.push(w, c);
+            }
+        }
+    }
+}
+
+  // heap bytes behind a std::string, given libstdc++'s 15 character short-string buffer
+static size_t stringHeap(const string& s)
+{
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+  // bucket count ExpandableHashMap reaches for this many entries at its default load factor
+static size_t bucketsFor(size_t entries)
+{
+    size_t buckets = 8;
+    while ( entries > 0.5 * buckets )
+        buckets *= 2;
+    return buckets;
+}
+
+void StreetGraph::compactBytes(size_t& nodeBytes, size_t& edgeBytes, size_t& nameBytes) const
+{
+    const size_t LIST_LINKS = 2 * sizeof(void*);
+    nodeBytes = nodeCount() * (2 * sizeof(int) + sizeof(unsigned char) + 2 * sizeof(int))
+              + m_frozenIds.memoryBytes() + (m_cellStart.size() + m_cellNodes.size()) * sizeof(int);
+    for ( size_t i = 0 ; i < m_textCoords.size() ; i++ )
+        nodeBytes += sizeof(pair<int, GeoCoord>) + LIST_LINKS + sizeof(GeoCoord) + sizeof(int);
+    edgeBytes = edgeCount() * (2 * sizeof(int) + sizeof(double));
+    nameBytes = 0;
+    for ( size_t i = 0 ; i < m_names.size() ; i++ )
+        nameBytes += sizeof(string) + stringHeap(m_names[i]) + LIST_LINKS + sizeof(string) + stringHeap(m_names[i]) + sizeof(int);
+    nameBytes += bucketsFor(m_names.size()) * sizeof(list<int>);
+}
+
+size_t StreetGraph::memoryBytes() const
+{
+    size_t nodeBytes, edgeBytes, nameBytes;
+    compactBytes(nodeBytes, edgeBytes, nameBytes);
+    return nodeBytes + edgeBytes + nameBytes;
+}
+
+void StreetGraph::memoryReport(ostream& out) const
+{
+    size_t n = nodeCount(), e = edgeCount();
+    if ( n == 0  ||  e == 0 )
+    {
+        out << "Street graph is empty." << endl;
+        return;
+    }
+
+    // before: every directed segment was a StreetSegment (two GeoCoords and the name), kept in a
+    // vector per start coordinate, in an ExpandableHashMap<GeoCoord, vector<StreetSegment>>
+    const size_t LIST_LINKS = 2 * sizeof(void*);
+    vector<size_t> coordHeap(n);
+    for ( size_t v = 0 ; v < n ; v++ )
+    {
+        GeoCoord g = coord(v);
+        coordHeap[v] = stringHeap(g.latitudeText) + stringHeap(g.longitudeText);
+    }
+    size_t oldEdgeBytes = e * sizeof(StreetSegment);
+    size_t oldNodeBytes = n * (LIST_LINKS + sizeof(GeoCoord) + sizeof(vector<StreetSegment>))
+                        + bucketsFor(n) * sizeof(list<int>);
+    for ( size_t v = 0 ; v < n ; v++ )
+    {
+        oldNodeBytes += coordHeap[v]; // the table key
+        for ( int i = firstEdge(v) ; i < lastEdge(v) ; i++ )
+            oldEdgeBytes += coordHeap[v] + coordHeap[m_edgeTarget[i]] + stringHeap(m_names[m_edgeName[i]]);
+    }
+
+    // after
+    size_t newNodeBytes, newEdgeBytes, nameBytes;
+    compactBytes(newNodeBytes, newEdgeBytes, nameBytes);
+
+    out.setf(ios::fixed);
+    out.precision(1);
+    out << "Street graph: " << n << " nodes, " << e << " directed edges, " << m_names.size() << " street names" << endl;
+    out << "  text-backed:  " << double(oldNodeBytes) / n << " bytes/node, " << double(oldEdgeBytes) / e
+        << " bytes/edge, " << (oldNodeBytes + oldEdgeBytes) / 1024 << " KB total" << endl;
+    out << "  compact:      " << double(newNodeBytes) / n << " bytes/node, " << double(newEdgeBytes) / e
+        << " bytes/edge, " << (newNodeBytes + newEdgeBytes + nameBytes) / 1024 << " KB total (incl. "
+        << nameBytes / 1024 << " KB name table)" << endl;
+}
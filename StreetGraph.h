@@ -0,0 +1,173 @@
+
+#ifndef STREET_GRAPH_INCLUDED
+#define STREET_GRAPH_INCLUDED
+
+#include "provided.h"
+#include "ExpandableHashMap.h"
+#include "GraphMemory.h"
+#include <string>
+#include <vector>
+#include <iostream>
+
+// StreetGraph.h
+
+// The road network behind a StreetMap, stored without any per-segment text.
+//
+// Intersections are numbered 0..nodeCount()-1. Their coordinates are kept as two int arrays of
+// 1e-7 degrees (the resolution of mapdata.txt) plus one byte recording how many decimals each
+// was written with, so the original text can be rebuilt exactly when a GeoCoord is handed out.
+// The rare coordinate whose text wouldn't survive that (a leading '+', "-0", more than seven
+// decimals, ...) keeps its text on the side. Streets leaving node n are edges
+// firstEdge(n)..lastEdge(n)-1; each edge stores its end node, a street name number and its
+// length. Node lookup hashes and compares the integers, never the text, and once the graph is
+// finished goes through a FrozenCoordTable instead of the hash map it was built with.
+
+struct CoordKey
+{
+    int lat;
+    int lon;
+    unsigned char format;   // decimals of lat in the high nibble, lon in the low; 0xFF if kept as text
+};
+
+inline bool operator==(const CoordKey& lhs, const CoordKey& rhs)
+{
+    return lhs.lat == rhs.lat  &&  lhs.lon == rhs.lon  &&  lhs.format == rhs.format;
+}
+
+  // A minimal perfect hash over the coordinates of a finished graph, CHD style: keys are split
+  // into buckets of a few, and each bucket gets a displacement that sends all its keys to slots no
+  // other key has, in a table exactly as big as the number of keys. A lookup reads the bucket's
+  // displacement and then the slot. The slot keeps the 32 bits of the key's hash that didn't pick
+  // its bucket, so a coordinate that isn't in the graph almost always stops there; the node a
+  // lookup returns still has to be checked against the key.
+class FrozenCoordTable
+{
+public:
+    FrozenCoordTable();
+    void clear();
+    void build(const std::vector<CoordKey>& keys, const std::vector<int>& nodes);
+    int find(const CoordKey& key) const;    // the only node that can have this key, or -1
+    void copyFrom(const FrozenCoordTable& other);
+    size_t memoryBytes() const;
+
+    FrozenCoordTable(const FrozenCoordTable&) = delete;
+    FrozenCoordTable& operator=(const FrozenCoordTable&) = delete;
+private:
+    struct Slot
+    {
+        unsigned int fingerprint;
+        int node;
+    };
+
+    bool tryBuild(const std::vector<CoordKey>& keys, const std::vector<int>& nodes);
+    unsigned long long hash(const CoordKey& key) const;
+    int bucketOf(unsigned long long h) const;
+    void probe(unsigned long long h, unsigned int& first, unsigned int& stride) const;
+    int slotOf(unsigned long long h, unsigned int displacement) const;
+
+    GraphArray<unsigned int> m_displacement;    // per bucket
+    GraphArray<Slot> m_slots;
+    unsigned long long m_seed;                  // tried until every bucket fits
+};
+
+class StreetGraph
+{
+public:
+    StreetGraph();
+    void clear();
+
+      // building: add every street, then finish() once, which freezes the coordinate lookup
+    void addSegment(const GeoCoord& start, const GeoCoord& end, const std::string& name);
+    void finish();
+
+      // instead of building: the same finished graph, its arrays allocated afresh under whatever
+      // PlacementScope (GraphMemory.h) this thread is in
+    void copyFrom(const StreetGraph& other);
+
+    int nodeCount() const { return m_lat.size(); }
+    int edgeCount() const { return m_edgeTarget.size(); }
+      // for files built from this graph to check they're loaded with the same one
+    unsigned long long checksum() const;
+
+      // nodes with the same component number are joined by streets; others never are
+    int component(int node) const { return m_component[node]; }
+    int componentCount() const { return m_componentCount; }
+
+      // -1 if there's no intersection at exactly this coordinate text
+    int findNode(const GeoCoord& g) const;
+      // the intersection closest to g as the crow flies, counting only those in component unless
+      // it's -1; -1 if there's none. Looks through the grid outward from g's cell
+    int nearestNode(const GeoCoord& g, int component = -1) const;
+    GeoCoord coord(int node) const;
+    double latitude(int node) const;
+    double longitude(int node) const;
+
+    int firstEdge(int node) const { return m_edgeStart[node]; }
+    int lastEdge(int node) const { return m_edgeStart[node + 1]; }
+    int edgeTarget(int edge) const { return m_edgeTarget[edge]; }
+    int edgeSource(int edge) const;         // a binary search over the node offsets
+    int edgeName(int edge) const { return m_edgeName[edge]; }
+    double edgeMiles(int edge) const { return m_edgeMiles[edge]; }
+    const std::string& streetName(int nameId) const { return m_names[nameId]; }
+    int streetNameCount() const { return m_names.size(); }
+
+      // the edge as the StreetSegment StreetMap has always returned
+    StreetSegment segment(int from, int edge) const;
+
+      // for every node, the edge it's reached by on the shortest way out of root, or -1 for root
+      // and nodes it can't reach. Every street goes both ways at the same length, so followed
+      // backwards these are also the shortest ways into root
+    void shortestPathTree(int root, std::vector<int>& parentEdge) const;
+
+      // bytes per node and per edge, next to what the text-backed layout this replaced would use
+    void memoryReport(std::ostream& out) const;
+    size_t memoryBytes() const;     // the compact total memoryReport() prints
+
+    StreetGraph(const StreetGraph&) = delete;
+    StreetGraph& operator=(const StreetGraph&) = delete;
+private:
+    int addNode(const GeoCoord& g);
+    const GeoCoord& textCoord(int node) const;
+    int addName(const std::string& name);
+    void freeze();
+    void labelComponents();
+    void buildGrid();
+    int gridRow(double lat) const;
+    int gridColumn(double lon) const;
+    void compactBytes(size_t& nodeBytes, size_t& edgeBytes, size_t& nameBytes) const;
+
+    // structure of arrays, one entry per node
+    GraphArray<int> m_lat, m_lon;               // 1e-7 degrees
+    GraphArray<unsigned char> m_format;
+    GraphArray<int> m_edgeStart;                // nodeCount() + 1 entries once finished
+    GraphArray<int> m_component;
+    int m_componentCount;
+
+    // a grid of square cells over the nodes, row by row from the south-west corner, each
+    // listing the nodes in it: m_cellNodes[m_cellStart[c]..m_cellStart[c+1]-1]
+    GraphArray<int> m_cellStart;
+    GraphArray<int> m_cellNodes;
+    double m_gridLat, m_gridLon;                // 1e-7 degrees
+    double m_cellSize;
+    int m_gridRows, m_gridColumns;
+
+    // one entry per directed edge
+    GraphArray<int> m_edgeTarget;
+    GraphArray<int> m_edgeName;
+    GraphArray<double> m_edgeMiles;
+
+    std::vector<std::string> m_names;
+    ExpandableHashMap<CoordKey, int> m_nodeIds; // while building
+    FrozenCoordTable m_frozenIds;               // once finished
+    bool m_frozen;
+    ExpandableHashMap<std::string, int> m_nameIds;
+
+    // coordinates that couldn't be stored as integers, by text and by node
+    ExpandableHashMap<GeoCoord, int> m_textNodeIds;
+    std::vector<std::pair<int, GeoCoord>> m_textCoords;
+
+    // edges as added, before finish() sorts them by start node
+    std::vector<int> m_pendingFrom;
+};
+
+#endif // STREET_GRAPH_INCLUDED
@@ -11,10 +11,21 @@
 #include <vector>
 #include <functional>
 #include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include "ChainGraph.h"
+#include "GraphMemory.h"
+#include "TiledMap.h"
+#include "Trace.h"
+#include "AllocStats.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
 
 using namespace std;
 
@@ -23,29 +34,22 @@ unsigned int hasher(const GeoCoord& g)
     return std::hash<string>()(g.latitudeText + g.longitudeText);
 }
 
-class StreetMapImpl
+unsigned int hasher(const string& s)
 {
-public:
-    StreetMapImpl();
-    ~StreetMapImpl();
-    bool load(string mapFile);
-    bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
-private:
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> m_Map;
-    
-};
-
-StreetMapImpl::StreetMapImpl() {}
-
-StreetMapImpl::~StreetMapImpl() {}
-
+    return std::hash<string>()(s);
+}
 
-bool StreetMapImpl::load(string mapFile)
+  // reads a file in mapdata.txt format, calling onSegment with each segment's coordinate text
+  // and street name in the order the file lists them. Everything that reads map files goes
+  // through this, so they all take the format the same way
+bool readMapFile(string mapFile, const function<void(const string& streetName,
+                                                     const string& startLat, const string& startLon,
+                                                     const string& endLat, const string& endLon)>& onSegment)
 {
     ifstream mapDataFile(mapFile);
     if ( !mapDataFile ) // unable to open file
         return false;
-    
+
     string line;
     int nSegments = 0;
     string sLattitude, sLongitude;
@@ -65,42 +69,7 @@ bool StreetMapImpl::load(string mapFile)
         {
             // get data from line
             iss >> sLattitude >> sLongitude >> eLattitude >> eLongitude;
-            GeoCoord sCoord(sLattitude,sLongitude);
-            GeoCoord eCoord(eLattitude,eLongitude);
-            
-            // add the forward street segment to the vector
-            StreetSegment forward(sCoord,eCoord,streetName);
-            vector<StreetSegment> sCord_vec;
-            sCord_vec.push_back(forward);
-            
-            //check if already another segment starting with sCoord
-            vector<StreetSegment>* sCoordExistingSegment_vec;
-            sCoordExistingSegment_vec = m_Map.find(sCoord);
-            if ( sCoordExistingSegment_vec != nullptr)
-            {
- 
-                for (int i = 0 ; i < (*sCoordExistingSegment_vec).size() ; i++)
-                    sCord_vec.push_back((*sCoordExistingSegment_vec)[i]);
-            }
-            
-            m_Map.associate(sCoord, sCord_vec);
-            
-            // add the backward segment to the vector
-            StreetSegment backward(eCoord,sCoord,streetName);
-            vector<StreetSegment> eCord_vec;
-            eCord_vec.push_back(backward);
-            
-            //check if already an existing segment starting with eCoord
-            vector<StreetSegment>* eCoordExistingSegment_vec;
-            eCoordExistingSegment_vec = m_Map.find(eCoord);
-            if ( eCoordExistingSegment_vec != nullptr)
-            {
-
-                for (int i = 0 ; i < (*eCoordExistingSegment_vec).size() ; i++)
-                    eCord_vec.push_back((*eCoordExistingSegment_vec)[i]);
-            }
-            
-            m_Map.associate(eCoord, eCord_vec);
+            onSegment(streetName, sLattitude, sLongitude, eLattitude, eLongitude);
         
             if ( lineCounter == nSegments)
                 lineCounter = -2;
@@ -110,17 +79,363 @@ bool StreetMapImpl::load(string mapFile)
     return true;
 }
 
+  // reads a file in mapdata.txt format into graph, which is left finished; spanName is a literal
+  // so whole-map and tile loads show up separately in a trace
+static bool readStreets(string mapFile, StreetGraph& graph, const char* spanName)
+{
+    TRACE_SPAN(spanName);
+    ALLOC_SCOPE(ALLOC_MAP);
+    graph.clear();
+    bool read = readMapFile(mapFile, [&graph](const string& streetName, const string& sLat, const string& sLon,
+                                              const string& eLat, const string& eLon) {
+        // the graph keeps both the forward and the backward segment
+        graph.addSegment(GeoCoord(sLat, sLon), GeoCoord(eLat, eLon), streetName);
+    });
+    if ( !read )
+        return false;
+    graph.finish();
+    return true;
+}
+
+class StreetMapImpl
+{
+public:
+    StreetMapImpl();
+    ~StreetMapImpl();
+    bool load(string mapFile);
+    bool loadTiles(string tileDir, int maxResidentTiles);
+    void setGraphPlacement(const GraphPlacement& placement);
+    bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    const StreetGraph* graph() const;
+    const ChainGraph* chains() const;
+    int componentOf(const GeoCoord& gc) const;
+    int residentTileCount() const;
+    int tileLoadCount() const;
+    int tileOf(double latitude, double longitude) const;
+    shared_ptr<const StreetGraph> tileGraph(int t) const;
+    void prefetchTile(int t) const;
+private:
+    shared_ptr<const StreetGraph> tile(int t) const;
+    shared_ptr<const StreetGraph> residentTile(int t) const;
+    shared_ptr<const StreetGraph> loadTile(int t) const;
+    void prefetch(int t) const;
+    void runPrefetcher();
+    void stopPrefetcher();
+    int replica() const;
+
+    StreetGraph m_graph;
+    ChainGraph m_chains;
+
+    // with replicatePerNode, m_graph and m_chains are on node 0 and m_replicas[k - 1] and
+    // m_chainReplicas[k - 1] on node k
+    GraphPlacement m_placement;
+    vector<unique_ptr<StreetGraph>> m_replicas;
+    vector<unique_ptr<ChainGraph>> m_chainReplicas;
+
+    // tiled mode: m_graph stays empty and tiles come and go, most recently used first
+    bool m_tiled;
+    string m_tileDir;
+    TileGrid m_grid;
+    vector<bool> m_tileExists;
+    int m_maxResident;
+    mutable list<pair<int, shared_ptr<const StreetGraph>>> m_resident;
+    mutable int m_tileLoads;
+
+    // tiles the search is about to reach, loaded by a background thread
+    mutable deque<int> m_prefetchQueue;
+    bool m_stopping;
+    thread m_prefetcher;
+
+    mutable mutex m_tileLock;
+    mutable condition_variable m_prefetchReady;
+};
+
+StreetMapImpl::StreetMapImpl()
+{
+    m_tiled = false;
+    m_maxResident = 0;
+    m_tileLoads = 0;
+    m_stopping = false;
+    m_placement.pages = DEFAULT_PAGES;
+    m_placement.replicatePerNode = false;
+}
+
+StreetMapImpl::~StreetMapImpl()
+{
+    stopPrefetcher();
+}
+
+bool StreetMapImpl::load(string mapFile)
+{
+    stopPrefetcher();
+    m_tiled = false;
+    m_resident.clear();
+    m_chains.clear();
+    m_replicas.clear();
+    m_chainReplicas.clear();
+    bool replicate = m_placement.replicatePerNode  &&  numaNodeCount() > 1;
+    {
+        PlacementScope scope(m_placement.pages, replicate ? 0 : -1);
+        if ( !readStreets(mapFile, m_graph, "StreetMap::load") )
+            return false;
+        m_chains.build(m_graph);
+    }
+    if ( replicate )
+    {
+        for ( int node = 1 ; node < numaNodeCount() ; node++ )
+        {
+            PlacementScope scope(m_placement.pages, node);
+            m_replicas.push_back(unique_ptr<StreetGraph>(new StreetGraph));
+            m_replicas.back()->copyFrom(m_graph);
+            m_chainReplicas.push_back(unique_ptr<ChainGraph>(new ChainGraph));
+            m_chainReplicas.back()->build(*m_replicas.back());
+        }
+    }
+    return true;
+}
+
+void StreetMapImpl::setGraphPlacement(const GraphPlacement& placement)
+{
+    m_placement = placement;
+}
+
+bool StreetMapImpl::loadTiles(string tileDir, int maxResidentTiles)
+{
+    stopPrefetcher();
+    m_graph.clear();
+    m_chains.clear();
+    m_replicas.clear();
+    m_chainReplicas.clear();
+    m_resident.clear();
+    m_tileLoads = 0;
+
+    ifstream index(tileDir + "/tiles.txt");
+    string word;
+    if ( !index  ||  !(index >> word >> m_grid.degrees >> m_grid.originLat >> m_grid.originLon >> m_grid.rows >> m_grid.cols)  ||
+         word != "tiles"  ||  m_grid.rows <= 0  ||  m_grid.cols <= 0 )
+    {
+        m_tiled = false;
+        return false;
+    }
+    m_tileExists.assign(m_grid.rows * m_grid.cols, false);
+    int t;
+    while ( index >> t )
+    {
+        if ( t >= 0  &&  t < int(m_tileExists.size()) )
+            m_tileExists[t] = true;
+    }
+
+    m_tiled = true;
+    m_tileDir = tileDir;
+    m_maxResident = maxResidentTiles < 1 ? 1 : maxResidentTiles;
+    m_stopping = false;
+    m_prefetcher = thread(&StreetMapImpl::runPrefetcher, this);
+    return true;
+}
+
+void StreetMapImpl::stopPrefetcher()
+{
+    if ( !m_prefetcher.joinable() )
+        return;
+    {
+        lock_guard<mutex> guard(m_tileLock);
+        m_stopping = true;
+        m_prefetchQueue.clear();
+    }
+    m_prefetchReady.notify_all();
+    m_prefetcher.join();
+}
+
+  // the tile if it's resident, moved to the front; the caller holds m_tileLock
+shared_ptr<const StreetGraph> StreetMapImpl::residentTile(int t) const
+{
+    for ( list<pair<int, shared_ptr<const StreetGraph>>>::iterator it = m_resident.begin() ; it != m_resident.end() ; it++ )
+    {
+        if ( it->first == t )
+        {
+            if ( it != m_resident.begin() )
+                m_resident.splice(m_resident.begin(), m_resident, it);
+            return m_resident.front().second;
+        }
+    }
+    return nullptr;
+}
+
+  // reads the tile without holding the lock, so a prefetch never stalls a lookup of another tile.
+  // If someone else got the same tile in first, theirs wins and ours is dropped
+shared_ptr<const StreetGraph> StreetMapImpl::loadTile(int t) const
+{
+    ALLOC_SCOPE(ALLOC_MAP);
+    shared_ptr<StreetGraph> loaded(new StreetGraph);
+    if ( !readStreets(m_tileDir + "/tile_" + to_string(t) + ".txt", *loaded, "StreetMap::loadTile") )
+        return nullptr;
+
+    lock_guard<mutex> guard(m_tileLock);
+    shared_ptr<const StreetGraph> existing = residentTile(t);
+    if ( existing )
+        return existing;
+    m_tileLoads++;
+    m_resident.push_front(make_pair(t, shared_ptr<const StreetGraph>(loaded)));
+    while ( int(m_resident.size()) > m_maxResident )
+        m_resident.pop_back(); // a caller still using it keeps its own reference
+    return m_resident.front().second;
+}
+
+shared_ptr<const StreetGraph> StreetMapImpl::tile(int t) const
+{
+    {
+        lock_guard<mutex> guard(m_tileLock);
+        shared_ptr<const StreetGraph> resident = residentTile(t);
+        if ( resident )
+            return resident;
+    }
+    return loadTile(t);
+}
+
+void StreetMapImpl::prefetch(int t) const
+{
+    {
+        lock_guard<mutex> guard(m_tileLock);
+        if ( m_stopping  ||  int(m_prefetchQueue.size()) >= m_maxResident )
+            return;
+        for ( size_t i = 0 ; i < m_prefetchQueue.size() ; i++ )
+        {
+            if ( m_prefetchQueue[i] == t )
+                return;
+        }
+        for ( list<pair<int, shared_ptr<const StreetGraph>>>::const_iterator it = m_resident.begin() ; it != m_resident.end() ; it++ )
+        {
+            if ( it->first == t )
+                return;
+        }
+        m_prefetchQueue.push_back(t);
+    }
+    m_prefetchReady.notify_one();
+}
+
+void StreetMapImpl::runPrefetcher()
+{
+    unique_lock<mutex> lock(m_tileLock);
+    for (;;)
+    {
+        m_prefetchReady.wait(lock, [this] { return m_stopping  ||  !m_prefetchQueue.empty(); });
+        if ( m_stopping )
+            return;
+        int t = m_prefetchQueue.front();
+        m_prefetchQueue.pop_front();
+        lock.unlock();
+        loadTile(t);
+        lock.lock();
+    }
+}
+
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    const vector<StreetSegment>* segsPtr = m_Map.find(gc);
-    if ( segsPtr == nullptr )
+    const StreetGraph* graph = m_tiled ? nullptr : this->graph();
+    shared_ptr<const StreetGraph> held;
+    int t = -1;
+    if ( m_tiled )
+    {
+        t = m_grid.tileOf(gc);
+        if ( t == -1  ||  !m_tileExists[t] )
+            return false;
+        held = tile(t);
+        if ( !held )
+            return false;
+        graph = held.get();
+    }
+
+    int node = graph->findNode(gc);
+    if ( node == -1 )
         return false;
     segs.clear();
-    for ( int i = 0 ; i < (*segsPtr).size() ; i++ )
-        segs.push_back( (*segsPtr)[i] );
+    for ( int e = graph->firstEdge(node) ; e < graph->lastEdge(node) ; e++ )
+    {
+        int target = graph->edgeTarget(e);
+        segs.push_back( StreetSegment(gc, graph->coord(target), graph->streetName(graph->edgeName(e))) );
+        // the search will expand the far end soon, so start reading its tile now
+        if ( m_tiled )
+        {
+            int next = m_grid.tileOf(segs.back().end);
+            if ( next != t  &&  next != -1  &&  m_tileExists[next] )
+                prefetch(next);
+        }
+    }
     return true;
 }
 
+  // which copy of the graph is on this thread's NUMA node right now: 0 for m_graph, k for
+  // m_replicas[k - 1]. The copies number nodes and edges alike, so a thread that moves between
+  // two lookups still gets the same answers, only from further away
+int StreetMapImpl::replica() const
+{
+    int node = m_replicas.empty() ? 0 : currentNumaNode();
+    return node > 0  &&  node <= int(m_replicas.size()) ? node : 0;
+}
+
+  // a tiled map has no single graph
+const StreetGraph* StreetMapImpl::graph() const
+{
+    if ( m_tiled )
+        return nullptr;
+    int k = replica();
+    return k == 0 ? &m_graph : m_replicas[k - 1].get();
+}
+
+const ChainGraph* StreetMapImpl::chains() const
+{
+    if ( m_tiled )
+        return nullptr;
+    int k = replica();
+    return k == 0 ? &m_chains : m_chainReplicas[k - 1].get();
+}
+
+  // tiles are labeled on their own, so their component numbers mean nothing across the map
+int StreetMapImpl::componentOf(const GeoCoord& gc) const
+{
+    if ( m_tiled )
+        return -1;
+    const StreetGraph* g = graph();
+    int node = g->findNode(gc);
+    return node == -1 ? -1 : g->component(node);
+}
+
+int StreetMapImpl::residentTileCount() const
+{
+    lock_guard<mutex> guard(m_tileLock);
+    return m_resident.size();
+}
+
+int StreetMapImpl::tileLoadCount() const
+{
+    lock_guard<mutex> guard(m_tileLock);
+    return m_tileLoads;
+}
+
+int StreetMapImpl::tileOf(double latitude, double longitude) const
+{
+    if ( !m_tiled )
+        return 0;
+    int t = m_grid.tileOf(latitude, longitude);
+    return t != -1  &&  m_tileExists[t] ? t : -1;
+}
+
+  // the whole graph is shared without being owned, as the map outlives its routers
+shared_ptr<const StreetGraph> StreetMapImpl::tileGraph(int t) const
+{
+    if ( !m_tiled )
+        return t == 0 ? shared_ptr<const StreetGraph>(shared_ptr<const StreetGraph>(), graph()) : nullptr;
+    if ( t < 0  ||  t >= int(m_tileExists.size())  ||  !m_tileExists[t] )
+        return nullptr;
+    return tile(t);
+}
+
+void StreetMapImpl::prefetchTile(int t) const
+{
+    if ( m_tiled  &&  t >= 0  &&  t < int(m_tileExists.size())  &&  m_tileExists[t] )
+        prefetch(t);
+}
+
 //******************** StreetMap functions ************************************
 
 // These functions simply delegate to StreetMapImpl's functions.
@@ -141,9 +456,59 @@ bool StreetMap::load(string mapFile)
     return m_impl->load(mapFile);
 }
 
+bool StreetMap::loadTiles(string tileDir, int maxResidentTiles)
+{
+    return m_impl->loadTiles(tileDir, maxResidentTiles);
+}
+
+void StreetMap::setGraphPlacement(const GraphPlacement& placement)
+{
+    m_impl->setGraphPlacement(placement);
+}
+
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
 
+const StreetGraph* StreetMap::graph() const
+{
+    return m_impl->graph();
+}
+
+
 
+const ChainGraph* StreetMap::chains() const
+{
+    return m_impl->chains();
+}
+
+int StreetMap::componentOf(const GeoCoord& gc) const
+{
+    return m_impl->componentOf(gc);
+}
+
+int StreetMap::residentTileCount() const
+{
+    return m_impl->residentTileCount();
+}
+
+int StreetMap::tileLoadCount() const
+{
+    return m_impl->tileLoadCount();
+}
+
+int StreetMap::tileOf(double latitude, double longitude) const
+{
+    return m_impl->tileOf(latitude, longitude);
+}
+
+shared_ptr<const StreetGraph> StreetMap::tileGraph(int t) const
+{
+    return m_impl->tileGraph(t);
+}
+
+void StreetMap::prefetchTile(int t) const
+{
+    m_impl->prefetchTile(t);
+}
@@ -0,0 +1,387 @@
+//
+//  StreetNameIndex.cpp
+//  Goober Eats
+//
+
+#include "StreetNameIndex.h"
+#include "StreetGraph.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+  // street kinds as they're often shortened; only a word after the first is taken as one
+static const char* const KIND_ABBREVIATIONS[][2] = {
+    { "blvd", "boulevard" }, { "ave", "avenue" }, { "av", "avenue" }, { "st", "street" },
+    { "rd", "road" }, { "dr", "drive" }, { "ln", "lane" }, { "pl", "place" }, { "ct", "court" },
+    { "ter", "terrace" }, { "cir", "circle" }, { "pkwy", "parkway" }, { "hwy", "highway" },
+    { "fwy", "freeway" }, { "wy", "way" },
+};
+
+  // compass points, shortened at either end of a name
+static const char* const DIRECTION_ABBREVIATIONS[][2] = {
+    { "n", "north" }, { "s", "south" }, { "e", "east" }, { "w", "west" },
+};
+
+static string expand(const string& word, const char* const table[][2], int size)
+{
+    for ( int i = 0 ; i < size ; i++ )
+    {
+        if ( word == table[i][0] )
+            return table[i][1];
+    }
+    return word;
+}
+
+  // lower case, words separated by single spaces, apostrophes and periods dropped,
+  // abbreviations spelled out; the last word only if expandLast, since in a prefix it may be
+  // half typed ("Westwood Pl" on the way to Westwood Plaza)
+static string normalize(const string& name, bool expandLast = true)
+{
+    vector<string> words(1);
+    for ( size_t i = 0 ; i < name.size() ; i++ )
+    {
+        unsigned char c = name[i];
+        if ( isalnum(c) )
+            words.back() += char(tolower(c));
+        else if ( c != '\''  &&  c != '.'  &&  !words.back().empty() )
+            words.push_back("");
+    }
+    if ( words.back().empty() )
+        words.pop_back();
+
+    string key;
+    for ( size_t i = 0 ; i < words.size() ; i++ )
+    {
+        string word = words[i];
+        bool last = i + 1 == words.size();
+        if ( !last  ||  expandLast )
+        {
+            if ( i > 0 )
+                word = expand(word, KIND_ABBREVIATIONS, sizeof(KIND_ABBREVIATIONS) / sizeof(KIND_ABBREVIATIONS[0]));
+            if ( i == 0  ||  last )
+                word = expand(word, DIRECTION_ABBREVIATIONS, sizeof(DIRECTION_ABBREVIATIONS) / sizeof(DIRECTION_ABBREVIATIONS[0]));
+        }
+        if ( i > 0 )
+            key += ' ';
+        key += word;
+    }
+    return key;
+}
+
+  // three letters as one int; names are padded with two spaces in front so their start counts
+static void trigrams(const string& key, vector<int>& grams)
+{
+    grams.clear();
+    string padded = "  " + key;
+    for ( size_t i = 0 ; i + 2 < padded.size() ; i++ )
+        grams.push_back((int((unsigned char)padded[i]) << 16) | (int((unsigned char)padded[i+1]) << 8) | (unsigned char)padded[i+2]);
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end());
+}
+
+  // fewest edits turning query into some prefix of key, or maxEdits + 1 if that's more than maxEdits
+static int prefixDistance(const string& query, const char* key, int keyLength, int maxEdits, vector<int>& row)
+{
+    int q = query.size();
+    row.resize(q + 1);
+    for ( int i = 0 ; i <= q ; i++ )
+        row[i] = i;
+    int best = row[q];
+    for ( int j = 0 ; j < keyLength  &&  best > 0 ; j++ )
+    {
+        int diagonal = row[0];
+        row[0] = j + 1;
+        int smallest = row[0];
+        for ( int i = 1 ; i <= q ; i++ )
+        {
+            int above = row[i];
+            row[i] = min(min(row[i] + 1, row[i-1] + 1), diagonal + (query[i-1] == key[j] ? 0 : 1));
+            diagonal = above;
+            smallest = min(smallest, row[i]);
+        }
+        best = min(best, row[q]);
+        if ( smallest > maxEdits )
+            break;
+    }
+    return min(best, maxEdits + 1);
+}
+
+class StreetNameIndexImpl
+{
+public:
+    StreetNameIndexImpl(const StreetMap* sm);
+    ~StreetNameIndexImpl();
+    void findPrefix(const string& prefix, vector<int>& streets, int maxResults) const;
+    void findFuzzy(const string& text, vector<int>& streets, int maxResults) const;
+    int findStreet(const string& text) const;
+    const string& streetName(int street) const;
+    void segmentsOf(int street, vector<int>& segments) const;
+    bool intersectionsOf(const string& street1, const string& street2, vector<GeoCoord>& corners) const;
+    size_t memoryBytes() const;
+private:
+    const char* key(int i) const { return m_text.data() + m_keyStart[i]; }
+    int keyLength(int i) const { return m_keyStart[i + 1] - m_keyStart[i] - 1; }
+    int lowerBound(const string& key) const;
+    void keysStartingWith(const string& p, int maxResults, vector<int>& keys) const;
+    void cornersOf(int street, vector<int>& nodes) const;
+
+    const StreetGraph* m_graph;
+
+    // normal forms in sorted order, each ended by '\0', and the street each belongs to
+    string m_text;
+    vector<int> m_keyStart;
+    vector<int> m_keyStreet;
+
+    // for each distinct trigram, the sorted positions of the keys containing it
+    vector<int> m_grams;
+    vector<int> m_gramStart;
+    vector<int> m_gramKeys;
+
+    // by street number
+    vector<int> m_segmentStart;
+    vector<int> m_segments;
+};
+
+StreetNameIndexImpl::StreetNameIndexImpl(const StreetMap* sm)
+{
+    m_graph = sm->graph();
+    m_keyStart.push_back(0);
+    m_segmentStart.push_back(0);
+    if ( m_graph == nullptr )
+        return;
+    const StreetGraph& g = *m_graph;
+
+    vector<pair<string, int>> keys;
+    for ( int s = 0 ; s < g.streetNameCount() ; s++ )
+        keys.push_back(make_pair(normalize(g.streetName(s)), s));
+    sort(keys.begin(), keys.end());
+    vector<pair<int, int>> gramKeys;
+    vector<int> grams;
+    for ( size_t i = 0 ; i < keys.size() ; i++ )
+    {
+        m_text += keys[i].first;
+        m_text += '\0';
+        m_keyStart.push_back(m_text.size());
+        m_keyStreet.push_back(keys[i].second);
+        trigrams(keys[i].first, grams);
+        for ( size_t k = 0 ; k < grams.size() ; k++ )
+            gramKeys.push_back(make_pair(grams[k], i));
+    }
+    sort(gramKeys.begin(), gramKeys.end());
+    for ( size_t i = 0 ; i < gramKeys.size() ; i++ )
+    {
+        if ( m_grams.empty()  ||  m_grams.back() != gramKeys[i].first )
+        {
+            m_grams.push_back(gramKeys[i].first);
+            m_gramStart.push_back(i);
+        }
+        m_gramKeys.push_back(gramKeys[i].second);
+    }
+    m_gramStart.push_back(gramKeys.size());
+
+    // a counting sort of the edges by street
+    vector<int> count(g.streetNameCount() + 1, 0);
+    for ( int v = 0 ; v < g.nodeCount() ; v++ )
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+            if ( v <= g.edgeTarget(e) )
+                count[g.edgeName(e) + 1]++;
+    for ( int s = 0 ; s < g.streetNameCount() ; s++ )
+        count[s + 1] += count[s];
+    m_segmentStart = count;
+    m_segments.resize(count.back());
+    for ( int v = 0 ; v < g.nodeCount() ; v++ )
+        for ( int e = g.firstEdge(v) ; e < g.lastEdge(v) ; e++ )
+            if ( v <= g.edgeTarget(e) )
+                m_segments[count[g.edgeName(e)]++] = e;
+}
+
+StreetNameIndexImpl::~StreetNameIndexImpl()
+{
+}
+
+int StreetNameIndexImpl::lowerBound(const string& k) const
+{
+    int low = 0, high = m_keyStreet.size();
+    while ( low < high )
+    {
+        int middle = (low + high) / 2;
+        if ( strcmp(key(middle), k.c_str()) < 0 )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+  // appends the positions of up to maxResults keys starting with p
+void StreetNameIndexImpl::keysStartingWith(const string& p, int maxResults, vector<int>& keys) const
+{
+    int end = int(keys.size()) + maxResults;
+    for ( int i = lowerBound(p) ; i < int(m_keyStreet.size())  &&  int(keys.size()) < end ; i++ )
+    {
+        if ( strncmp(key(i), p.c_str(), p.size()) != 0 )
+            break;
+        keys.push_back(i);
+    }
+}
+
+  // the last word is matched both as typed and spelled out, so "S" finds Sunset Boulevard as well
+  // as South Beverly Drive; keys are in sorted order, so their positions give alphabetical order
+void StreetNameIndexImpl::findPrefix(const string& prefix, vector<int>& streets, int maxResults) const
+{
+    streets.clear();
+    vector<int> keys;
+    string typed = normalize(prefix, false), expanded = normalize(prefix);
+    keysStartingWith(typed, maxResults, keys);
+    if ( expanded != typed )
+        keysStartingWith(expanded, maxResults, keys);
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    for ( int i = 0 ; i < int(keys.size())  &&  i < maxResults ; i++ )
+        streets.push_back(m_keyStreet[keys[i]]);
+}
+
+void StreetNameIndexImpl::findFuzzy(const string& text, vector<int>& streets, int maxResults) const
+{
+    streets.clear();
+    string q = normalize(text);
+    if ( q.empty()  ||  m_keyStreet.empty() )
+        return;
+    int maxEdits = q.size() <= 4 ? 1 : q.size() <= 10 ? 2 : 3;
+
+    // each edit spoils at most three of the query's trigrams, so a name needs to share the rest,
+    // and at least one
+    vector<int> grams;
+    trigrams(q, grams);
+    int needed = max(1, int(grams.size()) - 3 * maxEdits);
+    vector<unsigned short> shared(m_keyStreet.size(), 0);
+    for ( size_t k = 0 ; k < grams.size() ; k++ )
+    {
+        int g = lower_bound(m_grams.begin(), m_grams.end(), grams[k]) - m_grams.begin();
+        if ( g == int(m_grams.size())  ||  m_grams[g] != grams[k] )
+            continue;
+        for ( int i = m_gramStart[g] ; i < m_gramStart[g + 1] ; i++ )
+            shared[m_gramKeys[i]]++;
+    }
+
+    vector<pair<int, int>> found;   // edits, key position
+    vector<int> row;
+    for ( size_t i = 0 ; i < m_keyStreet.size() ; i++ )
+    {
+        if ( shared[i] < needed )
+            continue;
+        int edits = prefixDistance(q, key(i), keyLength(i), maxEdits, row);
+        if ( edits <= maxEdits )
+            found.push_back(make_pair(edits, i));
+    }
+    sort(found.begin(), found.end());
+    for ( int i = 0 ; i < int(found.size())  &&  i < maxResults ; i++ )
+        streets.push_back(m_keyStreet[found[i].second]);
+}
+
+int StreetNameIndexImpl::findStreet(const string& text) const
+{
+    string k = normalize(text);
+    int i = lowerBound(k);
+    if ( i < int(m_keyStreet.size())  &&  k == key(i) )
+        return m_keyStreet[i];
+    vector<int> streets;
+    findFuzzy(text, streets, 1);
+    return streets.empty() ? -1 : streets[0];
+}
+
+const string& StreetNameIndexImpl::streetName(int street) const
+{
+    return m_graph->streetName(street);
+}
+
+void StreetNameIndexImpl::segmentsOf(int street, vector<int>& segments) const
+{
+    segments.assign(m_segments.begin() + m_segmentStart[street], m_segments.begin() + m_segmentStart[street + 1]);
+}
+
+  // every intersection the street touches, sorted
+void StreetNameIndexImpl::cornersOf(int street, vector<int>& nodes) const
+{
+    nodes.clear();
+    for ( int i = m_segmentStart[street] ; i < m_segmentStart[street + 1] ; i++ )
+    {
+        nodes.push_back(m_graph->edgeSource(m_segments[i]));
+        nodes.push_back(m_graph->edgeTarget(m_segments[i]));
+    }
+    sort(nodes.begin(), nodes.end());
+    nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+}
+
+bool StreetNameIndexImpl::intersectionsOf(const string& street1, const string& street2, vector<GeoCoord>& corners) const
+{
+    corners.clear();
+    int s1 = findStreet(street1), s2 = findStreet(street2);
+    if ( s1 == -1  ||  s2 == -1 )
+        return false;
+    vector<int> nodes1, nodes2, both;
+    cornersOf(s1, nodes1);
+    cornersOf(s2, nodes2);
+    set_intersection(nodes1.begin(), nodes1.end(), nodes2.begin(), nodes2.end(), back_inserter(both));
+    for ( size_t i = 0 ; i < both.size() ; i++ )
+        corners.push_back(m_graph->coord(both[i]));
+    return true;
+}
+
+size_t StreetNameIndexImpl::memoryBytes() const
+{
+    return m_text.capacity() + sizeof(int) * (m_keyStart.capacity() + m_keyStreet.capacity() + m_grams.capacity() +
+                                              m_gramStart.capacity() + m_gramKeys.capacity() +
+                                              m_segmentStart.capacity() + m_segments.capacity());
+}
+
+//******************** StreetNameIndex functions ******************************
+
+// These functions simply delegate to StreetNameIndexImpl's functions.
+
+StreetNameIndex::StreetNameIndex(const StreetMap* sm)
+{
+    m_impl = new StreetNameIndexImpl(sm);
+}
+
+StreetNameIndex::~StreetNameIndex()
+{
+    delete m_impl;
+}
+
+void StreetNameIndex::findPrefix(const string& prefix, vector<int>& streets, int maxResults) const
+{
+    m_impl->findPrefix(prefix, streets, maxResults);
+}
+
+void StreetNameIndex::findFuzzy(const string& text, vector<int>& streets, int maxResults) const
+{
+    m_impl->findFuzzy(text, streets, maxResults);
+}
+
+int StreetNameIndex::findStreet(const string& text) const
+{
+    return m_impl->findStreet(text);
+}
+
+const string& StreetNameIndex::streetName(int street) const
+{
+    return m_impl->streetName(street);
+}
+
+void StreetNameIndex::segmentsOf(int street, vector<int>& segments) const
+{
+    m_impl->segmentsOf(street, segments);
+}
+
+bool StreetNameIndex::intersectionsOf(const string& street1, const string& street2, vector<GeoCoord>& corners) const
+{
+    return m_impl->intersectionsOf(street1, street2, corners);
+}
+
+size_t StreetNameIndex::memoryBytes() const
+{
+    return m_impl->memoryBytes();
+}
@@ -0,0 +1,54 @@
+
+#ifndef STREET_NAME_INDEX_INCLUDED
+#define STREET_NAME_INDEX_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <vector>
+
+// StreetNameIndex.h
+
+// Finding streets by what a dispatcher types ("westwood blvd", "Wilshre") rather than by an
+// exact coordinate.
+//
+// Street names are compared in a normal form: lower case, punctuation dropped, and the usual
+// abbreviations spelled out, so "Westwood Blvd." and "Westwood Boulevard" are the same name.
+// The normal forms are kept sorted in one block of text, which answers prefix lookups with a
+// binary search. Fuzzy lookups go through an index of the three-letter pieces of each name:
+// only names sharing a piece with the query get an edit distance worked out, and the distance
+// is to the closest prefix of the name, so a misspelling halfway through typing still matches.
+//
+// A street is identified by its number in the map's name table. Its segments are StreetGraph
+// edge numbers, one per stretch of road: the graph has both directions of each, and this is the
+// one leaving the lower-numbered intersection (StreetGraph::segment(edgeSource(e), e) gives the
+// StreetSegment). Needs a map loaded with StreetMap::load; for a tiled map the index is empty.
+
+class StreetNameIndexImpl;
+
+class StreetNameIndex
+{
+public:
+    StreetNameIndex(const StreetMap* sm);
+    ~StreetNameIndex();
+      // streets whose name starts with prefix, alphabetically. The last word may be half typed,
+      // so it's matched both as it is and spelled out: "Westwood Pl" finds Westwood Place and
+      // Westwood Plaza
+    void findPrefix(const std::string& prefix, std::vector<int>& streets, int maxResults = 10) const;
+      // streets whose name starts with something within a few typos of text, closest first
+    void findFuzzy(const std::string& text, std::vector<int>& streets, int maxResults = 10) const;
+      // the exact name if there is one, or else the closest fuzzy match; -1 if nothing is close
+    int findStreet(const std::string& text) const;
+    const std::string& streetName(int street) const;
+    void segmentsOf(int street, std::vector<int>& segments) const;
+      // where the two streets meet, one coordinate per intersection; false if either name
+      // matches no street
+    bool intersectionsOf(const std::string& street1, const std::string& street2, std::vector<GeoCoord>& corners) const;
+    size_t memoryBytes() const;
+      // We prevent a StreetNameIndex object from being copied or assigned.
+    StreetNameIndex(const StreetNameIndex&) = delete;
+    StreetNameIndex& operator=(const StreetNameIndex&) = delete;
+private:
+    StreetNameIndexImpl* m_impl;
+};
+
+#endif // STREET_NAME_INDEX_INCLUDED
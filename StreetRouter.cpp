@@ -0,0 +1,230 @@
+//
+//  StreetRouter.cpp
+//  Goober Eats
+//
+
+#include "StreetRouter.h"
+#include "RoutingPolicies.h"
+#include "ChainGraph.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+StreetClass classifyStreet(const string& name)
+{
+    size_t space = name.find_last_of(' ');
+    string last = space == string::npos ? name : name.substr(space + 1);
+    if ( last == "Freeway"  ||  last == "Highway"  ||  last == "Expressway"  ||  last == "Fwy"  ||  last == "Hwy" )
+        return FREEWAY;
+    if ( last == "Boulevard"  ||  last == "Blvd" )
+        return ARTERIAL;
+    if ( last == "Avenue"  ||  last == "Ave"  ||  last == "Av"  ||  last == "Street"  ||  last == "St"  ||
+         last == "Road"  ||  last == "Rd" )
+        return COLLECTOR;
+    if ( last == "Walk"  ||  last == "Steps"  ||  last == "Stairs"  ||  last == "Path"  ||  last == "Trail" )
+        return FOOTPATH;
+    return LOCAL_STREET;
+}
+
+template<typename Cost, typename Heuristic, typename OpenSet>
+class PolicyRouter : public StreetRouter
+{
+public:
+    PolicyRouter(const StreetMap* sm, const Cost& cost, const Heuristic& heuristic)
+     : m_streetMap(sm), m_cost(cost), m_heuristic(heuristic), m_deadline(nullptr)
+    {
+    }
+
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+    {
+        TRACE_SPAN("StreetRouter::generatePointToPointRoute");
+        ALLOC_SCOPE(ALLOC_ROUTER);
+        const StreetGraph& g = *m_streetMap->graph();
+        int a = g.findNode(start), b = g.findNode(end);
+        if ( a == -1  ||  b == -1 )
+            return BAD_COORD;
+        if ( g.component(a) != g.component(b) )
+            return NO_ROUTE;
+        route.clear();
+        totalDistanceTravelled = 0;
+        if ( a == b )
+            return DELIVERY_SUCCESS;
+
+        DeliveryResult result = searchStreetGraph(g, a, b, m_cost, m_heuristic, m_scratch, m_edges, m_deadline);
+        if ( result == NO_ROUTE )
+            return NO_ROUTE;
+        int at = a;
+        for ( size_t i = 0 ; i < m_edges.size() ; i++ )
+        {
+            route.push_back(g.segment(at, m_edges[i]));
+            totalDistanceTravelled += g.edgeMiles(m_edges[i]);
+            at = g.edgeTarget(m_edges[i]);
+        }
+        return result;
+    }
+
+    void setDeadline(const Deadline* deadline)
+    {
+        m_deadline = deadline;
+    }
+
+private:
+    const StreetMap* m_streetMap;
+    Cost m_cost;
+    Heuristic m_heuristic;
+    const Deadline* m_deadline;
+    mutable SearchArrays<OpenSet> m_scratch;
+    mutable vector<int> m_edges;
+};
+
+  // a policy router that owns the per-street table its cost policy points into
+template<typename Cost, typename OpenSet>
+class TableRouter : public PolicyRouter<Cost, CrowFliesHeuristic, OpenSet>
+{
+public:
+    TableRouter(const StreetMap* sm, vector<double>& table, Cost cost, double scale)
+     : PolicyRouter<Cost, CrowFliesHeuristic, OpenSet>(sm, cost, CrowFliesHeuristic{ scale })
+    {
+        m_table.swap(table); // the vector's buffer, which cost already points into, moves with it
+    }
+private:
+    vector<double> m_table;
+};
+
+template<typename OpenSet>
+class TurnRouter : public PolicyRouter<TurnPenaltyCost, CrowFliesHeuristic, OpenSet>
+{
+public:
+    TurnRouter(const StreetMap* sm, vector<int>& edgeSource, TurnPenaltyCost cost)
+     : PolicyRouter<TurnPenaltyCost, CrowFliesHeuristic, OpenSet>(sm, cost, CrowFliesHeuristic{ 1 })
+    {
+        m_edgeSource.swap(edgeSource);
+    }
+private:
+    vector<int> m_edgeSource;
+};
+
+  // SHORTEST_DISTANCE over the map's chain graph, which gives the same routes searching far
+  // fewer intersections
+template<typename OpenSet>
+class ChainRouter : public StreetRouter
+{
+public:
+    ChainRouter(const StreetMap* sm) : m_streetMap(sm), m_deadline(nullptr) {}
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+    {
+        TRACE_SPAN("StreetRouter::generatePointToPointRoute");
+        ALLOC_SCOPE(ALLOC_ROUTER);
+        const StreetGraph& g = *m_streetMap->graph();
+        int a = g.findNode(start), b = g.findNode(end);
+        if ( a == -1  ||  b == -1 )
+            return BAD_COORD;
+        if ( g.component(a) != g.component(b) )
+            return NO_ROUTE;
+        route.clear();
+        totalDistanceTravelled = 0;
+        if ( a == b )
+            return DELIVERY_SUCCESS;
+
+        DeliveryResult result = m_streetMap->chains()->route(a, b, m_scratch, m_edges, m_deadline);
+        if ( result == NO_ROUTE )
+            return NO_ROUTE;
+        int at = a;
+        for ( size_t i = 0 ; i < m_edges.size() ; i++ )
+        {
+            route.push_back(g.segment(at, m_edges[i]));
+            totalDistanceTravelled += g.edgeMiles(m_edges[i]);
+            at = g.edgeTarget(m_edges[i]);
+        }
+        return result;
+    }
+    void setDeadline(const Deadline* deadline)
+    {
+        m_deadline = deadline;
+    }
+private:
+    const StreetMap* m_streetMap;
+    const Deadline* m_deadline;
+    mutable SearchArrays<OpenSet> m_scratch;
+    mutable vector<int> m_edges;
+};
+
+  // tiled maps have no StreetGraph to search, so they get the original router
+class GenericRouter : public StreetRouter
+{
+public:
+    GenericRouter(const StreetMap* sm) : m_router(sm) {}
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+    {
+        return m_router.generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+    }
+    void setDeadline(const Deadline* deadline)
+    {
+        m_router.setDeadline(deadline);
+    }
+private:
+    PointToPointRouter m_router;
+};
+
+template<typename OpenSet>
+unique_ptr<StreetRouter> createGraphRouter(const StreetMap* sm, RouteCost cost)
+{
+    const StreetGraph* g = sm->graph();
+    switch ( cost )
+    {
+    case SHORTEST_DISTANCE:
+        if ( sm->chains() != nullptr  &&  sm->chains()->junctionCount() > 0 )
+            return unique_ptr<StreetRouter>(new ChainRouter<OpenSet>(sm));
+        return unique_ptr<StreetRouter>(new PolicyRouter<DistanceCost, CrowFliesHeuristic, OpenSet>(sm, DistanceCost(), CrowFliesHeuristic{ 1 }));
+    case SHORTEST_TIME:
+    {
+        vector<double> minutesPerMile(g->streetNameCount());
+        for ( size_t i = 0 ; i < minutesPerMile.size() ; i++ )
+            minutesPerMile[i] = 60 / CLASS_SPEED_MPH[classifyStreet(g->streetName(i))];
+        TravelTimeCost timeCost = { minutesPerMile.data() };
+        return unique_ptr<StreetRouter>(new TableRouter<TravelTimeCost, OpenSet>(sm, minutesPerMile, timeCost, 60 / CLASS_SPEED_MPH[FREEWAY]));
+    }
+    case TURN_PENALIZED:
+    {
+        vector<int> edgeSource(g->edgeCount());
+        for ( int v = 0 ; v < g->nodeCount() ; v++ )
+            for ( int e = g->firstEdge(v) ; e < g->lastEdge(v) ; e++ )
+                edgeSource[e] = v;
+        TurnPenaltyCost turnCost = { edgeSource.data() };
+        return unique_ptr<StreetRouter>(new TurnRouter<OpenSet>(sm, edgeSource, turnCost));
+    }
+    case AVOID_HIGHWAYS:
+    {
+        vector<double> factor(g->streetNameCount());
+        for ( size_t i = 0 ; i < factor.size() ; i++ )
+            factor[i] = classifyStreet(g->streetName(i)) == FREEWAY ? HIGHWAY_AVOIDANCE_FACTOR : 1;
+        AvoidHighwayCost avoidCost = { factor.data() };
+        return unique_ptr<StreetRouter>(new TableRouter<AvoidHighwayCost, OpenSet>(sm, factor, avoidCost, 1));
+    }
+    }
+    return nullptr;
+}
+
+unique_ptr<StreetRouter> createRouter(const StreetMap* sm, RouteCost cost, OpenSetKind open)
+{
+    if ( sm->graph() == nullptr )
+        return unique_ptr<StreetRouter>(cost == SHORTEST_DISTANCE ? new GenericRouter(sm) : nullptr);
+    if ( open == RADIX_HEAP )
+        return createGraphRouter<RadixHeap>(sm, cost);
+    return createGraphRouter<QuaternaryHeap>(sm, cost);
+}
@@ -0,0 +1,58 @@
+
+#ifndef STREET_ROUTER_INCLUDED
+#define STREET_ROUTER_INCLUDED
+
+#include "provided.h"
+#include "Deadline.h"
+#include <list>
+#include <memory>
+
+// StreetRouter.h
+
+// Routers for different vehicles, picked at run time. Each kind is its own instantiation of the
+// search in RoutingPolicies.h, so the choice costs one virtual call per route and nothing per
+// street looked at.
+//
+//   SHORTEST_DISTANCE      fewest miles, as PointToPointRouter, searched over the map's ChainGraph
+//   SHORTEST_TIME          fewest minutes, driving each street at the typical speed of its kind
+//   TURN_PENALIZED         fewest miles, counting each turn as a little extra distance
+//   AVOID_HIGHWAYS         fewest miles, counting freeway miles ten times over
+//
+// totalDistanceTravelled is always in miles, whatever the route was chosen by. A router keeps
+// its search arrays between calls, so use one per thread. On a tiled map only
+// SHORTEST_DISTANCE is available (through PointToPointRouter); createRouter returns nullptr
+// for the others. Every router heeds a Deadline given with setDeadline() the way
+// PointToPointRouter does: past it, the search finishes greedily and the route comes back with
+// DEADLINE_EXCEEDED, costing no more than DEADLINE_ROUTE_WEIGHT times the cheapest.
+//
+// The open set of the search is picked the same way (see OpenSet.h):
+//
+//   INDEXED_HEAP           a 4-ary heap that lowers a waiting intersection's key in place
+//   RADIX_HEAP             buckets by the bits of whole millionths of a mile or minute; cheaper
+//                          per push and pop, at the price of rounding keys to a millionth
+
+enum RouteCost : int
+{
+    SHORTEST_DISTANCE, SHORTEST_TIME, TURN_PENALIZED, AVOID_HIGHWAYS
+};
+
+enum OpenSetKind
+{
+    INDEXED_HEAP, RADIX_HEAP
+};
+
+class StreetRouter
+{
+public:
+    virtual ~StreetRouter() {}
+    virtual DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled) const = 0;
+    virtual void setDeadline(const Deadline* /* deadline */) {}
+};
+
+std::unique_ptr<StreetRouter> createRouter(const StreetMap* sm, RouteCost cost, OpenSetKind open = INDEXED_HEAP);
+
+#endif // STREET_ROUTER_INCLUDED
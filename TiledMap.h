@@ -0,0 +1,46 @@
+
+#ifndef TILED_MAP_INCLUDED
+#define TILED_MAP_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <cmath>
+
+// TiledMap.h
+
+// A map file cut into a grid of square tiles, so a StreetMap can load only the area a search
+// actually touches (see StreetMap::loadTiles).
+//
+// tileMap() writes, into outDir:
+//   tiles.txt        "tiles <degrees> <origin lat> <origin lon> <rows> <cols>", then the
+//                    number of every tile that has streets, one per line
+//   tile_<k>.txt     every street with at least one end in tile k, in mapdata.txt format and
+//                    in the order the map file lists them
+//
+// A street crossing a tile edge is written to both tiles. That way every street starting at a
+// coordinate is found in that coordinate's own tile, in the same order a full load gives.
+
+struct TileGrid
+{
+    double degrees;
+    double originLat, originLon;    // south-west corner of tile 0
+    int rows, cols;
+
+      // -1 outside the grid
+    int tileOf(double latitude, double longitude) const
+    {
+        double row = std::floor((latitude - originLat) / degrees);
+        double col = std::floor((longitude - originLon) / degrees);
+        if ( row < 0  ||  row >= rows  ||  col < 0  ||  col >= cols )
+            return -1;
+        return int(row) * cols + int(col);
+    }
+
+    int tileOf(const GeoCoord& g) const { return tileOf(g.latitude, g.longitude); }
+};
+
+const double DEFAULT_TILE_DEGREES = 0.02;     // about 1.4 by 1.1 miles around Los Angeles
+
+bool tileMap(std::string mapFile, std::string outDir, double tileDegrees = DEFAULT_TILE_DEGREES);
+
+#endif // TILED_MAP_INCLUDED
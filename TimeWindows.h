@@ -0,0 +1,69 @@
+
+#ifndef TIME_WINDOWS_INCLUDED
+#define TIME_WINDOWS_INCLUDED
+
+#include <algorithm>
+#include <limits>
+
+// TimeWindows.h
+
+// Summary of a run of consecutive stops, so that two runs can be joined in constant time
+// instead of replaying the route stop by stop. A tour keeps one of these for every prefix
+// (forward) and every suffix (backward); a 2-opt or insertion move is then checked by joining
+// a prefix, the changed middle and a suffix.
+//
+// All times are in minutes. earliest/latest bound when service may start at the first stop of
+// the run so that the rest of the run goes through without waiting past its windows; timeWarp
+// is how late the run is forced to be in total, and is zero exactly when the run is feasible.
+
+struct ScheduleSegment
+{
+    double duration;   // travel + service + unavoidable waiting
+    double timeWarp;   // total lateness that cannot be avoided
+    double earliest;
+    double latest;
+};
+
+inline ScheduleSegment scheduleForStop(double earliest, double latest, double service)
+{
+    ScheduleSegment s;
+    s.duration = service;
+    s.timeWarp = 0;
+    s.earliest = earliest;
+    s.latest = latest;
+    return s;
+}
+
+  // the run a, then travel minutes of driving, then the run b
+inline ScheduleSegment concatenate(const ScheduleSegment& a, double travel, const ScheduleSegment& b)
+{
+    double delta = a.duration - a.timeWarp + travel;
+    double wait = std::max(b.earliest - delta - a.latest, 0.0);
+    double warp = std::max(a.earliest + delta - b.latest, 0.0);
+
+    ScheduleSegment s;
+    s.duration = a.duration + b.duration + travel + wait;
+    s.timeWarp = a.timeWarp + b.timeWarp + warp;
+    s.earliest = std::max(b.earliest - delta, a.earliest) - wait;
+    s.latest = std::min(b.latest - delta, a.latest) + warp;
+    return s;
+}
+
+const double TIME_WARP_TOLERANCE = 1e-9;
+
+// typical city driving, used to turn miles into minutes for time windows
+const double DEFAULT_AVERAGE_SPEED_MPH = 20;
+
+  // the travel model every time-window check uses, so the optimizer and plan insertion agree on
+  // what's feasible: the crow-flies miles between two stops, driven at an average speed
+inline double travelMinutes(double crowMiles, double milesPerHour)
+{
+    return crowMiles / milesPerHour * 60;
+}
+
+inline bool isFeasible(const ScheduleSegment& s)
+{
+    return s.timeWarp <= TIME_WARP_TOLERANCE;
+}
+
+#endif // TIME_WINDOWS_INCLUDED
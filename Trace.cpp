@@ -0,0 +1,146 @@
+//
+//  Trace.cpp
+//  Goober Eats
+//
+
+#include "Trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+
+using namespace std;
+
+// spans each thread can hold; 24 bytes each, so 1.5 MB per thread that traces anything
+const size_t TRACE_BUFFER_SPANS = 65536;
+
+atomic<bool> g_tracingEnabled(false);
+static atomic<unsigned int> g_traceGeneration(0);     // one more for every startTracing
+
+struct TraceEvent
+{
+    const char* name;
+    long long start;
+    long long end;
+};
+
+// written only by its own thread. count is published with release ordering after the event is
+// filled in, so writeTrace can read the buffer while the thread is still going. startTracing
+// never touches a buffer: the thread itself empties it when its next span finds the generation
+// has moved on, and until then writeTrace skips it as belonging to an earlier trace
+struct TraceBuffer
+{
+    int thread;
+    vector<TraceEvent> events;
+    atomic<unsigned int> generation;
+    atomic<size_t> count;
+    atomic<size_t> dropped;
+};
+
+static mutex g_bufferLock;                              // only for registering a new thread
+static vector<shared_ptr<TraceBuffer>> g_buffers;
+static const chrono::steady_clock::time_point g_traceEpoch = chrono::steady_clock::now();
+
+  // the calling thread's buffer, created on its first span; the list keeps it after the thread ends
+static TraceBuffer& threadBuffer()
+{
+    thread_local shared_ptr<TraceBuffer> buffer;
+    if ( !buffer )
+    {
+        buffer.reset(new TraceBuffer);
+        buffer->events.resize(TRACE_BUFFER_SPANS);
+        buffer->generation = g_traceGeneration.load() - 1; // emptied by its first span
+        buffer->count = 0;
+        buffer->dropped = 0;
+        lock_guard<mutex> guard(g_bufferLock);
+        buffer->thread = g_buffers.size() + 1;
+        g_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+long long TraceSpan::traceClock()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - g_traceEpoch).count();
+}
+
+void TraceSpan::record(const char* name, long long start, long long end)
+{
+    TraceBuffer& buffer = threadBuffer();
+    unsigned int generation = g_traceGeneration.load(memory_order_acquire);
+    if ( buffer.generation.load(memory_order_relaxed) != generation )
+    {
+        buffer.count.store(0, memory_order_relaxed);
+        buffer.dropped.store(0, memory_order_relaxed);
+        buffer.generation.store(generation, memory_order_release);
+    }
+    size_t n = buffer.count.load(memory_order_relaxed);
+    if ( n == buffer.events.size() )
+    {
+        buffer.dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    buffer.events[n].name = name;
+    buffer.events[n].start = start;
+    buffer.events[n].end = end;
+    buffer.count.store(n + 1, memory_order_release);
+}
+
+  // spans already recorded stay until the next startTracing, which drops them
+void startTracing()
+{
+    g_traceGeneration.fetch_add(1, memory_order_release);
+    g_tracingEnabled = true;
+}
+
+void stopTracing()
+{
+    g_tracingEnabled = false;
+}
+
+static void writeJsonString(ostream& out, const char* s)
+{
+    out << '"';
+    for ( ; *s != '\0' ; s++ )
+    {
+        if ( *s == '"'  ||  *s == '\\' )
+            out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+  // "X" (complete) events, with microsecond timestamps as the format wants
+bool writeTrace(string traceFile)
+{
+    ofstream out(traceFile);
+    if ( !out )
+        return false;
+    out.setf(ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    size_t dropped = 0;
+    unsigned int generation = g_traceGeneration.load(memory_order_acquire);
+    lock_guard<mutex> guard(g_bufferLock);
+    for ( size_t b = 0 ; b < g_buffers.size() ; b++ )
+    {
+        const TraceBuffer& buffer = *g_buffers[b];
+        if ( buffer.generation.load(memory_order_acquire) != generation )
+            continue;
+        size_t n = buffer.count.load(memory_order_acquire);
+        dropped += buffer.dropped.load(memory_order_relaxed);
+        for ( size_t i = 0 ; i < n ; i++ )
+        {
+            const TraceEvent& e = buffer.events[i];
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            writeJsonString(out, e.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.thread << ",\"ts\":" << e.start / 1000.0
+                << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n],\"otherData\":{\"droppedSpans\":" << dropped << "}}\n";
+    return bool(out);
+}
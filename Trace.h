@@ -0,0 +1,56 @@
+
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include <atomic>
+#include <string>
+
+// Trace.h
+
+// Timing of the phases of a run, written as Chrome trace-event JSON (load it in chrome://tracing
+// or ui.perfetto.dev).
+//
+// TRACE_SPAN("name") times the rest of the enclosing block. While tracing is off that is one
+// relaxed atomic load. While it's on, each thread appends to a buffer of its own, so spans on
+// different threads never wait for each other; a thread that fills its buffer drops the rest of
+// its spans and the count of dropped spans goes into the file. Names must be string literals
+// (or otherwise outlive the trace), since only the pointer is kept.
+//
+// startTracing and stopTracing can be called while other threads are in spans; a restart drops
+// what was recorded before it. writeTrace can run while threads are still recording, but not at
+// the same time as a startTracing.
+
+extern std::atomic<bool> g_tracingEnabled;
+
+void startTracing();
+void stopTracing();
+bool writeTrace(std::string traceFile);
+
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name)
+    {
+        m_name = g_tracingEnabled.load(std::memory_order_relaxed) ? name : nullptr;
+        m_start = m_name != nullptr ? traceClock() : 0;
+    }
+    ~TraceSpan()
+    {
+        if ( m_name != nullptr )
+            record(m_name, m_start, traceClock());
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    static long long traceClock();      // monotonic nanoseconds
+    static void record(const char* name, long long start, long long end);
+
+    const char* m_name;
+    long long m_start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_INCLUDED
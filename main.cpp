@@ -1,32 +1,220 @@
 
 
 #include "provided.h"
+#include "Polyline.h"
+#include "RegionalMap.h"
+#include "StreetGraph.h"
+#include "TiledMap.h"
+#include "HubLabels.h"
+#include "ServiceArea.h"
+#include "NearestSource.h"
+#include "StreetRouter.h"
+#include "ChainGraph.h"
+#include "RoutingPolicies.h"
+#include "DepotTrees.h"
+#include "LoadGenerator.h"
+#include "StreetNameIndex.h"
+#include "Deadline.h"
+#include "Trace.h"
+#include "AllocStats.h"
+#include "GraphMemory.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
 using namespace std;
 
 
 bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
 bool parseDelivery(string line, string& lat, string& lon, string& item);
+bool writePolyline(string polylineFile, const DeliveryPlan& plan);
+int benchmarkHubLabels(string mapFile, string labelFile, bool withPaths);
+int benchmarkRouters(string mapFile, int pairs);
+int buildDepotTrees(string mapFile, string depotsFile, string treeFile);
+int generateLoad(int argc, char* argv[]);
+int searchStreets(string mapFile, string text, string crossStreet);
+int benchmarkReroutes(string mapFile, string deliveriesFile, int reroutes);
+int benchmarkPlacement(string mapFile, int threads, int trees);
+int checkNearestSources(string mapFile, int sources, int orders, int threads);
+int benchmarkRegional(string mapFile, string partitionDir, int pairs, int residentCells);
+
+  // prints each leg's commands the moment the plan hands them over
+class PrintingSink : public DeliveryCommandSink
+{
+public:
+    PrintingSink() : m_start(chrono::steady_clock::now()), m_firstLegMillis(-1) {}
+    void legRouted(int leg, const vector<DeliveryCommand>& commands, double /* legDistance */)
+    {
+        ALLOC_SCOPE(ALLOC_OUTPUT);
+        if (leg == 0)
+        {
+            m_firstLegMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - m_start).count();
+            cout << "Starting at the depot...\n";
+        }
+        for (const auto& dc : commands)
+            cout << dc.description() << endl;
+    }
+    double firstLegMillis() const { return m_firstLegMillis; }
+    double millisSoFar() const { return chrono::duration<double, milli>(chrono::steady_clock::now() - m_start).count(); }
+private:
+    chrono::steady_clock::time_point m_start;
+    double m_firstLegMillis;
+};
 
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    if (argc >= 4 && string(argv[1]) == "--partition")
     {
-        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt" << endl;
+        int cellNodes = argc >= 5 ? atoi(argv[4]) : 2000;
+        if (!partitionMap(argv[2], argv[3], cellNodes))
+        {
+            cout << "Unable to partition map data file " << argv[2] << " into " << argv[3] << endl;
+            return 1;
+        }
+        cout << "Partitioned " << argv[2] << " into " << argv[3] << endl;
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--tile")
+    {
+        double tileDegrees = argc >= 5 ? atof(argv[4]) : DEFAULT_TILE_DEGREES;
+        if (!tileMap(argv[2], argv[3], tileDegrees))
+        {
+            cout << "Unable to tile map data file " << argv[2] << " into " << argv[3] << endl;
+            return 1;
+        }
+        cout << "Tiled " << argv[2] << " into " << argv[3] << endl;
+        return 0;
+    }
+
+    if (argc >= 4 && string(argv[1]) == "--hub-labels")
+        return benchmarkHubLabels(argv[2], argv[3], argc >= 5 && string(argv[4]) == "paths");
+
+    if (argc >= 3 && string(argv[1]) == "--route-bench")
+        return benchmarkRouters(argv[2], argc >= 4 ? atoi(argv[3]) : 200);
+
+    if (argc >= 5 && string(argv[1]) == "--depot-trees")
+        return buildDepotTrees(argv[2], argv[3], argv[4]);
+
+    if (argc >= 3 && string(argv[1]) == "--load-test")
+        return generateLoad(argc, argv);
+
+    if (argc >= 4 && string(argv[1]) == "--street-search")
+        return searchStreets(argv[2], argv[3], argc >= 5 ? argv[4] : "");
+
+    if (argc >= 4 && string(argv[1]) == "--reroute-bench")
+        return benchmarkReroutes(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 1000);
+
+    if (argc >= 3 && string(argv[1]) == "--placement-bench")
+        return benchmarkPlacement(argv[2], argc >= 4 ? atoi(argv[3]) : thread::hardware_concurrency(),
+                                  argc >= 5 ? atoi(argv[4]) : 200);
+
+    if (argc >= 4 && string(argv[1]) == "--regional")
+        return benchmarkRegional(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 200, argc >= 6 ? atoi(argv[5]) : 4);
+
+    if (argc >= 3 && string(argv[1]) == "--nearest")
+        return checkNearestSources(argv[2], argc >= 4 ? atoi(argv[3]) : 8, argc >= 5 ? atoi(argv[4]) : 200,
+                                   argc >= 6 ? atoi(argv[5]) : thread::hardware_concurrency());
+
+    string polylineFile;
+    bool memoryReport = false;
+    bool tiled = false; // argv[1] is a tile directory rather than a map file
+    int residentTiles = 0; // 0 for loadTiles' default
+    double serviceMiles = -1;
+    string traceFile;
+    string treeFile;
+    double deadlineMillis = 0;
+    bool allocReport = false;
+    bool stream = false;
+    RouteCost routeCost = SHORTEST_DISTANCE;
+    for (int i = 3; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--polyline" && i + 1 < argc)
+            polylineFile = argv[++i];
+        else if (option == "--memory-report")
+            memoryReport = true;
+        else if (option == "--tiled")
+        {
+            tiled = true;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                residentTiles = atoi(argv[++i]);
+        }
+        else if (option == "--service-area" && i + 1 < argc)
+            serviceMiles = atof(argv[++i]);
+        else if (option == "--trace" && i + 1 < argc)
+            traceFile = argv[++i];
+        else if (option == "--depot-trees" && i + 1 < argc)
+            treeFile = argv[++i];
+        else if (option == "--deadline" && i + 1 < argc && atof(argv[i + 1]) > 0)
+            deadlineMillis = atof(argv[++i]);
+        else if (option == "--alloc-stats")
+            allocReport = true;
+        else if (option == "--stream")
+            stream = true;
+        else if (option == "--route-cost" && i + 1 < argc)
+        {
+            string kind = argv[++i];
+            if (kind == "distance")
+                routeCost = SHORTEST_DISTANCE;
+            else if (kind == "time")
+                routeCost = SHORTEST_TIME;
+            else if (kind == "turns")
+                routeCost = TURN_PENALIZED;
+            else if (kind == "no-highways")
+                routeCost = AVOID_HIGHWAYS;
+            else
+                argc = 0;
+        }
+        else
+            argc = 0; // fall into the usage message
+    }
+    if (argc < 3)
+    {
+        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt [--polyline route.bin] [--memory-report] [--trace trace.json] [--alloc-stats] [--depot-trees trees.spt] [--deadline ms] [--stream] [--route-cost distance|time|turns|no-highways]" << endl;
+        cout << "       " << argv[0] << " mapdata.txt deliveries.txt --service-area miles" << endl;
+        cout << "       " << argv[0] << " tiledir deliveries.txt --tiled [resident tiles] [...]" << endl;
+        cout << "       " << argv[0] << " --partition mapdata.txt outdir [nodes per cell]" << endl;
+        cout << "       " << argv[0] << " --tile mapdata.txt outdir [tile degrees]" << endl;
+        cout << "       " << argv[0] << " --hub-labels mapdata.txt labels.bin [paths]" << endl;
+        cout << "       " << argv[0] << " --route-bench mapdata.txt [pairs]" << endl;
+        cout << "       " << argv[0] << " --depot-trees mapdata.txt depots.txt trees.spt" << endl;
+        cout << "       " << argv[0] << " --load-test mapdata.txt [threads] [requests/s] [requests] [seed] [min stops] [max stops] [clustered fraction] [cluster miles] [deadline ms]" << endl;
+        cout << "       " << argv[0] << " --street-search mapdata.txt \"street name\" [\"cross street\"]" << endl;
+        cout << "       " << argv[0] << " --reroute-bench mapdata.txt deliveries.txt [reroutes]" << endl;
+        cout << "       " << argv[0] << " --placement-bench mapdata.txt [threads] [trees]" << endl;
+        cout << "       " << argv[0] << " --nearest mapdata.txt [sources] [orders] [threads]" << endl;
+        cout << "       " << argv[0] << " --regional mapdata.txt partitiondir [pairs] [resident cells]" << endl;
         return 1;
     }
 
+    if (!traceFile.empty())
+        startTracing();
+
     StreetMap sm;
         
-    if (!sm.load(argv[1]))
+    bool loaded;
+    if (!tiled)
+        loaded = sm.load(argv[1]);
+    else if (residentTiles > 0)
+        loaded = sm.loadTiles(argv[1], residentTiles);
+    else
+        loaded = sm.loadTiles(argv[1]);
+    if (!loaded)
     {
         cout << "Unable to load map data file " << argv[1] << endl;
         return 1;
     }
+    if (memoryReport && sm.graph() != nullptr)
+    {
+        sm.graph()->memoryReport(cout);
+        sm.chains()->report(cout);
+    }
 
     GeoCoord depot;
     vector<DeliveryRequest> deliveries;
@@ -36,12 +224,42 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (serviceMiles >= 0)
+    {
+        ServiceArea area(&sm);
+        vector<GeoCoord> addresses;
+        vector<bool> within;
+        for (const auto& d : deliveries)
+            addresses.push_back(d.location);
+        if (area.checkAddresses(depot, serviceMiles, addresses, within) != DELIVERY_SUCCESS)
+        {
+            cout << "The depot coordinate is invalid." << endl;
+            return 1;
+        }
+        for (size_t i = 0; i < deliveries.size(); i++)
+            cout << (within[i] ? "IN   " : "OUT  ") << deliveries[i].item << endl;
+        return 0;
+    }
+
     cout << "Generating route...\n\n";
 
-    DeliveryPlanner dp(&sm);
-    vector<DeliveryCommand> dcs;
-    double totalMiles;
-    DeliveryResult result = dp.generateDeliveryPlan(depot, deliveries, dcs, totalMiles);
+    DepotTrees trees(&sm);
+    DeliveryPlan plan(&sm);
+    if (!treeFile.empty())
+    {
+        if (!trees.load(treeFile))
+        {
+            cout << "Unable to load depot tree file " << treeFile << endl;
+            return 1;
+        }
+        plan.useDepotTrees(&trees);
+    }
+    Deadline deadline(deadlineMillis);
+    if (deadlineMillis > 0)
+        plan.setDeadline(&deadline);
+    plan.setRouteCost(routeCost);
+    PrintingSink sink;
+    DeliveryResult result = plan.generate(depot, deliveries, stream ? &sink : nullptr);
     if (result == BAD_COORD)
     {
         cout << "One or more depot or delivery coordinates are invalid." << endl;
@@ -52,13 +270,57 @@ int main(int argc, char *argv[])
         cout << "No route can be found to deliver all items." << endl;
         return 1;
     }
-    cout << "Starting at the depot...\n";
-    for (const auto& dc : dcs)
-        cout << dc.description() << endl;
-    cout << "You are back at the depot and your deliveries are done!\n";
-    cout.setf(ios::fixed);
-    cout.precision(2);
-    cout << totalMiles << " miles travelled for all deliveries." << endl;
+    if (result == TIME_WINDOW_VIOLATION)
+    {
+        cout << "No delivery order meets every delivery's time window." << endl;
+        return 1;
+    }
+    if (result == DEADLINE_EXCEEDED && !stream)
+        cout << "Out of time after " << deadlineMillis << " ms; this is the best plan found so far.\n\n";
+    {
+        TRACE_SPAN("output");
+        ALLOC_SCOPE(ALLOC_OUTPUT);
+        const vector<DeliveryCommand>& dcs = plan.commands();
+        double totalMiles = plan.totalDistanceTravelled();
+        if (!stream)
+        {
+            cout << "Starting at the depot...\n";
+            for (const auto& dc : dcs)
+                cout << dc.description() << endl;
+        }
+        cout << "You are back at the depot and your deliveries are done!\n";
+        cout.setf(ios::fixed);
+        cout.precision(2);
+        cout << totalMiles << " miles travelled for all deliveries." << endl;
+    }
+    if (stream)
+    {
+        if (result == DEADLINE_EXCEEDED)
+            cout << "Out of time after " << deadlineMillis << " ms; that was the best plan found so far." << endl;
+        cout << "First leg's commands after " << sink.firstLegMillis() << " ms, the whole plan after "
+             << sink.millisSoFar() << " ms." << endl;
+    }
+    if (memoryReport && tiled)
+        cout << sm.tileLoadCount() << " tile loads, " << sm.residentTileCount() << " tiles resident." << endl;
+
+    if (!polylineFile.empty() && !writePolyline(polylineFile, plan))
+    {
+        cout << "Unable to write polyline file " << polylineFile << endl;
+        return 1;
+    }
+
+    if (allocReport)
+        writeAllocationReport(cout);
+
+    if (!traceFile.empty())
+    {
+        stopTracing();
+        if (!writeTrace(traceFile))
+        {
+            cout << "Unable to write trace file " << traceFile << endl;
+            return 1;
+        }
+    }
 }
 
 bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v)
@@ -104,3 +366,645 @@ bool parseDelivery(string line, string& lat, string& lon, string& item)
     return true;
 }
 
+
+bool writePolyline(string polylineFile, const DeliveryPlan& plan)
+{
+    ALLOC_SCOPE(ALLOC_OUTPUT);
+    vector<unsigned char> encoded;
+    encodePlan(plan, encoded);
+    ofstream outf(polylineFile, ios::binary);
+    if (!outf)
+        return false;
+    outf.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+      // what the same segments cost as text: both coordinates and the street name
+    size_t textBytes = 0;
+    for (int leg = 0; leg < plan.legCount(); leg++)
+    {
+        for (const auto& seg : plan.legRoute(leg))
+            textBytes += seg.start.latitudeText.size() + seg.start.longitudeText.size() +
+                         seg.end.latitudeText.size() + seg.end.longitudeText.size() + seg.name.size() + 5;
+    }
+    cout << "Wrote " << encoded.size() << " byte polyline to " << polylineFile
+         << " (" << textBytes << " bytes as text)." << endl;
+    return bool(outf);
+}
+
+  // builds and saves the labels, then times them against PointToPointRouter on random pairs
+int benchmarkHubLabels(string mapFile, string labelFile, bool withPaths)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    HubLabels labels(&sm);
+    auto t0 = chrono::steady_clock::now();
+    labels.build(withPaths);
+    double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    if (!labels.save(labelFile) || !labels.load(labelFile))
+    {
+        cout << "Unable to write hub label file " << labelFile << endl;
+        return 1;
+    }
+    cout.setf(ios::fixed);
+    cout.precision(2);
+    cout << "Built labels in " << buildSeconds << " s, " << labels.averageLabelSize() << " hubs per intersection" << endl;
+
+    const StreetGraph* g = sm.graph();
+    mt19937 rng(2020);
+    const int PAIRS = 100000, ROUTED = 200;
+    vector<GeoCoord> from, to;
+    for (int i = 0; i < PAIRS; i++)
+    {
+        from.push_back(g->coord(rng() % g->nodeCount()));
+        to.push_back(g->coord(rng() % g->nodeCount()));
+    }
+
+    double sum = 0, miles;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < PAIRS; i++)
+        if (labels.distance(from[i], to[i], miles) == DELIVERY_SUCCESS)
+            sum += miles;
+    double labelMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / PAIRS;
+
+    PointToPointRouter router(&sm);
+    int agree = 0, labelShorter = 0, routeMismatch = 0;
+    list<StreetSegment> route;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < ROUTED; i++)
+    {
+        double routed;
+        if (router.generatePointToPointRoute(from[i], to[i], route, routed) != DELIVERY_SUCCESS ||
+            labels.distance(from[i], to[i], miles) != DELIVERY_SUCCESS)
+            continue;
+        if (abs(miles - routed) < 1e-4)
+            agree++;
+        else if (miles < routed)
+            labelShorter++;
+    }
+    double routerMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / ROUTED;
+
+    if (withPaths)
+    {
+        for (int i = 0; i < ROUTED; i++)
+        {
+            double unpacked;
+            if (labels.generatePointToPointRoute(from[i], to[i], route, unpacked) == DELIVERY_SUCCESS &&
+                labels.distance(from[i], to[i], miles) == DELIVERY_SUCCESS && abs(unpacked - miles) > 1e-4)
+                routeMismatch++;
+        }
+    }
+
+    cout << "Hub labels: " << labelMicros << " us per distance (checksum " << sum << ")" << endl;
+    cout << "Router:     " << routerMicros << " us per route" << endl;
+    cout << agree << " of " << ROUTED << " distances match the router, " << labelShorter << " shorter" << endl;
+    if (withPaths)
+        cout << routeMismatch << " unpacked routes differ from their distance" << endl;
+    return 0;
+}
+
+  // times each router kind on the same random pairs, and checks the templated shortest-distance
+  // router against PointToPointRouter
+int benchmarkRouters(string mapFile, int pairs)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    const StreetGraph* g = sm.graph();
+    mt19937 rng(2020);
+    vector<GeoCoord> from, to;
+    for (int i = 0; i < pairs; i++)
+    {
+        from.push_back(g->coord(rng() % g->nodeCount()));
+        to.push_back(g->coord(rng() % g->nodeCount()));
+    }
+
+    cout.setf(ios::fixed);
+    cout.precision(3);
+    PointToPointRouter handWritten(&sm);
+    vector<double> reference(pairs, -1);
+    list<StreetSegment> route;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < pairs; i++)
+        if (handWritten.generatePointToPointRoute(from[i], to[i], route, reference[i]) != DELIVERY_SUCCESS)
+            reference[i] = -1;
+    double handMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / pairs;
+    cout << "PointToPointRouter   " << handMillis << " ms per route" << endl;
+
+    const char* names[] = { "SHORTEST_DISTANCE", "SHORTEST_TIME", "TURN_PENALIZED", "AVOID_HIGHWAYS" };
+    const char* openSets[] = { "indexed heap", "radix heap" };
+    double chainMillis = 0;
+    for (int kind = SHORTEST_DISTANCE; kind <= AVOID_HIGHWAYS; kind++)
+    {
+        vector<double> indexedMiles(pairs, -1);
+        for (int open = INDEXED_HEAP; open <= RADIX_HEAP; open++)
+        {
+            unique_ptr<StreetRouter> router = createRouter(&sm, RouteCost(kind), OpenSetKind(open));
+            int matches = 0, agree = 0;
+            double miles, totalMiles = 0;
+            t0 = chrono::steady_clock::now();
+            for (int i = 0; i < pairs; i++)
+            {
+                if (router->generatePointToPointRoute(from[i], to[i], route, miles) != DELIVERY_SUCCESS)
+                    miles = -1;
+                else
+                    totalMiles += miles;
+                if (abs(miles - reference[i]) < 1e-9)
+                    matches++;
+                if (open == INDEXED_HEAP)
+                    indexedMiles[i] = miles;
+                else if (abs(miles - indexedMiles[i]) < 1e-9)
+                    agree++;
+            }
+            double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / pairs;
+            cout << names[kind] << string(18 - string(names[kind]).size(), ' ') << openSets[open]
+                 << string(14 - string(openSets[open]).size(), ' ') << millis << " ms per route, "
+                 << totalMiles / pairs << " miles on average";
+            if (kind == SHORTEST_DISTANCE)
+                cout << ", " << matches << " of " << pairs << " match PointToPointRouter";
+            if (kind == SHORTEST_DISTANCE && open == INDEXED_HEAP)
+                chainMillis = millis;
+            if (open == RADIX_HEAP)
+                cout << ", " << agree << " of " << pairs << " as long as the indexed heap's";
+            cout << endl;
+        }
+    }
+
+    // SHORTEST_DISTANCE again over every intersection, to show what collapsing chains saves
+    SearchScratch scratch;
+    vector<int> edges;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < pairs; i++)
+        searchStreetGraph(*g, g->findNode(from[i]), g->findNode(to[i]), DistanceCost(), CrowFliesHeuristic{ 1 }, scratch, edges);
+    double fullMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / pairs;
+    sm.chains()->report(cout);
+    cout << "Without chains       " << fullMillis << " ms per route, " << fullMillis / chainMillis
+         << "x the chain graph's time" << endl;
+    return 0;
+}
+
+  // depotsFile has one "latitude longitude" per line
+int buildDepotTrees(string mapFile, string depotsFile, string treeFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    ifstream inf(depotsFile);
+    if (!inf)
+    {
+        cout << "Unable to load depot file " << depotsFile << endl;
+        return 1;
+    }
+    vector<GeoCoord> depots;
+    string lat, lon;
+    while (inf >> lat >> lon)
+        depots.push_back(GeoCoord(lat, lon));
+
+    DepotTrees trees(&sm);
+    auto t0 = chrono::steady_clock::now();
+    if (!trees.build(depots, treeFile))
+    {
+        cout << "Unable to build depot trees into " << treeFile << " (is every depot an intersection?)" << endl;
+        return 1;
+    }
+    double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout.setf(ios::fixed);
+    cout.precision(2);
+    cout << "Built " << depots.size() << " depot trees into " << treeFile << " in " << buildSeconds << " s" << endl;
+    return 0;
+}
+
+  // --load-test mapdata.txt, then the LoadProfile fields in order, each optional
+int generateLoad(int argc, char* argv[])
+{
+    StreetMap sm;
+    if (!sm.load(argv[2]))
+    {
+        cout << "Unable to load map data file " << argv[2] << endl;
+        return 1;
+    }
+    LoadProfile profile;
+    if (argc >= 4) profile.threads = atoi(argv[3]);
+    if (argc >= 5) profile.requestsPerSecond = atof(argv[4]);
+    if (argc >= 6) profile.requests = atoi(argv[5]);
+    if (argc >= 7) profile.seed = strtoul(argv[6], nullptr, 10);
+    if (argc >= 8) profile.minStops = atoi(argv[7]);
+    if (argc >= 9) profile.maxStops = atoi(argv[8]);
+    if (argc >= 10) profile.clusteredFraction = atof(argv[9]);
+    if (argc >= 11) profile.clusterMiles = atof(argv[10]);
+    if (argc >= 12) profile.deadlineMillis = atof(argv[11]);
+
+    LoadReport report;
+    if (!runLoad(&sm, profile, report))
+    {
+        cout << "Unable to generate load with these settings" << endl;
+        return 1;
+    }
+    writeLoadReport(profile, report, cout);
+    return 0;
+}
+
+int searchStreets(string mapFile, string text, string crossStreet)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    StreetNameIndex index(&sm);
+    vector<int> streets, segments;
+
+    index.findPrefix(text, streets);
+    cout << "Starting with \"" << text << "\":" << endl;
+    for (int s : streets)
+    {
+        index.segmentsOf(s, segments);
+        cout << "  " << index.streetName(s) << " (" << segments.size() << " segments)" << endl;
+    }
+    index.findFuzzy(text, streets);
+    cout << "Close to \"" << text << "\":" << endl;
+    for (int s : streets)
+    {
+        index.segmentsOf(s, segments);
+        cout << "  " << index.streetName(s) << " (" << segments.size() << " segments)" << endl;
+    }
+
+    if (!crossStreet.empty())
+    {
+        vector<GeoCoord> corners;
+        if (!index.intersectionsOf(text, crossStreet, corners))
+            cout << "No street matches one of the names." << endl;
+        else
+        {
+            cout << index.streetName(index.findStreet(text)) << " meets " << index.streetName(index.findStreet(crossStreet))
+                 << " at " << corners.size() << " intersections" << endl;
+            for (const auto& c : corners)
+                cout << "  " << c.latitudeText << " " << c.longitudeText << endl;
+        }
+    }
+
+    const int LOOKUPS = 10000;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++)
+        index.findFuzzy(text, streets);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout.setf(ios::fixed);
+    cout.precision(0);
+    cout << LOOKUPS / seconds << " fuzzy lookups/s, index is " << index.memoryBytes() / 1024 << " KB" << endl;
+    return 0;
+}
+
+  // plans the deliveries, then has the driver miss a turn again and again: each time one street
+  // away from somewhere on a random leg's route, at the intersection or, every other time,
+  // partway along the street. Checks every new remainder against PointToPointRouter's route
+  // from the intersection the reroute starts at
+int benchmarkReroutes(string mapFile, string deliveriesFile, int reroutes)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    GeoCoord depot;
+    vector<DeliveryRequest> deliveries;
+    if (!loadDeliveryRequests(deliveriesFile, depot, deliveries))
+    {
+        cout << "Unable to load delivery request file " << deliveriesFile << endl;
+        return 1;
+    }
+    DeliveryPlan plan(&sm);
+    if (plan.generate(depot, deliveries) != DELIVERY_SUCCESS || plan.legCount() == 0)
+    {
+        cout << "No plan to reroute" << endl;
+        return 1;
+    }
+
+    // turns are missed off the routes as first planned, not what's left of them after rerouting
+    vector<vector<StreetSegment>> planned;
+    for (int leg = 0; leg < plan.legCount(); leg++)
+        planned.push_back(vector<StreetSegment>(plan.legRoute(leg).begin(), plan.legRoute(leg).end()));
+
+    PointToPointRouter router(&sm);
+    mt19937 rng(2020);
+    vector<bool> rerouted(plan.legCount(), false);
+    vector<StreetSegment> turns;
+    list<StreetSegment> route;
+    double firstMillis = 0, laterMillis = 0;
+    int firsts = 0, laters = 0, matches = 0, done = 0;
+    for (int i = 0; i < reroutes; i++)
+    {
+        int leg = rng() % plan.legCount();
+        if (planned[leg].empty())
+            continue;
+        sm.getSegmentsThatStartWith(planned[leg][rng() % planned[leg].size()].start, turns);
+        const StreetSegment& turn = turns[rng() % turns.size()];
+        GeoCoord position = turn.end;
+        if (i % 2 == 1)
+            position = GeoCoord(to_string(turn.start.latitude + (turn.end.latitude - turn.start.latitude) * 0.3),
+                                to_string(turn.start.longitude + (turn.end.longitude - turn.start.longitude) * 0.3));
+
+        auto t0 = chrono::steady_clock::now();
+        DeliveryResult result = plan.reroute(leg, position);
+        double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (result != DELIVERY_SUCCESS)
+            continue;
+        if (!rerouted[leg])
+        {
+            firstMillis += millis;
+            firsts++;
+            rerouted[leg] = true;
+        }
+        else
+        {
+            laterMillis += millis;
+            laters++;
+        }
+        done++;
+
+        const GeoCoord& stop = leg < int(plan.deliveries().size()) ? plan.deliveries()[leg].location : depot;
+        GeoCoord corner = sm.graph()->coord(sm.graph()->nearestNode(position));
+        double miles, legMiles = 0;
+        for (const StreetSegment& s : plan.legRoute(leg))
+            legMiles += distanceEarthMiles(s.start, s.end);
+        if (router.generatePointToPointRoute(corner, stop, route, miles) == DELIVERY_SUCCESS && abs(miles - legMiles) < 1e-9)
+            matches++;
+    }
+
+    cout.setf(ios::fixed);
+    cout.precision(3);
+    cout << done << " reroutes over " << plan.legCount() << " legs, " << matches << " as short as PointToPointRouter's" << endl;
+    if (firsts > 0)
+        cout << "First on a leg (builds its tree): " << firstMillis / firsts << " ms" << endl;
+    if (laters > 0)
+        cout << "Later ones:                       " << laterMillis / laters * 1000 << " us" << endl;
+    cout << plan.commands().size() << " commands, " << plan.totalDistanceTravelled() << " miles in the plan now" << endl;
+    return 0;
+}
+
+  // settled nodes per second with threads building shortest path trees at once, under each graph
+  // placement. Thread t is bound to node t % nodes before it asks for the graph, so with replicas
+  // it reads its own node's copy for the whole run
+int benchmarkPlacement(string mapFile, int threads, int trees)
+{
+    if (threads < 1)
+        threads = 1;
+    const char* names[] = { "default pages", "transparent huge pages", "explicit huge pages", "huge pages, per node" };
+    GraphPlacement placements[] = {
+        { DEFAULT_PAGES, false }, { TRANSPARENT_HUGE_PAGES, false },
+        { EXPLICIT_HUGE_PAGES, false }, { TRANSPARENT_HUGE_PAGES, true }
+    };
+    cout.setf(ios::fixed);
+    cout.precision(1);
+    cout << threads << " threads, " << trees << " trees each, " << numaNodeCount() << " NUMA nodes" << endl;
+    for (int p = 0; p < 4; p++)
+    {
+        long long hugeBefore = hugePageBytes();
+        StreetMap sm;
+        sm.setGraphPlacement(placements[p]);
+        if (!sm.load(mapFile))
+        {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        long long hugeAfter = hugePageBytes();
+
+        atomic<long long> settled(0);
+        vector<thread> workers;
+        auto t0 = chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++)
+            workers.push_back(thread([&sm, &settled, trees, t]() {
+                bindThreadToNode(t % numaNodeCount());
+                const StreetGraph* g = sm.graph();
+                mt19937 rng(2020 + t);
+                vector<int> parentEdge;
+                long long mine = 0;
+                for (int i = 0; i < trees; i++)
+                {
+                    g->shortestPathTree(rng() % g->nodeCount(), parentEdge);
+                    for (size_t v = 0; v < parentEdge.size(); v++)
+                        if (parentEdge[v] != -1)
+                            mine++;
+                    mine++; // the root
+                }
+                settled += mine;
+            }));
+        for (thread& w : workers)
+            w.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+        cout << names[p] << string(24 - string(names[p]).size(), ' ') << settled / seconds / 1e6
+             << " million nodes settled per second";
+        if (hugeAfter >= 0 && hugeBefore >= 0)
+            cout << ", " << (hugeAfter - hugeBefore) / 1024 << " kB more on huge pages";
+        cout << endl;
+    }
+    return 0;
+}
+
+  // random sources and orders: every order's nearest source, from one search for all of them and
+  // from assignWave with one source struck off each order's candidates, checked against a
+  // shortest path tree grown from each source on its own
+int checkNearestSources(string mapFile, int sources, int orders, int threads)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    if (sources < 2 || orders < 1)
+    {
+        cout << "Need at least 2 sources and 1 order." << endl;
+        return 1;
+    }
+    const StreetGraph* g = sm.graph();
+    mt19937 rng(2020);
+    vector<int> sourceNode, orderNode;
+    vector<GeoCoord> sourceAt, orderAt;
+    for (int i = 0; i < sources; i++)
+    {
+        sourceNode.push_back(rng() % g->nodeCount());
+        sourceAt.push_back(g->coord(sourceNode.back()));
+    }
+    for (int i = 0; i < orders; i++)
+    {
+        orderNode.push_back(rng() % g->nodeCount());
+        orderAt.push_back(g->coord(orderNode.back()));
+    }
+
+    // reference[s][i]: road miles from source s to order i, -1 if it can't get there
+    auto t0 = chrono::steady_clock::now();
+    vector<vector<double>> reference(sources, vector<double>(orders, -1));
+    vector<int> parentEdge;
+    for (int s = 0; s < sources; s++)
+    {
+        g->shortestPathTree(sourceNode[s], parentEdge);
+        for (int i = 0; i < orders; i++)
+        {
+            double miles = 0;
+            int v = orderNode[i];
+            while (v != sourceNode[s] && parentEdge[v] != -1)
+            {
+                miles += g->edgeMiles(parentEdge[v]);
+                v = g->edgeSource(parentEdge[v]);
+            }
+            if (v == sourceNode[s])
+                reference[s][i] = miles;
+        }
+    }
+    double treeMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    // the best of the allowed sources, or -1; a pick is right if no allowed source is nearer
+    auto best = [&](int i, int skip) {
+        double bestMiles = -1;
+        for (int s = 0; s < sources; s++)
+            if (s != skip && reference[s][i] >= 0 && (bestMiles < 0 || reference[s][i] < bestMiles))
+                bestMiles = reference[s][i];
+        return bestMiles;
+    };
+    auto right = [&](int i, int skip, int picked, double miles) {
+        double expected = best(i, skip);
+        if (picked == -1)
+            return expected < 0;
+        return picked != skip && abs(miles - expected) < 1e-9 && abs(reference[picked][i] - expected) < 1e-9;
+    };
+
+    NearestSource nearest(&sm);
+    vector<int> source;
+    vector<double> miles;
+    t0 = chrono::steady_clock::now();
+    if (nearest.nearestForEach(sourceAt, orderAt, source, miles) != DELIVERY_SUCCESS)
+    {
+        cout << "No source is an intersection." << endl;
+        return 1;
+    }
+    double oneSearchMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    int correct = 0;
+    for (int i = 0; i < orders; i++)
+        if (right(i, -1, source[i], miles[i]))
+            correct++;
+
+    vector<vector<GeoCoord>> candidates(orders, sourceAt);
+    for (int i = 0; i < orders; i++)
+        candidates[i].erase(candidates[i].begin() + i % sources);
+    t0 = chrono::steady_clock::now();
+    nearest.assignWave(candidates, orderAt, source, miles, threads);
+    double waveMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    int waveCorrect = 0;
+    for (int i = 0; i < orders; i++)
+    {
+        int skip = i % sources;
+        int picked = source[i] >= skip ? source[i] + 1 : source[i]; // back to an index into all sources
+        if (right(i, skip, source[i] == -1 ? -1 : picked, miles[i]))
+            waveCorrect++;
+    }
+
+    cout.setf(ios::fixed);
+    cout.precision(1);
+    cout << sources << " sources, " << orders << " orders" << endl;
+    cout << "One tree per source   " << treeMillis << " ms" << endl;
+    cout << "nearestForEach        " << oneSearchMillis << " ms, " << correct << " of " << orders << " nearest" << endl;
+    cout << "assignWave, " << threads << " threads " << waveMillis << " ms, " << waveCorrect << " of " << orders << " nearest" << endl;
+    return correct == orders && waveCorrect == orders ? 0 : 1;
+}
+
+  // random pairs routed by a RegionalRouter over a partitionMap() directory and by
+  // PointToPointRouter over the whole map: how often they agree, whether each regional route
+  // really runs from start to end along streets of the map, and how much of the map the regional
+  // router held at its most, next to the whole map's graph
+int benchmarkRegional(string mapFile, string partitionDir, int pairs, int residentCells)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    RegionalRouter regional(residentCells);
+    if (!regional.load(partitionDir))
+    {
+        cout << "Unable to load partitions from " << partitionDir << "; write them with --partition first" << endl;
+        return 1;
+    }
+    const StreetGraph* g = sm.graph();
+    mt19937 rng(2020);
+    vector<GeoCoord> from, to;
+    for (int i = 0; i < pairs; i++)
+    {
+        from.push_back(g->coord(rng() % g->nodeCount()));
+        to.push_back(g->coord(rng() % g->nodeCount()));
+    }
+
+    PointToPointRouter router(&sm);
+    int routed = 0, agree = 0, longer = 0, shorter = 0, broken = 0, resultDiffers = 0, peakCells = 0;
+    size_t peakBytes = 0;
+    double routerMillis = 0, regionalMillis = 0;
+    list<StreetSegment> route, regionalRoute;
+    vector<StreetSegment> segs;
+    for (int i = 0; i < pairs; i++)
+    {
+        double miles, regionalMiles;
+        auto t0 = chrono::steady_clock::now();
+        DeliveryResult expected = router.generatePointToPointRoute(from[i], to[i], route, miles);
+        auto t1 = chrono::steady_clock::now();
+        DeliveryResult result = regional.generatePointToPointRoute(from[i], to[i], regionalRoute, regionalMiles);
+        auto t2 = chrono::steady_clock::now();
+        routerMillis += chrono::duration<double, milli>(t1 - t0).count();
+        regionalMillis += chrono::duration<double, milli>(t2 - t1).count();
+        peakCells = max(peakCells, regional.residentCellCount());
+        peakBytes = max(peakBytes, regional.residentCellBytes());
+        if (result != expected)
+        {
+            resultDiffers++;
+            continue;
+        }
+        if (result != DELIVERY_SUCCESS)
+            continue;
+        routed++;
+
+        // every segment has to be a street of the whole map, each starting where the last ended
+        GeoCoord at = from[i];
+        double sum = 0;
+        bool intact = true;
+        for (const StreetSegment& seg : regionalRoute)
+        {
+            bool isStreet = false;
+            if (seg.start == at && sm.getSegmentsThatStartWith(seg.start, segs))
+                for (size_t k = 0; k < segs.size() && !isStreet; k++)
+                    isStreet = segs[k].end == seg.end && segs[k].name == seg.name;
+            intact = intact && isStreet;
+            sum += distanceEarthMiles(seg.start, seg.end);
+            at = seg.end;
+        }
+        if (!intact || at != to[i] || abs(sum - regionalMiles) > 1e-6)
+            broken++;
+        if (abs(regionalMiles - miles) < 1e-4)
+            agree++;
+        else if (regionalMiles > miles)
+            longer++;
+        else
+            shorter++;
+    }
+
+    cout.setf(ios::fixed);
+    cout.precision(2);
+    cout << regional.cellCount() << " cells, at most " << residentCells << " resident" << endl;
+    cout << "PointToPointRouter: " << routerMillis / pairs << " ms per route" << endl;
+    cout << "RegionalRouter:     " << regionalMillis / pairs << " ms per route" << endl;
+    cout << agree << " of " << routed << " routed distances match, " << longer << " longer, " << shorter << " shorter, "
+         << resultDiffers << " with a different result, " << broken << " routes broken" << endl;
+    cout << "Whole map graph:    " << g->memoryBytes() / 1024 << " KB" << endl;
+    cout << "Regional, at most:  " << peakCells << " cells, " << peakBytes / 1024 << " KB, plus "
+         << regional.overlayBytes() / 1024 << " KB of crossing streets and shortcuts" << endl;
+    return 0;
+}
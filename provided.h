@@ -16,13 +16,19 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <limits>
+#include <memory>
 
 
+  // DEADLINE_EXCEEDED comes with a best-effort result; see Deadline.h
 enum DeliveryResult
 {
-    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD
+    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD, TIME_WINDOW_VIOLATION, DEADLINE_EXCEEDED
 };
 
+class Deadline;
+enum RouteCost : int;   // StreetRouter.h
+
 struct GeoCoord
 {
     GeoCoord(std::string lat, std::string lon)
@@ -81,6 +87,9 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
 }
 
 class StreetMapImpl;
+class StreetGraph;
+class ChainGraph;
+struct GraphPlacement;
 
 class StreetMap
 {
@@ -88,7 +97,34 @@ public:
     StreetMap();
     ~StreetMap();
     bool load(std::string mapFile);
+      // instead of load: reads only the index of a directory written by tileMap() (TiledMap.h),
+      // then loads tiles as getSegmentsThatStartWith reaches them, keeping at most
+      // maxResidentTiles in memory. The default holds a search frontier across the bundled map
+      // with the default tile size; much fewer and a long route reloads the same tiles over and over
+    bool loadTiles(std::string tileDir, int maxResidentTiles = 16);
+      // how load() lays out the graph arrays: on huge pages, and with a copy per NUMA node
+      // (GraphMemory.h). Tiles always get ordinary pages
+    void setGraphPlacement(const GraphPlacement& placement);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // the compact node/edge arrays behind the map (StreetGraph.h), for the routing code;
+      // nullptr for a tiled map. With replicatePerNode, the copy on the calling thread's node
+    const StreetGraph* graph() const;
+      // the same graph with its chains of two-street intersections collapsed (ChainGraph.h);
+      // nullptr for a tiled map
+    const ChainGraph* chains() const;
+      // connected component of an intersection; coordinates with different components have no
+      // route between them. -1 if gc isn't an intersection, or for a tiled map, where it's unknown
+    int componentOf(const GeoCoord& gc) const;
+    int residentTileCount() const;
+    int tileLoadCount() const;
+      // for routing a tile at a time: the tile a coordinate falls in (-1 if it's off the grid or
+      // the tile has no streets), and tile t's graph, read in if it isn't resident and kept for
+      // as long as the pointer is held. A node on a street that leaves its tile is in both tiles,
+      // but only its own has all of its streets. prefetchTile starts reading a tile in the
+      // background. A map that isn't tiled is a single tile 0, holding graph()
+    int tileOf(double latitude, double longitude) const;
+    std::shared_ptr<const StreetGraph> tileGraph(int t) const;
+    void prefetchTile(int t) const;
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -98,6 +134,7 @@ private:
 
 class PointToPointRouterImpl;
 
+  // keeps its search arrays between calls, so use one per thread
 class PointToPointRouter
 {
 public:
@@ -108,6 +145,8 @@ public:
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // nullptr (the default) for no time limit
+    void setDeadline(const Deadline* deadline);
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -118,10 +157,26 @@ private:
 struct DeliveryRequest
 {
     DeliveryRequest(std::string it, const GeoCoord& loc)
-     : item(it), location(loc)
+     : item(it), location(loc), earliestArrival(0),
+       latestArrival(std::numeric_limits<double>::infinity()), serviceTime(0)
+    {}
+
+      // times are in minutes after leaving the depot
+    DeliveryRequest(std::string it, const GeoCoord& loc, double earliest, double latest, double service = 0)
+     : item(it), location(loc), earliestArrival(earliest), latestArrival(latest), serviceTime(service)
     {}
+
+    bool hasTimeWindow() const
+    {
+        return earliestArrival > 0  ||  latestArrival != std::numeric_limits<double>::infinity();
+    }
+
     std::string item;
     GeoCoord location;
+    double earliestArrival;   // driver waits if early
+    double latestArrival;     // infinity if there is no deadline
+    double serviceTime;       // minutes spent handing over the item
+};
 
 class DeliveryOptimizerImpl;
 
@@ -130,11 +185,19 @@ class DeliveryOptimizer
 public:
     DeliveryOptimizer(const StreetMap* sm);
     ~DeliveryOptimizer();
-    void optimizeDeliveryOrder(
+      // returns false if no order was found that meets every delivery's time window
+    bool optimizeDeliveryOrder(
         const GeoCoord& depot,
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // Batches with at most maxStops deliveries are ordered exactly (Held-Karp);
+      // larger batches fall back to nearest-neighbor + 2-opt.
+    void setExactSolverLimit(int maxStops);
+      // Travel times for time-window checks are crow-flies miles at this speed.
+    void setAverageSpeed(double milesPerHour);
+      // stop improving the order once this passes, and keep the best so far
+    void setDeadline(const Deadline* deadline);
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -216,6 +279,73 @@ private:
     double       m_distance;    // 1.92 (in miles)
 };
 
+  // takes a plan's commands a leg at a time, in order, as soon as each leg is routed. Leg i
+  // ends at the plan's i-th delivery, and the last leg back at the depot
+class DeliveryCommandSink
+{
+public:
+    virtual ~DeliveryCommandSink() {}
+    virtual void legRouted(int leg, const std::vector<DeliveryCommand>& commands, double legDistance) = 0;
+};
+
+class DeliveryPlanImpl;
+class DepotTrees;
+
+  // An ordered set of deliveries together with the routed legs between them, kept so the
+  // plan can be amended without routing it again from scratch. Leg i ends at delivery i;
+  // the last leg returns to the depot.
+class DeliveryPlan
+{
+public:
+    DeliveryPlan(const StreetMap* sm);
+    ~DeliveryPlan();
+      // order the deliveries and route every leg, replacing whatever the plan held. With a sink,
+      // legs are routed on background threads and each is handed to it, on this thread, as soon
+      // as it and all the legs before it are done; if a leg then fails, the ones already handed
+      // over stand and the plan is left as it was. An exception from the sink also leaves the
+      // plan as it was, and comes out of generate once the routing threads have stopped
+    DeliveryResult generate(const GeoCoord& depot, const std::vector<DeliveryRequest>& deliveries,
+                            DeliveryCommandSink* sink = nullptr);
+      // add one delivery at its cheapest position, routing only the two legs on either side
+      // of it; on failure the plan is left as it was. BAD_COORD if generate() hasn't succeeded
+      // yet, since until then the plan has no depot
+    DeliveryResult insertDelivery(const DeliveryRequest& request);
+    const std::vector<DeliveryRequest>& deliveries() const;
+    const std::vector<DeliveryCommand>& commands() const;
+    double totalDistanceTravelled() const;
+    int legCount() const;
+    const std::list<StreetSegment>& legRoute(int leg) const;
+      // index into commands() of the leg's first command, and for each of the leg's
+      // segments the index (relative to that) of the command that covers it
+    int legFirstCommand(int leg) const;
+    const std::vector<int>& legSegmentCommands(int leg) const;
+      // the driver has left the route of leg and is at position: the rest of the leg becomes the
+      // cheapest way by the route cost from there to its stop, and only its commands are redone.
+      // A position between intersections (a GPS fix) is moved to the nearest intersection that
+      // can reach the stop first; on a tiled map it has to be an intersection. Under
+      // SHORTEST_DISTANCE the first reroute of a leg builds a shortest-path tree into its stop,
+      // and later ones just follow it; other costs search each time, and can hit the deadline
+    DeliveryResult reroute(int leg, const GeoCoord& position);
+      // time windows are checked as the DeliveryOptimizer checks them, with crow-flies miles at
+      // this speed (DEFAULT_AVERAGE_SPEED_MPH unless set), both when generating and inserting
+    void setAverageSpeed(double milesPerHour);
+      // what legs are routed by (StreetRouter.h), SHORTEST_DISTANCE unless set. A tiled map only
+      // has SHORTEST_DISTANCE, so it's used there whatever this says
+    void setRouteCost(RouteCost cost);
+      // route legs out of and back into depots from these trees where they have one; they must
+      // outlive the plan. The trees are by distance, so they're only used while the route cost
+      // is SHORTEST_DISTANCE
+    void useDepotTrees(const DepotTrees* trees);
+      // generate and insertDelivery return DEADLINE_EXCEEDED, with the best-effort plan in
+      // place, if this passed before they were done
+    void setDeadline(const Deadline* deadline);
+      // We prevent a DeliveryPlan object from being copied or assigned.
+    DeliveryPlan(const DeliveryPlan&) = delete;
+    DeliveryPlan& operator=(const DeliveryPlan&) = delete;
+private:
+    DeliveryPlanImpl* m_impl;
+};
+
 class DeliveryPlannerImpl;
 
 class DeliveryPlanner
@@ -228,6 +358,16 @@ public:
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // the same plan, with each leg's commands handed to sink as soon as that leg is routed
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        DeliveryCommandSink& sink,
+        double& totalDistanceTravelled) const;
+      // on DEADLINE_EXCEEDED, commands and totalDistanceTravelled hold the best-effort plan
+    void setDeadline(const Deadline* deadline);
+      // as DeliveryPlan::setRouteCost
+    void setRouteCost(RouteCost cost);
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;